@@ -1,33 +1,70 @@
 // CGIHandler.cpp
 #include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
-#include <limits.h>
+#include <errno.h>
 #include <iostream>
+#include <vector>
 #include <cstring>
+#include <cctype>
+#include <algorithm>
 #include "CGIHandler.hpp"
+#include "CGISpawner.hpp"
+#include "CGILimiter.hpp"
 #include "HTTPResponse.hpp"
 #include "Server.hpp"
 #include "Logger.hpp"
+#include "Metrics.hpp"
 #include "Utils.hpp"
 
 CGIHandler::CGIHandler::CGIHandler(const std::string& scriptPath, const std::string& interpreterPath, const HTTPRequest& request)
-    : _scriptPath(scriptPath), _request(request), _interpreterPath(interpreterPath), _pid(-1), _CGIOutput(""), _bytesSent(0), _started(false), _cgiFinished(false), _cgiExitStatus(-1) {
+    : _scriptPath(scriptPath), _request(request), _interpreterPath(interpreterPath), _pid(-1), _CGIOutput(""), _bytesSent(0), _started(false), _inputExpected(0), _inputReceived(0),
+      _lastReadTime(0), _lastSendTime(0), _readTimeout(DEFAULT_TIMEOUT_MS), _sendTimeout(DEFAULT_TIMEOUT_MS), _maxOutput(0), _outputTotal(0), _outputExceeded(false),
+      _cgiFinished(false), _cgiExitStatus(-1), _failureStatus(500), _useSpawner(false), _spawned(false), _spawnRequest(0), _splice(false), _pipeSize(0), _inputBlocked(false),
+      _stderrWindowStart(0), _stderrLines(0), _stderrSuppressed(0), _concurrencySlot(NULL) {
     _outputPipeFd[0] = -1;
     _outputPipeFd[1] = -1;
     _inputPipeFd[0] = -1;
     _inputPipeFd[1] = -1;
-    setCGIInput(request.getBody().c_str());
+    _errorPipeFd[0] = -1;
+    _errorPipeFd[1] = -1;
+    setCGIInput(request.getBody());
+    _inputExpected = _CGIInput.size();
+    _inputReceived = _CGIInput.size();
 }
 
-CGIHandler::~CGIHandler() {}
+CGIHandler::~CGIHandler() {
+    if (_spawnRequest)
+        CGISpawner::instance().cancel(_spawnRequest);
+    // Ne laisse ni zombie ni process orphelin si le client part avant la fin
+    if (_pid > 0 && !_cgiFinished) {
+        isCgiDone();
+        if (!_cgiFinished)
+            terminateCGI();
+    }
+    closeInputPipe();
+    closeOutputPipe();
+    drainErrors();
+    closeErrorPipe();
+    flushErrors();
+    if (_concurrencySlot)
+        CGILimiter::instance().release(_concurrencySlot);
+}
 
 // Getters
 int CGIHandler::getPid() const { return _pid; }
 int CGIHandler::getInputPipeFd() const { return _inputPipeFd[1]; }
 int CGIHandler::getOutputPipeFd() const { return _outputPipeFd[0]; }
+int CGIHandler::getErrorPipeFd() const { return _errorPipeFd[0]; }
 std::string CGIHandler::getCGIInput() const { return _CGIInput; }
 std::string CGIHandler::getCGIOutput() const { return _CGIOutput; }
+std::string& CGIHandler::getCGIOutputBuffer() { return _CGIOutput; }
+bool CGIHandler::isOutputClosed() const { return _outputPipeFd[0] == -1; }
+int CGIHandler::getFailureStatus() const { return _failureStatus; }
 
 // Setters
 void CGIHandler::setPid(int pid) { _pid = pid; }
@@ -41,6 +78,21 @@ void CGIHandler::setOutputPipeFd(int outputPipeFd[2]) {
 }
 void CGIHandler::setCGIInput(const std::string& CGIInput) { _CGIInput = CGIInput; }
 void CGIHandler::setCGIOutput(const std::string& CGIOutput) { _CGIOutput = CGIOutput; }
+void CGIHandler::setUseSpawner(bool useSpawner) { _useSpawner = useSpawner; }
+void CGIHandler::setContext(const CGIContext& context) { _context = context; }
+void CGIHandler::setResourceLimits(const CGIResourceLimits& limits) { _limits = limits; }
+void CGIHandler::setConcurrencySlot(const Location* location) { _concurrencySlot = location; }
+void CGIHandler::setLimits(unsigned long readTimeout, unsigned long sendTimeout, size_t maxOutput) {
+    if (readTimeout)
+        _readTimeout = readTimeout;
+    if (sendTimeout)
+        _sendTimeout = sendTimeout;
+    _maxOutput = maxOutput;
+}
+void CGIHandler::setPipeOptions(bool splice, int pipeSize) {
+    _splice = splice;
+    _pipeSize = pipeSize;
+}
 
 int CGIHandler::isCgiDone() {
     if (_cgiFinished) {
@@ -48,20 +100,24 @@ int CGIHandler::isCgiDone() {
     }
 
     int status;
-    pid_t result = waitpid(_pid, &status, WNOHANG);
+    struct rusage usage;
+    if (_spawned) {
+        // Enfant du helper : c'est lui qui le récolte et nous renvoie le statut
+        if (!_spawnRequest && CGISpawner::instance().collectExit(_pid, status, usage)) {
+            recordExitStatus(status);
+            reportUsage(usage);
+            return _cgiExitStatus;
+        }
+        return 0;
+    }
+
+    pid_t result = wait4(_pid, &status, WNOHANG, &usage);
     if (result == 0) {
         // Process is still running
         return 0;
     } else if (result == _pid) {
-        if (WIFEXITED(status) || WIFSIGNALED(status)) {
-            if (WEXITSTATUS(status))
-                _cgiExitStatus = WEXITSTATUS(status);
-            else if (WTERMSIG(status))
-                _cgiExitStatus = WTERMSIG(status);
-        } else {
-            _cgiExitStatus = -1;
-        }
-        _cgiFinished = true;
+        recordExitStatus(status);
+        reportUsage(usage);
         return _cgiExitStatus;
     } else {
         Logger::instance().log(ERROR, "isCGIDone: waitpid failed: " + std::string(to_string(errno)));
@@ -71,40 +127,181 @@ int CGIHandler::isCgiDone() {
     }
 }
 
+// 0 pour une sortie normale, sinon le code de sortie ou le signal reçu
+void CGIHandler::recordExitStatus(int status) {
+    if (WIFEXITED(status)) {
+        _cgiExitStatus = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        _cgiExitStatus = WTERMSIG(status);
+    } else {
+        _cgiExitStatus = -1;
+    }
+    _cgiFinished = true;
+}
+
+void CGIHandler::reportUsage(const struct rusage& usage) const {
+    unsigned long userMs = usage.ru_utime.tv_sec * 1000 + usage.ru_utime.tv_usec / 1000;
+    unsigned long systemMs = usage.ru_stime.tv_sec * 1000 + usage.ru_stime.tv_usec / 1000;
+    // ru_maxrss : Ko sous Linux
+    unsigned long maxRss = usage.ru_maxrss > 0 ? usage.ru_maxrss : 0;
+    Logger::instance().log(INFO, "CGI usage [" + _context.requestId + "] " + (_context.scriptName.empty() ? _scriptPath : _context.scriptName)
+                                 + ": status=" + to_string(_cgiExitStatus) + " user=" + to_string(userMs) + "ms sys=" + to_string(systemMs)
+                                 + "ms maxrss=" + to_string(maxRss) + "KB");
+    Metrics::instance().observe(Metrics::labeled("cgi_cpu_ms", "location", _context.location), userMs + systemMs);
+    Metrics::instance().observe(Metrics::labeled("cgi_maxrss_kb", "location", _context.location), maxRss);
+}
+
+// Retourne 0 quand il n'y a plus rien à écrire pour l'instant (le pipe est
+// fermé une fois tout le corps transmis), une valeur positive sinon.
 int CGIHandler::writeToCGI() {
     if (_inputPipeFd[1] == -1) {
         return -1;
     }
+    // POLLOUT : le pipe a de nouveau de la place pour splice()
+    _inputBlocked = false;
 
-    const char* bufferPtr = _CGIInput.c_str() + _bytesSent;
-    ssize_t remaining = _CGIInput.size() - _bytesSent;
-    ssize_t bytesWritten = write(_inputPipeFd[1], bufferPtr, remaining);
+    size_t remaining = _CGIInput.size() - _bytesSent;
+    if (remaining) {
+        ssize_t bytesWritten = write(_inputPipeFd[1], _CGIInput.data() + _bytesSent, remaining);
+        if (bytesWritten > 0) {
+            _bytesSent += bytesWritten;
+            _lastSendTime = curr_time_ms();
+        } else if (bytesWritten == -1) {
+            Logger::instance().log(ERROR, "writeToCGI: Write error");
+        }
+    }
 
-    if (bytesWritten > 0) {
-        _bytesSent += bytesWritten;
-    } else if (bytesWritten == -1) {
-        Logger::instance().log(ERROR, "writeToCGI: Write error");
+    if (_bytesSent < _CGIInput.size()) {
+        return 1;
     }
 
-    if (_bytesSent == _CGIInput.size()) {
+    _CGIInput.clear();
+    _bytesSent = 0;
+    if (!isAwaitingBody()) {
         // All data sent; close the input pipe
         close(_inputPipeFd[1]);
         _inputPipeFd[1] = -1;
-        return 0; // Indicate that writing is complete
     }
+    return 0;
+}
+
+void CGIHandler::setStreamedBody(size_t contentLength) {
+    _inputExpected = contentLength;
+}
+
+// Octets de corps lus sur le socket client. Si le script a déjà fermé son
+// entrée, ils sont simplement consommés.
+void CGIHandler::appendInput(const char* data, size_t size) {
+    _inputReceived += size;
+    // Le délai du script court à partir du dernier octet reçu
+    _lastReadTime = curr_time_ms();
+    if (_inputPipeFd[1] == -1)
+        return;
+    if (!getPendingInputSize())
+        _lastSendTime = _lastReadTime;
+    if (_bytesSent > _CGIInput.size() / 2) {
+        _CGIInput.erase(0, _bytesSent);
+        _bytesSent = 0;
+    }
+    _CGIInput.append(data, size);
+}
+
+bool CGIHandler::isAwaitingBody() const {
+    return _inputReceived < _inputExpected;
+}
 
-    return _bytesSent;
+size_t CGIHandler::getRemainingBody() const {
+    return isAwaitingBody() ? _inputExpected - _inputReceived : 0;
 }
 
-bool CGIHandler::hasReceivedBody() {
-    std::string sequence = "\r\n\r\n";
-    size_t pos = getCGIOutput().find(sequence);
+size_t CGIHandler::getPendingInputSize() const {
+    return _CGIInput.size() - _bytesSent;
+}
 
-    if (pos == std::string::npos)
-        return false;
-    return ((pos + 4) < getCGIOutput().length());
-} 
+bool CGIHandler::hasPendingInput() const {
+    return _inputPipeFd[1] != -1 && (getPendingInputSize() || !isAwaitingBody() || _inputBlocked);
+}
 
+bool CGIHandler::canSplice() const {
+#ifdef __linux__
+    return _splice;
+#else
+    return false;
+#endif
+}
+
+bool CGIHandler::isInputBlocked() const {
+    return _inputBlocked;
+}
+
+// Corps de requête déplacé du socket client vers l'entrée du script sans
+// passer par _CGIInput. Retourne 0 s'il faut passer par read() (rien en
+// attente sur le socket, ou données déjà bufferisées à écrire avant),
+// -1 si le pipe est plein.
+ssize_t CGIHandler::spliceInput(int sourceFd) {
+#ifdef __linux__
+    if (!_splice || _inputPipeFd[1] == -1 || getPendingInputSize() || !isAwaitingBody())
+        return 0;
+    // FIONREAD lève l'ambiguïté d'un EAGAIN : socket vide ou pipe plein
+    int available = 0;
+    if (ioctl(sourceFd, FIONREAD, &available) == -1 || available <= 0)
+        return 0;
+    size_t length = std::min(static_cast<size_t>(available), getRemainingBody());
+    ssize_t moved = splice(sourceFd, NULL, _inputPipeFd[1], NULL, length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (moved > 0) {
+        _inputReceived += moved;
+        _lastReadTime = curr_time_ms();
+        _lastSendTime = _lastReadTime;
+        return moved;
+    }
+    if (moved == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        // Le script cesse de lire : cgi_send_timeout court depuis maintenant
+        if (!_inputBlocked)
+            _lastSendTime = curr_time_ms();
+        _inputBlocked = true;
+        return -1;
+    }
+    return 0;
+#else
+    (void)sourceFd;
+    return 0;
+#endif
+}
+
+// Sortie du script envoyée telle quelle vers le client. Comme readFromCGI(),
+// retourne 0 sur EOF (le pipe est alors fermé) et -1 avec errno sinon.
+ssize_t CGIHandler::spliceOutput(int destinationFd, size_t length) {
+#ifdef __linux__
+    if (_outputPipeFd[0] == -1)
+        return -1;
+    length = outputAllowance(length);
+    if (length == 0) {
+        errno = EFBIG;
+        return -1;
+    }
+    ssize_t moved = splice(_outputPipeFd[0], NULL, destinationFd, NULL, length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE);
+    if (moved > 0) {
+        _outputTotal += moved;
+        _lastReadTime = curr_time_ms();
+    } else if (moved == 0) {
+        close(_outputPipeFd[0]);
+        _outputPipeFd[0] = -1;
+    }
+    return moved;
+#else
+    (void)destinationFd;
+    (void)length;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+bool CGIHandler::hasExited() const {
+    return _cgiFinished;
+}
+
+// Pipe non bloquant : retourne 0 sur EOF (le pipe est alors fermé),
+// -1 s'il n'y a rien à lire pour l'instant.
 int CGIHandler::readFromCGI() {
     if (_outputPipeFd[0] == -1) {
         return -1;
@@ -112,7 +309,12 @@ int CGIHandler::readFromCGI() {
     char buffer[4096];
     ssize_t bytesRead = read(_outputPipeFd[0], buffer, sizeof(buffer));
     if (bytesRead > 0) {
-        _CGIOutput.append(buffer, bytesRead);
+        size_t accepted = outputAllowance(bytesRead);
+        _CGIOutput.append(buffer, accepted);
+        _outputTotal += accepted;
+        _lastReadTime = curr_time_ms();
+        if (_outputExceeded)
+            return -1; // cgi_max_output : la boucle tue le script
     } else if (bytesRead == 0) {
         close(_outputPipeFd[0]);
         _outputPipeFd[0] = -1;
@@ -121,18 +323,73 @@ int CGIHandler::readFromCGI() {
 }
 
 bool CGIHandler::hasTimedOut() const {
-    unsigned long currentTime = curr_time_ms();
-    return (currentTime - _startTime) > CGI_TIMEOUT_MS;
+    return curr_time_ms() - _lastReadTime > _readTimeout;
+}
+
+// Un script sorti a déjà été jugé ; seule sa sortie compte une fois fermée
+CGIHandler::Limit CGIHandler::checkLimits() const {
+    if (_outputExceeded)
+        return OUTPUT_TOO_LARGE;
+    if (isOutputClosed())
+        return WITHIN_LIMITS;
+    unsigned long now = curr_time_ms();
+    if (getInputPipeFd() != -1 && (getPendingInputSize() || _inputBlocked) && now - _lastSendTime > _sendTimeout)
+        return SEND_TIMEOUT;
+    if (now - _lastReadTime > _readTimeout)
+        return READ_TIMEOUT;
+    return WITHIN_LIMITS;
+}
+
+unsigned long CGIHandler::timeUntilLimit() const {
+    unsigned long now = curr_time_ms();
+    unsigned long elapsed = now - _lastReadTime;
+    unsigned long remaining = elapsed >= _readTimeout ? 0 : _readTimeout - elapsed;
+    if (getInputPipeFd() != -1 && (getPendingInputSize() || _inputBlocked)) {
+        elapsed = now - _lastSendTime;
+        remaining = std::min(remaining, elapsed >= _sendTimeout ? 0 : _sendTimeout - elapsed);
+    }
+    return remaining;
+}
+
+void CGIHandler::resetReadTimer() {
+    _lastReadTime = curr_time_ms();
+}
+
+// cgi_max_output : part de `size` octets de sortie encore acceptée
+size_t CGIHandler::outputAllowance(size_t size) {
+    if (!_maxOutput)
+        return size;
+    size_t left = _outputTotal < _maxOutput ? _maxOutput - _outputTotal : 0;
+    if (size > left) {
+        _outputExceeded = true;
+        return left;
+    }
+    return size;
 }
 
 void CGIHandler::terminateCGI() {
-    if (_pid > 0) {
-        kill(_pid, SIGKILL);
-        waitpid(_pid, NULL, 0);
-        _pid = -1;
+    if (_spawnRequest) {
+        // Pas encore lancé : le spawner tuera le script s'il démarre quand même
+        CGISpawner::instance().cancel(_spawnRequest);
+        _spawnRequest = 0;
+        _cgiFinished = true;
+        _cgiExitStatus = SIGKILL;
+    }
+    if (_pid > 0 && !_cgiFinished) {
+        if (kill(-_pid, SIGKILL) == -1)
+            kill(_pid, SIGKILL);
+        _cgiFinished = true;
+        _cgiExitStatus = SIGKILL;
+        struct rusage usage;
+        if (_spawned)
+            CGISpawner::instance().forget(_pid);
+        else if (wait4(_pid, NULL, 0, &usage) == _pid)
+            reportUsage(usage);
     }
     closeInputPipe();
     closeOutputPipe();
+    drainErrors();
+    closeErrorPipe();
 }
 
 bool CGIHandler::endsWith(const std::string& str, const std::string& suffix) const {
@@ -144,7 +401,8 @@ bool CGIHandler::endsWith(const std::string& str, const std::string& suffix) con
 }
 
 bool CGIHandler::startCGI() {
-    _startTime = curr_time_ms();
+    _lastReadTime = curr_time_ms();
+    _lastSendTime = _lastReadTime;
     Logger::instance().log(DEBUG, "Startin CGI script: " + _scriptPath);
 
     std::string interpreter = _interpreterPath;
@@ -159,64 +417,204 @@ bool CGIHandler::startCGI() {
         Logger::instance().log(ERROR, std::string("executeCGI: Output pipe failed: ") + strerror(errno));
         return false;
     }
+    if (pipe(_errorPipeFd) == -1) {
+        Logger::instance().log(ERROR, std::string("executeCGI: Error pipe failed: ") + strerror(errno));
+        return false;
+    }
+
+    if (_pipeSize > 0) {
+        resizePipe(_inputPipeFd[1]);
+        resizePipe(_outputPipeFd[1]);
+    }
 
     Logger::instance().log(DEBUG, std::string("pipe fds : INPUT 0 : ") + to_string(_inputPipeFd[0]) + " - INPUT 1 : " + to_string(_inputPipeFd[1]) + " - OUTPUT 0 : " + to_string(_outputPipeFd[0])  + " - OUTPUT 1 : " + to_string(_outputPipeFd[1]));
 
+    // argv et envp sont prêts avant le fork : l'enfant n'a plus qu'à execve()
+    std::vector<std::string> args;
+    args.push_back(interpreter);
+    args.push_back(_scriptPath);
+    std::vector<std::string> env = buildEnvironment(_inputExpected);
+
+    if (_useSpawner) {
+        // Côté serveur, les pipes servent dès maintenant : le script, lui,
+        // démarre quand le helper répond (onSpawned)
+        setNonBlocking(_outputPipeFd[0]);
+        setNonBlocking(_inputPipeFd[1]);
+        setNonBlocking(_errorPipeFd[0]);
+        _spawnRequest = CGISpawner::instance().spawn(args, env, _inputPipeFd[0], _outputPipeFd[1], _errorPipeFd[1], _limits, this);
+        if (_spawnRequest) {
+            _spawned = true;
+            return true;
+        }
+        // Spawner indisponible, demande non partie : on retombe sur fork()
+    }
+
+    std::vector<char*> argv;
+    for (size_t i = 0; i < args.size(); ++i)
+        argv.push_back(const_cast<char*>(args[i].c_str()));
+    argv.push_back(NULL);
+    std::vector<char*> envp;
+    envp.reserve(env.size() + 1);
+    for (size_t i = 0; i < env.size(); ++i)
+        envp.push_back(const_cast<char*>(env[i].c_str()));
+    envp.push_back(NULL);
+
     int pid = fork();
     if (pid == 0) {
-        // Processus enfant : exécution du script CGI
+        // Processus enfant : exécution du script CGI, dans son propre groupe
+        // pour que terminateCGI() atteigne aussi ses descendants
+        setpgid(0, 0);
+        // Le serveur ignore SIGPIPE : le script retrouve les signaux par
+        // défaut, comme avec le helper CGISpawner
+        signal(SIGINT, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
         close(_outputPipeFd[0]);
         dup2(_outputPipeFd[1], STDOUT_FILENO);
         close(_outputPipeFd[1]);
         close(_inputPipeFd[1]);
         dup2(_inputPipeFd[0], STDIN_FILENO);
         close(_inputPipeFd[0]);
+        close(_errorPipeFd[0]);
+        dup2(_errorPipeFd[1], STDERR_FILENO);
+        close(_errorPipeFd[1]);
+        if (!_limits.empty() && !_limits.apply()) {
+            std::string message = std::string("cgi resource limits: ") + strerror(errno) + "\n";
+            ssize_t ret = write(STDERR_FILENO, message.data(), message.size());
+            (void)ret;
+            _exit(EXIT_FAILURE);
+        }
 
-        setupEnvironment(_request, _scriptPath);
-
-        execl(interpreter.c_str(), interpreter.c_str(), _scriptPath.c_str(), NULL);
+        execve(argv[0], &argv[0], &envp[0]);
         Logger::instance().log(ERROR, std::string("executeCGI: Failed to execute CGI script: ") + _scriptPath + std::string(". Error: ") + strerror(errno));
-        exit(EXIT_FAILURE);
+        _exit(EXIT_FAILURE);
     } else if (pid > 0){
-        _pid = pid;
-        _started = true;
-        close(_outputPipeFd[1]);
-        close(_inputPipeFd[0]);
-        return true;
+        setpgid(pid, pid);
+        return attachChild(pid);
     } else if (pid == -1) {
         Logger::instance().log(ERROR, "executeCGI: Fork failed: " + std::string(strerror(errno)));
         close(_inputPipeFd[0]);
         close(_inputPipeFd[1]);
         close(_outputPipeFd[0]);
         close(_outputPipeFd[1]);
+        closeErrorPipe();
         return false;
     }
     return true;
 }
 
-void CGIHandler::setupEnvironment(const HTTPRequest& request, std::string scriptPath) {
-    char absPath[PATH_MAX];
-    if (realpath(scriptPath.c_str(), absPath) == NULL) {
-        Logger::instance().log(ERROR, "Failed to get absolute path of the CGI script.");
+// Côté serveur : ne garde que nos extrémités des pipes, en non bloquant
+// Réponse du helper à la demande de startCGI()
+void CGIHandler::onSpawned(pid_t pid, int error) {
+    _spawnRequest = 0;
+    if (pid > 0) {
+        attachChild(pid);
+        return;
+    }
+    // Comme un script mort aussitôt : la sortie se ferme, le statut est un échec
+    Logger::instance().log(ERROR, "executeCGI: CGI spawner could not start " + _scriptPath + ": " + strerror(error));
+    _cgiFinished = true;
+    _cgiExitStatus = -1;
+    close(_outputPipeFd[1]);
+    _outputPipeFd[1] = -1;
+    close(_inputPipeFd[0]);
+    _inputPipeFd[0] = -1;
+    close(_errorPipeFd[1]);
+    _errorPipeFd[1] = -1;
+}
+
+bool CGIHandler::attachChild(int pid) {
+    _pid = pid;
+    _started = true;
+    close(_outputPipeFd[1]);
+    _outputPipeFd[1] = -1;
+    close(_inputPipeFd[0]);
+    _inputPipeFd[0] = -1;
+    close(_errorPipeFd[1]);
+    _errorPipeFd[1] = -1;
+    setNonBlocking(_outputPipeFd[0]);
+    setNonBlocking(_inputPipeFd[1]);
+    setNonBlocking(_errorPipeFd[0]);
+    return true;
+}
+
+// cgi_pipe_size : au-delà de /proc/sys/fs/pipe-max-size le noyau refuse,
+// on garde alors la taille par défaut
+void CGIHandler::resizePipe(int fd) const {
+#ifdef F_SETPIPE_SZ
+    if (fcntl(fd, F_SETPIPE_SZ, _pipeSize) == -1)
+        Logger::instance().log(WARNING, "cgi_pipe_size " + to_string(_pipeSize) + " refused: " + strerror(errno));
+#else
+    (void)fd;
+#endif
+}
+
+namespace {
+    // Content-Type -> HTTP_CONTENT_TYPE
+    std::string headerVariableName(const std::string& header) {
+        std::string name = "HTTP_";
+        name.reserve(5 + header.size());
+        for (size_t i = 0; i < header.size(); ++i) {
+            char c = header[i];
+            name += (c == '-') ? '_' : static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        }
+        return name;
+    }
+}
+
+// Variables CGI de la requête (RFC 3875) au format "NOM=valeur", suivies de
+// l'environnement statique de la location. Sert aussi de paramètres FastCGI.
+std::vector<std::string> CGIHandler::buildEnvironment(size_t contentLength) const {
+    std::map<std::string, std::string> headers = _request.getHeaders();
+    std::vector<std::string> env;
+    env.reserve(16 + headers.size() + (_context.staticEnv ? _context.staticEnv->size() : 0));
+
+    std::string query = _request.getQueryString();
+    std::string scriptName = _context.scriptName.empty() ? _scriptPath : _context.scriptName;
+
+    env.push_back("REQUEST_METHOD=" + _request.getMethod());
+    env.push_back("QUERY_STRING=" + query);
+    env.push_back("REQUEST_URI=" + _request.getPath() + (query.empty() ? "" : "?" + query));
+    env.push_back("SCRIPT_NAME=" + scriptName);
+    env.push_back("SCRIPT_FILENAME=" + absolutePath(_scriptPath));
+    env.push_back("CONTENT_LENGTH=" + to_string(contentLength));
+    std::string contentType = _request.getStrHeader("Content-Type");
+    if (!contentType.empty())
+        env.push_back("CONTENT_TYPE=" + contentType);
+    if (!_context.pathInfo.empty()) {
+        env.push_back("PATH_INFO=" + _context.pathInfo);
+        env.push_back("PATH_TRANSLATED=" + absolutePath(_context.documentRoot) + _context.pathInfo);
+    }
+
+    // SERVER_NAME : l'hôte demandé, sans le port
+    std::string serverName = _request.getStrHeader("Host");
+    size_t colonPos = serverName.find(':');
+    if (colonPos != std::string::npos)
+        serverName.erase(colonPos);
+    env.push_back("SERVER_NAME=" + (serverName.empty() ? _context.serverName : serverName));
+    if (_context.serverPort)
+        env.push_back("SERVER_PORT=" + to_string(_context.serverPort));
+    if (!_context.remoteAddr.empty()) {
+        env.push_back("REMOTE_ADDR=" + _context.remoteAddr);
+        env.push_back("REMOTE_PORT=" + to_string(_context.remotePort));
     }
-    
-    std::string contentType = request.getStrHeader("Content-Type");
-    if (!contentType.empty()) {
-        setenv("CONTENT_TYPE", contentType.c_str(), 1);
+    if (!_context.requestId.empty())
+        env.push_back("REQUEST_ID=" + _context.requestId);
+
+    // En-têtes HTTP_* ; Content-* sont déjà transmis et Proxy est écarté (httpoxy)
+    for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+        std::string name = headerVariableName(it->first);
+        if (name == "HTTP_CONTENT_TYPE" || name == "HTTP_CONTENT_LENGTH" || name == "HTTP_PROXY")
+            continue;
+        env.push_back(name + "=" + it->second);
     }
 
-    // Variables CGI standard
-    setenv("REQUEST_METHOD", request.getMethod().c_str(), 1);
-    setenv("CONTENT_LENGTH", to_string(request.getBody().size()).c_str(), 1);
-    setenv("GATEWAY_INTERFACE", "CGI/1.1", 1);
-    setenv("SCRIPT_FILENAME", absPath, 1);
-    setenv("SCRIPT_NAME", scriptPath.c_str(), 1);
-    setenv("QUERY_STRING", request.getQueryString().c_str(), 1);
-    setenv("REDIRECT_STATUS", "200", 1);
-    setenv("SERVER_PROTOCOL", "HTTP/1.1", 1); 
-    std::string host = request.getStrHeader("Host");
-    setenv("SERVER_NAME", host.c_str(), 1);
-    setenv("SERVER_SOFTWARE", "webserv/1.0", 1);
+    if (_context.staticEnv)
+        env.insert(env.end(), _context.staticEnv->begin(), _context.staticEnv->end());
+    return env;
 }
 
 
@@ -242,3 +640,89 @@ void CGIHandler::closeOutputPipe() {
     }
 }
 
+void CGIHandler::closeErrorPipe() {
+    if (_errorPipeFd[0] != -1) {
+        close(_errorPipeFd[0]);
+        _errorPipeFd[0] = -1;
+    }
+    if (_errorPipeFd[1] != -1) {
+        close(_errorPipeFd[1]);
+        _errorPipeFd[1] = -1;
+    }
+}
+
+// Un script bavard ne doit jamais bloquer sur un stderr plein : la boucle
+// vide le pipe dès qu'il est lisible, même si les lignes sont jetées
+int CGIHandler::readErrors() {
+    if (_errorPipeFd[0] == -1)
+        return -1;
+    char buffer[4096];
+    ssize_t bytesRead = read(_errorPipeFd[0], buffer, sizeof(buffer));
+    if (bytesRead > 0) {
+        logErrors(buffer, bytesRead);
+        return bytesRead;
+    }
+    if (bytesRead == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return -1;
+    closeErrorPipe();
+    flushErrors();
+    return 0;
+}
+
+// Dernières lignes déjà écrites par le script, avant la fermeture du pipe
+void CGIHandler::drainErrors() {
+    for (int reads = 0; reads < 16 && readErrors() > 0; ++reads)
+        ;
+}
+
+std::string CGIHandler::errorPrefix() const {
+    return "CGI stderr [" + _context.requestId + "] " + (_context.scriptName.empty() ? _scriptPath : _context.scriptName) + ": ";
+}
+
+// Découpe en lignes ; une ligne trop longue est tronquée à STDERR_MAX_LINE
+void CGIHandler::logErrors(const char* data, size_t size) {
+    size_t start = 0;
+    while (start < size) {
+        const char* newline = static_cast<const char*>(memchr(data + start, '\n', size - start));
+        size_t end = newline ? static_cast<size_t>(newline - data) : size;
+        if (_stderrLine.size() < STDERR_MAX_LINE)
+            _stderrLine.append(data + start, std::min(end - start, STDERR_MAX_LINE - _stderrLine.size()));
+        if (!newline)
+            break;
+        logErrorLine();
+        start = end + 1;
+    }
+}
+
+void CGIHandler::logErrorLine() {
+    if (!_stderrLine.empty() && _stderrLine[_stderrLine.size() - 1] == '\r')
+        _stderrLine.erase(_stderrLine.size() - 1);
+    std::string prefix = errorPrefix();
+    unsigned long now = curr_time_ms();
+    if (now - _stderrWindowStart >= 1000) {
+        if (_stderrSuppressed)
+            Logger::instance().log(WARNING, prefix + to_string(_stderrSuppressed) + " lines suppressed");
+        _stderrWindowStart = now;
+        _stderrLines = 0;
+        _stderrSuppressed = 0;
+    }
+    if (_stderrLines < STDERR_LINES_PER_SECOND) {
+        Logger::instance().log(WARNING, prefix + _stderrLine);
+        ++_stderrLines;
+        Metrics::instance().increment("cgi_stderr_lines_total");
+    } else {
+        ++_stderrSuppressed;
+        Metrics::instance().increment("cgi_stderr_suppressed_total");
+    }
+    _stderrLine.clear();
+}
+
+// Fin du flux : dernière ligne sans retour à la ligne et résumé des lignes jetées
+void CGIHandler::flushErrors() {
+    if (!_stderrLine.empty())
+        logErrorLine();
+    if (_stderrSuppressed) {
+        Logger::instance().log(WARNING, errorPrefix() + to_string(_stderrSuppressed) + " lines suppressed");
+        _stderrSuppressed = 0;
+    }
+}
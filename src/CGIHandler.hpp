@@ -3,24 +3,53 @@
 #define CGIHANDLER_HPP
 
 #include <string>
+#include <map>
+#include <vector>
 #include <stdlib.h>
 #include "HTTPRequest.hpp"
+#include "CGIResourceLimits.hpp"
+#include "CGISpawner.hpp"
 
 class Server;
+struct Location;
+
+// Contexte serveur de la requête CGI, renseigné par Server avant startCGI()
+struct CGIContext {
+    const std::vector<std::string>* staticEnv; // préconstruit au chargement de la config
+    std::string scriptName;
+    std::string pathInfo;
+    std::string documentRoot;
+    std::string serverName;
+    std::string remoteAddr;
+    // X-Request-Id du client ou identifiant généré, repris dans les logs
+    std::string requestId;
+    // Location servie, label des métriques de consommation
+    std::string location;
+    int remotePort;
+    int serverPort;
+
+    CGIContext() : staticEnv(NULL), remotePort(0), serverPort(0) {}
+};
 
-class CGIHandler {
+class CGIHandler : public CGISpawner::Listener {
 public:
     CGIHandler(const std::string& scriptPath, const std::string& interpreterPath, const HTTPRequest& request);
-    ~CGIHandler();
+    virtual ~CGIHandler();
 
-    bool startCGI();
+    virtual bool startCGI();
+    virtual void onSpawned(pid_t pid, int error);
 
     // Getters
     int getPid() const;
-    int getInputPipeFd() const;
-    int getOutputPipeFd() const;
+    virtual int getInputPipeFd() const;
+    virtual int getOutputPipeFd() const;
+    // stderr du script, -1 une fois fermé (ou pour FastCGI)
+    int getErrorPipeFd() const;
+    virtual bool isOutputClosed() const;
+    int getFailureStatus() const;
     std::string getCGIInput() const;
     std::string getCGIOutput() const;
+    std::string& getCGIOutputBuffer();
 
     // Setters
     void setPid(int pid);
@@ -28,20 +57,57 @@ public:
     void setOutputPipeFd(int outputPipeFd[2]);
     void setCGIInput(const std::string& CGIInput);
     void setCGIOutput(const std::string& CGIOutput);
-
-    void closeInputPipe();
-    void closeOutputPipe();
-
-    int writeToCGI();
-    int readFromCGI();
-
-    int isCgiDone();
-    void terminateCGI();
+    void setUseSpawner(bool useSpawner);
+    void setContext(const CGIContext& context);
+    void setPipeOptions(bool splice, int pipeSize);
+    // Slot cgi_max_concurrent rendu à la destruction du handler
+    void setConcurrencySlot(const Location* location);
+    // cgi_read_timeout / cgi_send_timeout (ms, 0 : défaut) et cgi_max_output
+    // (octets, 0 : illimité)
+    void setLimits(unsigned long readTimeout, unsigned long sendTimeout, size_t maxOutput);
+    // cgi_rlimit_* et cgi_nice, posés au lancement du script
+    void setResourceLimits(const CGIResourceLimits& limits);
+
+    virtual void closeInputPipe();
+    virtual void closeOutputPipe();
+    void closeErrorPipe();
+
+    virtual int writeToCGI();
+    virtual int readFromCGI();
+    // Vide le pipe stderr vers les logs ; retourne 0 à la fermeture du pipe
+    int readErrors();
+    void drainErrors();
+
+    // Corps de requête reçu au fil de l'eau (cgi_request_buffering off)
+    void setStreamedBody(size_t contentLength);
+    virtual void appendInput(const char* data, size_t size);
+    bool isAwaitingBody() const;
+    size_t getRemainingBody() const;
+    size_t getPendingInputSize() const;
+    // Vrai s'il faut surveiller l'entrée en écriture (données ou fermeture)
+    virtual bool hasPendingInput() const;
+
+    // Relais sans copie par splice() (cgi_splice on, Linux uniquement)
+    bool canSplice() const;
+    ssize_t spliceInput(int sourceFd);
+    ssize_t spliceOutput(int destinationFd, size_t length);
+    bool isInputBlocked() const;
+
+    virtual int isCgiDone();
+    bool hasExited() const;
+    virtual void terminateCGI();
     bool hasTimedOut() const;
 
-    bool hasReceivedBody();
+    enum Limit { WITHIN_LIMITS, READ_TIMEOUT, SEND_TIMEOUT, OUTPUT_TOO_LARGE };
+    // Limite franchie par un script dont la sortie est encore ouverte
+    Limit checkLimits() const;
+    // Délai avant la prochaine échéance de checkLimits()
+    unsigned long timeUntilLimit() const;
+    // Le serveur ne lit plus la sortie (client lent) : le délai de lecture
+    // ne court pas
+    void resetReadTimer();
 
-private:
+protected:
     std::string _scriptPath;
     const HTTPRequest& _request;
 	std::string _interpreterPath;
@@ -49,22 +115,74 @@ private:
     int _pid;
     int _inputPipeFd[2];
     int _outputPipeFd[2];
+    int _errorPipeFd[2];
 
     std::string _CGIInput;
     std::string _CGIOutput;
 
     size_t  _bytesSent;
     bool    _started;
+    // Taille annoncée du corps et octets déjà reçus du client
+    size_t  _inputExpected;
+    size_t  _inputReceived;
+
+    // Dernière sortie lue (ou dernier octet de corps reçu du client) et
+    // dernière écriture vers l'entrée du script
+    unsigned long _lastReadTime;
+    unsigned long _lastSendTime;
+    unsigned long _readTimeout;
+    unsigned long _sendTimeout;
+    static const unsigned long DEFAULT_TIMEOUT_MS = 5000;
+
+    size_t _maxOutput;
+    size_t _outputTotal;
+    bool _outputExceeded;
+    size_t outputAllowance(size_t size);
 
-    unsigned long _startTime;
-    static const unsigned long CGI_TIMEOUT_MS = 5000;
+    CGIContext _context;
 
-	void setupEnvironment(const HTTPRequest&, std::string scriptPath);
+    std::vector<std::string> buildEnvironment(size_t contentLength) const;
 
     bool endsWith(const std::string& str, const std::string& suffix) const;
+    bool attachChild(int pid);
+    void recordExitStatus(int status);
+    // Temps CPU et mémoire du script récolté : logs et métriques par location
+    void reportUsage(const struct rusage& usage) const;
 
 	bool _cgiFinished;
     int _cgiExitStatus;
+    // Code HTTP renvoyé si le script échoue avant d'avoir produit ses en-têtes
+    int _failureStatus;
+
+    // Lancement via le helper CGISpawner plutôt que fork() (cgi_spawner on)
+    bool _useSpawner;
+    bool _spawned;
+    // Demande au helper encore sans réponse (0 : aucune)
+    unsigned int _spawnRequest;
+    CGIResourceLimits _limits;
+
+    bool _splice;
+    int _pipeSize;
+    // Le dernier splice() vers l'entrée du script a trouvé le pipe plein
+    bool _inputBlocked;
+
+    void resizePipe(int fd) const;
+
+    // Lignes de stderr : au plus STDERR_LINES_PER_SECOND par seconde et par
+    // script, le reste est compté puis résumé en une ligne
+    std::string _stderrLine;
+    unsigned long _stderrWindowStart;
+    size_t _stderrLines;
+    size_t _stderrSuppressed;
+    static const size_t STDERR_LINES_PER_SECOND = 20;
+    static const size_t STDERR_MAX_LINE = 1024;
+
+    void logErrors(const char* data, size_t size);
+    void logErrorLine();
+    void flushErrors();
+    std::string errorPrefix() const;
+
+    const Location* _concurrencySlot;
 };
 
 #endif
@@ -0,0 +1,108 @@
+// CGILimiter.cpp
+#include "CGILimiter.hpp"
+#include "Metrics.hpp"
+#include "Logger.hpp"
+
+CGILimiter& CGILimiter::instance() {
+    static CGILimiter instance;
+    return instance;
+}
+
+CGILimiter::CGILimiter() {}
+
+CGILimiter::Admission CGILimiter::admit(const Location& location, const void* waiter, unsigned long now) {
+    Pool& pool = _pools[&location];
+    pool.location = &location;
+
+    std::deque<Waiter>::iterator position = pool.queue.begin();
+    while (position != pool.queue.end() && position->id != waiter)
+        ++position;
+    bool queued = position != pool.queue.end();
+
+    if (pool.active < location.cgiMaxConcurrent && (pool.queue.empty() || position == pool.queue.begin())) {
+        unsigned long waited = 0;
+        if (queued) {
+            waited = now - position->since;
+            pool.queue.pop_front();
+        }
+        ++pool.active;
+        Metrics::instance().observe(Metrics::labeled("cgi_queue_wait_ms", "location", location.path), waited);
+        publish(pool);
+        return ADMITTED;
+    }
+
+    if (queued) {
+        if (now - position->since < location.cgiQueueTimeout)
+            return QUEUED;
+        pool.queue.erase(position);
+        Metrics::instance().increment(Metrics::labeled("cgi_queue_timeouts_total", "location", location.path));
+        publish(pool);
+        return REJECTED_TIMEOUT;
+    }
+
+    if (pool.queue.size() >= location.cgiQueueSize) {
+        Metrics::instance().increment(Metrics::labeled("cgi_queue_rejected_total", "location", location.path));
+        return REJECTED_FULL;
+    }
+    Waiter entry;
+    entry.id = waiter;
+    entry.since = now;
+    pool.queue.push_back(entry);
+    publish(pool);
+    Logger::instance().log(DEBUG, "CGI request queued in " + location.path);
+    return QUEUED;
+}
+
+bool CGILimiter::tryAcquire(const Location& location) {
+    Pool& pool = _pools[&location];
+    pool.location = &location;
+    if (pool.active >= location.cgiMaxConcurrent || !pool.queue.empty())
+        return false;
+    ++pool.active;
+    publish(pool);
+    return true;
+}
+
+void CGILimiter::release(const Location* location) {
+    std::map<const Location*, Pool>::iterator it = _pools.find(location);
+    if (it == _pools.end() || it->second.active == 0)
+        return;
+    --it->second.active;
+    publish(it->second);
+}
+
+void CGILimiter::cancel(const Location* location, const void* waiter) {
+    std::map<const Location*, Pool>::iterator it = _pools.find(location);
+    if (it == _pools.end())
+        return;
+    std::deque<Waiter>& queue = it->second.queue;
+    for (std::deque<Waiter>::iterator position = queue.begin(); position != queue.end(); ++position) {
+        if (position->id == waiter) {
+            queue.erase(position);
+            publish(it->second);
+            return;
+        }
+    }
+}
+
+long CGILimiter::pollTimeout(unsigned long now) const {
+    long timeout = -1;
+    for (std::map<const Location*, Pool>::const_iterator it = _pools.begin(); it != _pools.end(); ++it) {
+        const Pool& pool = it->second;
+        if (pool.queue.empty())
+            continue;
+        if (pool.active < pool.location->cgiMaxConcurrent)
+            return 0;
+        // La tête de file est la plus ancienne, donc la première à expirer
+        unsigned long elapsed = now - pool.queue.front().since;
+        long remaining = elapsed >= pool.location->cgiQueueTimeout ? 0 : static_cast<long>(pool.location->cgiQueueTimeout - elapsed);
+        if (timeout == -1 || remaining < timeout)
+            timeout = remaining;
+    }
+    return timeout;
+}
+
+void CGILimiter::publish(const Pool& pool) const {
+    Metrics::instance().setGauge(Metrics::labeled("cgi_active", "location", pool.location->path), pool.active);
+    Metrics::instance().setGauge(Metrics::labeled("cgi_queue_depth", "location", pool.location->path), pool.queue.size());
+}
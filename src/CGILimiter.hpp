@@ -0,0 +1,56 @@
+// CGILimiter.hpp
+#ifndef CGILIMITER_HPP
+#define CGILIMITER_HPP
+
+#include <deque>
+#include <map>
+#include "Location.hpp"
+
+/*
+ * Limite le nombre de CGI simultanés par location (cgi_max_concurrent).
+ * Les requêtes en excès attendent dans une file FIFO bornée
+ * (cgi_queue_size) au plus cgi_queue_timeout ms, puis sont refusées en 503.
+ * Un slot libéré revient à la tête de file avant tout nouvel arrivant.
+ */
+class CGILimiter {
+public:
+    enum Admission { ADMITTED, QUEUED, REJECTED_FULL, REJECTED_TIMEOUT };
+
+    static CGILimiter& instance();
+
+    // `waiter` identifie la requête en file d'un appel à l'autre
+    Admission admit(const Location& location, const void* waiter, unsigned long now);
+    // Slot pris seulement s'il est libre et que personne n'attend, sans file :
+    // pour les CGI lancés sans client (rafraîchissement de cgi_cache)
+    bool tryAcquire(const Location& location);
+    void release(const Location* location);
+    // La requête en attente est partie (client déconnecté)
+    void cancel(const Location* location, const void* waiter);
+
+    // Délai max de poll() pour servir la file à temps : 0 si un slot libre
+    // attend sa tête de file, -1 si aucune requête n'attend
+    long pollTimeout(unsigned long now) const;
+
+private:
+    CGILimiter();
+    CGILimiter(const CGILimiter&);
+    CGILimiter& operator=(const CGILimiter&);
+
+    struct Waiter {
+        const void* id;
+        unsigned long since;
+    };
+
+    struct Pool {
+        const Location* location;
+        int active;
+        std::deque<Waiter> queue;
+        Pool() : location(NULL), active(0) {}
+    };
+
+    std::map<const Location*, Pool> _pools;
+
+    void publish(const Pool& pool) const;
+};
+
+#endif
@@ -0,0 +1,32 @@
+// CGIResourceLimits.cpp
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "CGIResourceLimits.hpp"
+
+namespace {
+    // Le type des constantes RLIMIT_* varie (enum sous glibc en C++)
+    template <typename Resource>
+    bool setLimit(Resource resource, rlim_t soft, rlim_t hard) {
+        struct rlimit limit;
+        limit.rlim_cur = soft;
+        limit.rlim_max = hard;
+        return setrlimit(resource, &limit) == 0;
+    }
+}
+
+bool CGIResourceLimits::empty() const {
+    return !cpuSeconds && !addressSpace && !openFiles && !nice;
+}
+
+bool CGIResourceLimits::apply() const {
+    // SIGXCPU à la limite, SIGKILL une seconde plus tard s'il l'ignore
+    if (cpuSeconds && !setLimit(RLIMIT_CPU, cpuSeconds, cpuSeconds + 1))
+        return false;
+    if (addressSpace && !setLimit(RLIMIT_AS, addressSpace, addressSpace))
+        return false;
+    if (openFiles && !setLimit(RLIMIT_NOFILE, openFiles, openFiles))
+        return false;
+    if (nice && setpriority(PRIO_PROCESS, 0, nice) == -1)
+        return false;
+    return true;
+}
@@ -0,0 +1,25 @@
+// CGIResourceLimits.hpp
+#ifndef CGIRESOURCELIMITS_HPP
+#define CGIRESOURCELIMITS_HPP
+
+#include <sys/types.h>
+
+/*
+ * cgi_rlimit_cpu, cgi_rlimit_as, cgi_rlimit_nofile et cgi_nice d'une
+ * location (0 : rien à changer). Posées dans l'enfant juste avant execve(),
+ * qu'il vienne du fork du serveur ou de celui du helper CGISpawner.
+ */
+struct CGIResourceLimits {
+    unsigned long cpuSeconds;
+    unsigned long addressSpace;
+    unsigned long openFiles;
+    int nice;
+
+    CGIResourceLimits() : cpuSeconds(0), addressSpace(0), openFiles(0), nice(0) {}
+
+    bool empty() const;
+    // Sur le process courant ; false avec errno à la première erreur
+    bool apply() const;
+};
+
+#endif
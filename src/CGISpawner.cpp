@@ -0,0 +1,538 @@
+// CGISpawner.cpp
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <spawn.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <cstdlib>
+#include <cstring>
+#include "CGISpawner.hpp"
+#include "Logger.hpp"
+#include "Metrics.hpp"
+#include "Utils.hpp"
+
+namespace {
+    // Self-pipe du helper : SIGCHLD réveille son poll()
+    int sigchldPipe[2] = { -1, -1 };
+
+    void sigchldHandler(int) {
+        int savedErrno = errno;
+        char byte = 0;
+        ssize_t ret = write(sigchldPipe[1], &byte, 1);
+        (void)ret;
+        errno = savedErrno;
+    }
+
+    void setCloseOnExec(int fd) {
+        fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+    }
+
+    // Tout sauf stdin/stdout/stderr et `keep`
+    void closeInheritedFds(int keep) {
+        std::vector<int> fds;
+        DIR* dir = opendir("/proc/self/fd");
+        if (dir) {
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != NULL) {
+                if (entry->d_name[0] != '.')
+                    fds.push_back(std::atoi(entry->d_name));
+            }
+            closedir(dir);
+        } else {
+            for (long fd = 3; fd < sysconf(_SC_OPEN_MAX); ++fd)
+                fds.push_back(fd);
+        }
+        for (size_t i = 0; i < fds.size(); ++i) {
+            if (fds[i] > STDERR_FILENO && fds[i] != keep)
+                close(fds[i]);
+        }
+    }
+}
+
+CGISpawner& CGISpawner::instance() {
+    static CGISpawner instance;
+    return instance;
+}
+
+CGISpawner::CGISpawner() : _socket(-1), _helperPid(-1), _wanted(false), _lastStart(0), _nextRequest(0) {}
+
+CGISpawner::~CGISpawner() {
+    stop();
+}
+
+bool CGISpawner::isRunning() const {
+    return _socket != -1;
+}
+
+int CGISpawner::getSocketFd() const {
+    return _socket;
+}
+
+bool CGISpawner::start() {
+    if (_socket != -1)
+        return true;
+    _wanted = true;
+    _lastStart = curr_time_ms();
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == -1) {
+        Logger::instance().log(ERROR, std::string("CGI spawner: socketpair failed: ") + strerror(errno));
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        Logger::instance().log(ERROR, std::string("CGI spawner: fork failed: ") + strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        // Relancé en cours de route, le helper hériterait des sockets clients
+        closeInheritedFds(fds[1]);
+        run(fds[1]);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    _socket = fds[0];
+    setCloseOnExec(_socket);
+    _helperPid = pid;
+    Logger::instance().log(INFO, "CGI spawner started with pid " + to_string(pid));
+    return true;
+}
+
+void CGISpawner::stop() {
+    if (_socket != -1) {
+        // Le helper sort dès qu'il lit EOF sur la socket
+        close(_socket);
+        _socket = -1;
+    }
+    if (_helperPid > 0) {
+        waitpid(_helperPid, NULL, 0);
+        _helperPid = -1;
+    }
+    _wanted = false;
+    _pending.clear();
+    _running.clear();
+    _orphans.clear();
+    _exited.clear();
+    _forgotten.clear();
+}
+
+// Les demandes sans réponse échouent : le helper a pu lancer le script
+// avant de disparaître, le relancer ailleurs risquerait de l'exécuter deux
+// fois. Les scripts déjà lancés restent suivis comme orphelins.
+void CGISpawner::helperLost(const std::string& reason) {
+    Logger::instance().log(ERROR, "CGI spawner lost (" + reason + "), restarting it in " + to_string(RESTART_INTERVAL) + "ms");
+    Metrics::instance().increment("cgi_spawner_lost_total");
+    if (_helperPid > 0) {
+        kill(_helperPid, SIGKILL);
+        waitpid(_helperPid, NULL, 0);
+        _helperPid = -1;
+    }
+    close(_socket);
+    _socket = -1;
+    _orphans.insert(_running.begin(), _running.end());
+    _running.clear();
+
+    std::map<unsigned int, Listener*> pending;
+    pending.swap(_pending);
+    for (std::map<unsigned int, Listener*>::iterator it = pending.begin(); it != pending.end(); ++it)
+        it->second->onSpawned(-1, EPIPE);
+}
+
+void CGISpawner::restartIfLost(unsigned long now) {
+    if (!_wanted || _socket != -1 || now - _lastStart < RESTART_INTERVAL)
+        return;
+    if (start())
+        Metrics::instance().increment("cgi_spawner_restarts_total");
+}
+
+long CGISpawner::pollTimeout(unsigned long now) const {
+    if (!_wanted || _socket != -1)
+        return -1;
+    unsigned long elapsed = now - _lastStart;
+    return elapsed >= RESTART_INTERVAL ? 0 : static_cast<long>(RESTART_INTERVAL - elapsed);
+}
+
+unsigned int CGISpawner::spawn(const std::vector<std::string>& argv, const std::vector<std::string>& envp, int stdinFd, int stdoutFd, int stderrFd,
+                               const CGIResourceLimits& limits, Listener* listener) {
+    if (_socket == -1)
+        return 0;
+
+    RequestHeader header;
+    header.type = SPAWN_REQUEST;
+    header.id = ++_nextRequest;
+    if (header.id == 0)
+        header.id = ++_nextRequest;
+    header.argc = argv.size();
+    header.envc = envp.size();
+    header.limits = limits;
+
+    std::string payload(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (size_t i = 0; i < argv.size(); ++i)
+        payload.append(argv[i].c_str(), argv[i].size() + 1);
+    for (size_t i = 0; i < envp.size(); ++i)
+        payload.append(envp[i].c_str(), envp[i].size() + 1);
+    if (payload.size() > MAX_REQUEST_SIZE) {
+        Logger::instance().log(WARNING, "CGI spawner: request too large (" + to_string(payload.size()) + " bytes)");
+        return 0;
+    }
+
+    union {
+        cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int) * SPAWN_FDS)];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    iovec iov;
+    iov.iov_base = const_cast<char*>(payload.data());
+    iov.iov_len = payload.size();
+
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * SPAWN_FDS);
+    int fds[SPAWN_FDS] = { stdinFd, stdoutFd, stderrFd };
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    // SOCK_SEQPACKET : le message part en entier ou pas du tout
+    if (sendmsg(_socket, &msg, 0) != static_cast<ssize_t>(payload.size())) {
+        helperLost(std::string("sendmsg: ") + strerror(errno));
+        return 0;
+    }
+    _pending[header.id] = listener;
+    return header.id;
+}
+
+void CGISpawner::cancel(unsigned int request) {
+    _pending.erase(request);
+}
+
+void CGISpawner::handleSpawnReply(const Reply& reply) {
+    std::map<unsigned int, Listener*>::iterator it = _pending.find(reply.id);
+    if (it == _pending.end()) {
+        // Demande annulée entre-temps : le script ne doit pas tourner seul
+        if (reply.pid > 0) {
+            if (kill(-reply.pid, SIGKILL) == -1)
+                kill(reply.pid, SIGKILL);
+            _forgotten.insert(reply.pid);
+        }
+        return;
+    }
+    Listener* listener = it->second;
+    _pending.erase(it);
+    if (reply.pid > 0)
+        _running.insert(reply.pid);
+    else
+        Logger::instance().log(ERROR, "CGI spawner: failed to launch script: " + std::string(strerror(reply.status)));
+    listener->onSpawned(reply.pid > 0 ? reply.pid : -1, reply.status);
+}
+
+void CGISpawner::handleExit(const Reply& reply) {
+    _running.erase(reply.pid);
+    std::set<pid_t>::iterator it = _forgotten.find(reply.pid);
+    if (it != _forgotten.end()) {
+        _forgotten.erase(it);
+        return;
+    }
+    Exit& exit = _exited[reply.pid];
+    exit.status = reply.status;
+    exit.usage = reply.usage;
+}
+
+// Récupère sans bloquer tout ce que le helper a déjà envoyé
+void CGISpawner::drain() {
+    Reply reply;
+    while (_socket != -1) {
+        ssize_t bytesRead = recv(_socket, &reply, sizeof(reply), MSG_DONTWAIT);
+        if (bytesRead == static_cast<ssize_t>(sizeof(reply))) {
+            if (reply.type == SPAWN_REPLY)
+                handleSpawnReply(reply);
+            else if (reply.type == CHILD_EXITED)
+                handleExit(reply);
+        } else if (bytesRead == 0) {
+            helperLost("connection closed");
+        } else if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            break;
+        } else {
+            helperLost(bytesRead < 0 ? std::string("recv: ") + strerror(errno) : "truncated message");
+        }
+    }
+}
+
+void CGISpawner::handleEvents() {
+    drain();
+}
+
+bool CGISpawner::collectExit(pid_t pid, int& status, struct rusage& usage) {
+    drain();
+    std::map<pid_t, Exit>::iterator it = _exited.find(pid);
+    if (it == _exited.end())
+        return _orphans.count(pid) && collectOrphan(pid, status, usage);
+    status = it->second.status;
+    usage = it->second.usage;
+    _exited.erase(it);
+    return true;
+}
+
+// Script d'un helper perdu : rattaché à init, ou au serveur s'il est le
+// process 1 (conteneur) et peut alors le récolter lui-même. Sinon son
+// statut est perdu : il est compté comme sorti normalement, sa sortie fait foi.
+bool CGISpawner::collectOrphan(pid_t pid, int& status, struct rusage& usage) {
+    memset(&usage, 0, sizeof(usage));
+    pid_t result = wait4(pid, &status, WNOHANG, &usage);
+    if (result == 0)
+        return false;
+    if (result != pid) {
+        if (kill(pid, 0) == 0 || errno != ESRCH)
+            return false;
+        status = 0;
+        Logger::instance().log(WARNING, "CGI spawner: exit status of pid " + to_string(pid) + " lost with its helper");
+    }
+    _orphans.erase(pid);
+    return true;
+}
+
+void CGISpawner::forget(pid_t pid) {
+    drain();
+    if (_orphans.erase(pid)) {
+        // Plus de helper pour le récolter : wait4 seulement s'il est à nous
+        waitpid(pid, NULL, WNOHANG);
+        return;
+    }
+    if (_exited.erase(pid) == 0 && _running.count(pid))
+        _forgotten.insert(pid);
+}
+
+// --- Côté helper ---
+
+void CGISpawner::run(int socketFd) {
+    setCloseOnExec(socketFd);
+    // Le Ctrl-C du terminal vise tout le groupe : le helper attend plutôt que
+    // le serveur ferme la socket
+    signal(SIGINT, SIG_IGN);
+
+    if (pipe(sigchldPipe) == -1)
+        _exit(1);
+    for (int i = 0; i < 2; ++i) {
+        setNonBlocking(sigchldPipe[i]);
+        setCloseOnExec(sigchldPipe[i]);
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchldHandler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    std::vector<char> buffer(MAX_REQUEST_SIZE);
+    while (true) {
+        pollfd fds[2];
+        fds[0].fd = socketFd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = sigchldPipe[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            char drainBuffer[64];
+            while (read(sigchldPipe[0], drainBuffer, sizeof(drainBuffer)) > 0)
+                ;
+            reapChildren(socketFd);
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            union {
+                cmsghdr align;
+                char buffer[CMSG_SPACE(sizeof(int) * SPAWN_FDS)];
+            } control;
+
+            iovec iov;
+            iov.iov_base = &buffer[0];
+            iov.iov_len = buffer.size();
+
+            msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.buffer;
+            msg.msg_controllen = sizeof(control.buffer);
+
+            ssize_t bytesRead = recvmsg(socketFd, &msg, 0);
+            if (bytesRead <= 0)
+                break; // Le serveur est parti
+
+            int receivedFds[SPAWN_FDS] = { -1, -1, -1 };
+            size_t fdCount = 0;
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                fdCount = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                if (fdCount > SPAWN_FDS)
+                    fdCount = SPAWN_FDS;
+                memcpy(receivedFds, CMSG_DATA(cmsg), fdCount * sizeof(int));
+            }
+            handleRequest(socketFd, &buffer[0], bytesRead, receivedFds, fdCount);
+            for (size_t i = 0; i < fdCount; ++i)
+                close(receivedFds[i]);
+        }
+    }
+    _exit(0);
+}
+
+void CGISpawner::handleRequest(int socketFd, char* data, size_t size, const int* fds, size_t fdCount) {
+    Reply reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.type = SPAWN_REPLY;
+    reply.id = 0;
+    reply.pid = -1;
+    reply.status = EINVAL;
+
+    RequestHeader header;
+    if (size >= sizeof(header) && fdCount == SPAWN_FDS) {
+        memcpy(&header, data, sizeof(header));
+        reply.id = header.id;
+
+        // argv puis envp, chaînes terminées par '\0' mises bout à bout
+        std::vector<char*> strings;
+        size_t offset = sizeof(header);
+        while (offset < size && strings.size() < header.argc + header.envc) {
+            strings.push_back(data + offset);
+            offset += strlen(data + offset) + 1;
+        }
+
+        if (header.type == SPAWN_REQUEST && header.argc > 0 && strings.size() == header.argc + header.envc) {
+            std::vector<char*> argv(strings.begin(), strings.begin() + header.argc);
+            argv.push_back(NULL);
+            std::vector<char*> envp(strings.begin() + header.argc, strings.end());
+            envp.push_back(NULL);
+
+            pid_t pid;
+            int err = header.limits.empty() ? posixSpawn(&argv[0], &envp[0], fds, pid) : forkExec(&argv[0], &envp[0], fds, header.limits, pid);
+            if (err == 0) {
+                reply.pid = pid;
+                reply.status = 0;
+            } else {
+                reply.status = err;
+            }
+        }
+    }
+    send(socketFd, &reply, sizeof(reply), 0);
+}
+
+int CGISpawner::posixSpawn(char* const* argv, char* const* envp, const int* fds, pid_t& pid) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[2], STDERR_FILENO);
+
+    // Le script retrouve les signaux par défaut, même ceux que le helper ignore
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGPIPE);
+    sigaddset(&defaults, SIGCHLD);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    // Groupe de process propre : le serveur tue le script et ses descendants
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+
+    int err = posix_spawn(&pid, argv[0], &actions, &attr, argv, envp);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    return err;
+}
+
+// Les limites sont posées dans l'enfant, avant execve() : le script ne
+// s'exécute jamais sans elles. Un pipe close-on-exec remonte l'errno d'un
+// échec (limites ou execve) ; il se ferme sans rien dire si execve réussit.
+int CGISpawner::forkExec(char* const* argv, char* const* envp, const int* fds, const CGIResourceLimits& limits, pid_t& pid) {
+    int errorPipe[2];
+    if (pipe(errorPipe) == -1)
+        return errno;
+    setCloseOnExec(errorPipe[0]);
+    setCloseOnExec(errorPipe[1]);
+
+    pid = fork();
+    if (pid == -1) {
+        int err = errno;
+        close(errorPipe[0]);
+        close(errorPipe[1]);
+        return err;
+    }
+    if (pid == 0) {
+        close(errorPipe[0]);
+        // Mêmes réglages que posixSpawn()
+        signal(SIGINT, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+        setpgid(0, 0);
+        if (dup2(fds[0], STDIN_FILENO) != -1 && dup2(fds[1], STDOUT_FILENO) != -1 && dup2(fds[2], STDERR_FILENO) != -1) {
+            if (limits.apply()) {
+                execve(argv[0], argv, envp);
+            } else {
+                int err = errno;
+                std::string message = std::string("cgi resource limits: ") + strerror(err) + "\n";
+                ssize_t ret = write(STDERR_FILENO, message.data(), message.size());
+                (void)ret;
+                errno = err;
+            }
+        }
+        int err = errno;
+        ssize_t ret = write(errorPipe[1], &err, sizeof(err));
+        (void)ret;
+        _exit(127);
+    }
+
+    close(errorPipe[1]);
+    int err = 0;
+    ssize_t bytesRead;
+    while ((bytesRead = read(errorPipe[0], &err, sizeof(err))) == -1 && errno == EINTR)
+        ;
+    close(errorPipe[0]);
+    if (bytesRead != static_cast<ssize_t>(sizeof(err)))
+        return 0;
+    waitpid(pid, NULL, 0);
+    return err;
+}
+
+void CGISpawner::reapChildren(int socketFd) {
+    Reply reply;
+    reply.type = CHILD_EXITED;
+    reply.id = 0;
+    int status;
+    pid_t pid;
+    while ((pid = wait4(-1, &status, WNOHANG, &reply.usage)) > 0) {
+        reply.pid = pid;
+        reply.status = status;
+        send(socketFd, &reply, sizeof(reply), 0);
+    }
+}
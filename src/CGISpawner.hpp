@@ -0,0 +1,133 @@
+// CGISpawner.hpp
+#ifndef CGISPAWNER_HPP
+#define CGISPAWNER_HPP
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include "CGIResourceLimits.hpp"
+
+/*
+ * Processus auxiliaire forké au démarrage, avant que le serveur n'ait le
+ * moindre état : il lance les scripts CGI avec posix_spawn (fork puis execve
+ * quand la location pose des limites de ressources) à la demande de la
+ * boucle principale, qui n'a donc plus à forker tout son espace mémoire.
+ * C'est aussi lui qui récolte ses enfants et renvoie leur statut de sortie
+ * et leur consommation de ressources.
+ *
+ * Dialogue sur une socketpair SOCK_SEQPACKET (un message par requête) ; les
+ * trois extrémités de pipe du script voyagent en SCM_RIGHTS. La boucle
+ * principale n'attend jamais le helper : chaque demande porte un numéro, et
+ * la réponse arrive plus tard sur la socket, surveillée par poll().
+ * Un helper perdu (socket fermée) est relancé au plus toutes les
+ * RESTART_INTERVAL ms ; les scripts qu'il avait lancés restent suivis.
+ */
+class CGISpawner {
+public:
+    class Listener {
+    public:
+        virtual ~Listener() {}
+        // pid lancé, ou -1 si le lancement a échoué (error : errno)
+        virtual void onSpawned(pid_t pid, int error) = 0;
+    };
+
+    static CGISpawner& instance();
+
+    bool start();
+    void stop();
+    bool isRunning() const;
+    // Socket à surveiller en POLLIN, -1 sans helper
+    int getSocketFd() const;
+    // POLLIN sur la socket : réponses et fins de scripts
+    void handleEvents();
+    // Relance un helper perdu (voir RESTART_INTERVAL)
+    void restartIfLost(unsigned long now);
+    // Délai max de poll() avant la prochaine relance, -1 sans relance prévue
+    long pollTimeout(unsigned long now) const;
+
+    // Demande le lancement ; `listener` est appelé à la réponse du helper.
+    // Retourne le numéro de la demande, 0 si elle n'a pas pu partir : rien
+    // n'a été lancé et l'appelant se rabat sur fork.
+    // Les limites sont posées avant execve() : un script qu'on ne peut pas
+    // limiter n'est pas lancé.
+    unsigned int spawn(const std::vector<std::string>& argv, const std::vector<std::string>& envp, int stdinFd, int stdoutFd, int stderrFd,
+                       const CGIResourceLimits& limits, Listener* listener);
+    // Le demandeur est parti : un script lancé malgré tout est tué
+    void cancel(unsigned int request);
+
+    // Statut et rusage wait4() d'un enfant terminé ; false s'il tourne encore.
+    bool collectExit(pid_t pid, int& status, struct rusage& usage);
+    // L'enfant a été tué par le serveur : son statut ne sera pas réclamé.
+    void forget(pid_t pid);
+
+    static const unsigned long RESTART_INTERVAL = 1000;
+
+private:
+    CGISpawner();
+    ~CGISpawner();
+    CGISpawner(const CGISpawner&);
+    CGISpawner& operator=(const CGISpawner&);
+
+    enum MessageType { SPAWN_REQUEST = 1, SPAWN_REPLY = 2, CHILD_EXITED = 3 };
+
+    struct RequestHeader {
+        int type;
+        unsigned int id;
+        unsigned int argc;
+        unsigned int envc;
+        CGIResourceLimits limits;
+    };
+
+    // SPAWN_REPLY : demande `id`, pid lancé (-1 en cas d'échec, status = errno)
+    // CHILD_EXITED : pid récolté, son statut et son rusage wait4()
+    struct Reply {
+        int type;
+        unsigned int id;
+        pid_t pid;
+        int status;
+        struct rusage usage;
+    };
+
+    struct Exit {
+        int status;
+        struct rusage usage;
+    };
+
+    static const size_t MAX_REQUEST_SIZE = 131072;
+    // stdin, stdout et stderr du script
+    static const size_t SPAWN_FDS = 3;
+
+    int _socket;
+    pid_t _helperPid;
+    // Un helper a déjà été demandé : il sera relancé s'il se perd
+    bool _wanted;
+    unsigned long _lastStart;
+    unsigned int _nextRequest;
+    // Demandes sans réponse, et leur demandeur
+    std::map<unsigned int, Listener*> _pending;
+    // Scripts lancés par le helper courant et pas encore récoltés
+    std::set<pid_t> _running;
+    // Scripts d'un helper perdu : plus de CHILD_EXITED à attendre
+    std::set<pid_t> _orphans;
+    std::map<pid_t, Exit> _exited;
+    std::set<pid_t> _forgotten;
+
+    void handleSpawnReply(const Reply& reply);
+    void handleExit(const Reply& reply);
+    void drain();
+    void helperLost(const std::string& reason);
+    bool collectOrphan(pid_t pid, int& status, struct rusage& usage);
+
+    static void run(int socketFd);
+    static void handleRequest(int socketFd, char* data, size_t size, const int* fds, size_t fdCount);
+    // 0 ou l'errno du lancement ; fds : stdin, stdout et stderr du script
+    static int posixSpawn(char* const* argv, char* const* envp, const int* fds, pid_t& pid);
+    static int forkExec(char* const* argv, char* const* envp, const int* fds, const CGIResourceLimits& limits, pid_t& pid);
+    static void reapChildren(int socketFd);
+};
+
+#endif
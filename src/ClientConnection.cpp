@@ -1,37 +1,63 @@
 // ClientConnection.cpp
 #include <unistd.h>
 #include <errno.h>
+#include <sys/ioctl.h>
+#include <sstream>
 #include "ClientConnection.hpp"
 #include "CGIHandler.hpp"
+#include "CGILimiter.hpp"
+#include "UploadLimiter.hpp"
+#include "UploadStream.hpp"
 #include "Server.hpp"
 #include "HTTPRequest.hpp"
 #include "HTTPResponse.hpp"
+#include "Utils.hpp"
 
 ClientConnection::ClientConnection(Server* server)
-    : _server(server), _request(NULL), _response(NULL), _cgiHandler(NULL), _responseOffset(0), _isSending(false), _exchangeOver(false), _used(false) {}
+    : _server(server), _request(NULL), _response(NULL), _cgiHandler(NULL), _upload(NULL), _responseOffset(0), _sharedOffset(0), _isSending(false), _exchangeOver(false), _used(false), _headRequest(false), _streaming(false), _chunked(false), _chunkRemaining(0), _relayBlocked(false), _cgiSlot(NULL), _queuedFor(NULL), _uploadSlot(NULL), _uploadSlotBytes(0), _uploadQueuedFor(NULL), _cacheCapture(NULL), _awaitingFlight(false) {}
 
 ClientConnection::~ClientConnection() {
+    releaseCGIAdmission();
+    releaseUploadAdmission();
+    dropCacheCapture();
     delete _request;
     delete _response;
+    delete _cgiHandler;
+    delete _upload;
 }
 
 Server* ClientConnection::getServer() const { return _server; }
 HTTPRequest* ClientConnection::getRequest() const { return _request; }
 HTTPResponse* ClientConnection::getResponse() const { return _response; }
 CGIHandler* ClientConnection::getCgiHandler() const { return _cgiHandler; }
+UploadStream* ClientConnection::getUpload() const { return _upload; }
 bool ClientConnection::getExchangeOver() const { return _exchangeOver; }
 bool ClientConnection::getUsed() const { return _used; }
 
 void ClientConnection::setExchangeOver(bool value) { _exchangeOver = value; }
 void ClientConnection::setCgiHandler(CGIHandler* cgiHandler) { this->_cgiHandler = cgiHandler; }
+void ClientConnection::setUpload(UploadStream* upload) {
+    if (_upload != upload)
+        delete _upload;
+    _upload = upload;
+    // Upload terminé ou abandonné : son slot est rendu
+    if (!_upload)
+        releaseUploadAdmission();
+}
 void ClientConnection::setRequest(HTTPRequest* request) { this->_request = request; }
 void ClientConnection::setResponse(HTTPResponse* response) { this->_response = response; }
 void ClientConnection::setRequestActivity(unsigned long time) { _request->setLastActivity(time); }
+void ClientConnection::setHeadRequest(bool value) { _headRequest = value; }
 
 void ClientConnection::prepareResponse() {
     if (_response) {
+        if (_headRequest)
+            _response->setHeadOnly(true);
+        if (_response->isBodyless())
+            _sharedBody = SharedBuffer();
         _responseBuffer = _response->toString();
         _responseOffset = 0;
+        _sharedOffset = 0;
         _isSending = true;
     }
 }
@@ -43,6 +69,16 @@ int ClientConnection::sendResponseChunk(int client_fd) {
     char buffer[BUFFER_SIZE];
 
     size_t remaining = _responseBuffer.size() - _responseOffset;
+    if (remaining == 0) {
+        if (_streaming) {
+            _relayBlocked = false;
+            return 1; // En attente de la suite du corps
+        }
+        if (_sharedOffset < _sharedBody.size())
+            return sendSharedBody(client_fd);
+        _isSending = false;
+        return 0;
+    }
     size_t bytesToSend = std::min(remaining, BUFFER_SIZE);
 
     // Copier les données dans le buffer fixe
@@ -53,6 +89,14 @@ int ClientConnection::sendResponseChunk(int client_fd) {
     if (bytesSent > 0) {
         _responseOffset += bytesSent;
         if (_responseOffset >= _responseBuffer.size()) {
+            if (_streaming) {
+                _responseBuffer.clear();
+                _responseOffset = 0;
+                _relayBlocked = false;
+                return 1;
+            }
+            if (_sharedOffset < _sharedBody.size())
+                return 1; // Corps partagé au prochain POLLOUT
             _isSending = false;
             return 0; // Response fully sent
         }
@@ -63,7 +107,26 @@ int ClientConnection::sendResponseChunk(int client_fd) {
     return 1; // Response not fully sent
 }
 
+// Écrit directement depuis le bloc partagé, sans passer par un buffer local
+int ClientConnection::sendSharedBody(int client_fd) {
+    ssize_t bytesSent = write(client_fd, _sharedBody.data() + _sharedOffset, _sharedBody.size() - _sharedOffset);
+    if (bytesSent == -1) {
+        _isSending = false;
+        return -1;
+    }
+    _sharedOffset += bytesSent;
+    if (_sharedOffset < _sharedBody.size())
+        return 1;
+    _sharedBody = SharedBuffer();
+    _sharedOffset = 0;
+    _isSending = false;
+    return 0;
+}
+
 void ClientConnection::resetConnection() {
+    releaseCGIAdmission();
+    releaseUploadAdmission();
+    dropCacheCapture();
     if (_request) {
         delete _request;
         _request = NULL;
@@ -76,9 +139,18 @@ void ClientConnection::resetConnection() {
         delete _cgiHandler;
         _cgiHandler = NULL;
     }
+    setUpload(NULL);
+    _responseBuffer.clear();
     _responseOffset = 0;
+    _sharedBody = SharedBuffer();
+    _sharedOffset = 0;
     _isSending = false;
     _exchangeOver = false;
+    _headRequest = false;
+    _streaming = false;
+    _chunked = false;
+    _chunkRemaining = 0;
+    _relayBlocked = false;
     _used = true;
 }
 
@@ -87,3 +159,296 @@ bool ClientConnection::isResponseComplete() const {
     return !_isSending;
 }
 
+
+
+bool ClientConnection::isStreaming() const {
+    return _streaming;
+}
+
+size_t ClientConnection::getPendingOutputSize() const {
+    if (!_isSending)
+        return 0;
+    return _responseBuffer.size() - _responseOffset + _sharedBody.size() - _sharedOffset;
+}
+
+void ClientConnection::beginStreaming(HTTPResponse* response) {
+    if (_response && _response != response)
+        delete _response;
+    _response = response;
+    if (_headRequest)
+        _response->setHeadOnly(true);
+    if (_cacheCapture) {
+        _cacheCapture->captureHeaders(*_response);
+        _response->setHeader("X-Cache-Status", "MISS");
+    }
+
+    // Sans Content-Length fourni par le script, la fin du corps est signalée
+    // par le dernier chunk
+    _chunked = false;
+    _chunkRemaining = 0;
+    if (!_response->isBodyless() && _response->getStrHeader("Content-Length").empty()) {
+        _response->setHeader("Transfer-Encoding", "chunked");
+        _chunked = true;
+    }
+    _response->setHeader("Connection", "keep-alive");
+
+    _responseBuffer = _response->toStringHeaders() + "\r\n";
+    _responseOffset = 0;
+    _isSending = true;
+    _streaming = true;
+}
+
+void ClientConnection::appendBody(const char* data, size_t size) {
+    if (!_streaming || size == 0 || _response->isBodyless())
+        return;
+    if (_cacheCapture)
+        _cacheCapture->captureBody(data, size);
+
+    if (_chunked) {
+        std::ostringstream chunkHeader;
+        chunkHeader << std::hex << size << "\r\n";
+        _responseBuffer += chunkHeader.str();
+        _responseBuffer.append(data, size);
+        _responseBuffer += "\r\n";
+    } else {
+        _responseBuffer.append(data, size);
+    }
+}
+
+void ClientConnection::endStreaming() {
+    if (!_streaming)
+        return;
+    if (_chunked && !_response->isBodyless())
+        _responseBuffer += "0\r\n\r\n";
+    _streaming = false;
+}
+
+// Transmet ce que le CGI a produit depuis le dernier appel : dès que le bloc
+// d'en-têtes est complet, la réponse part et le corps suit au fil de l'eau.
+void ClientConnection::relayCGIOutput() {
+    if (!_cgiHandler)
+        return;
+    std::string& output = _cgiHandler->getCGIOutputBuffer();
+
+    if (!_streaming) {
+        size_t headerEnd = output.find("\r\n\r\n");
+        size_t separatorLength = 4;
+        size_t lfHeaderEnd = output.find("\n\n");
+        if (lfHeaderEnd != std::string::npos && (headerEnd == std::string::npos || lfHeaderEnd < headerEnd)) {
+            headerEnd = lfHeaderEnd;
+            separatorLength = 2;
+        }
+
+        if (headerEnd != std::string::npos) {
+            HTTPResponse* response = new HTTPResponse();
+            response->parseHeaders(output.substr(0, headerEnd));
+            output.erase(0, headerEnd + separatorLength);
+            beginStreaming(response);
+        } else if (output.size() > MAX_CGI_HEADER_SIZE) {
+            // Pas d'en-têtes exploitables : tout le flux devient le corps
+            beginStreaming(new HTTPResponse());
+        } else {
+            return;
+        }
+    }
+
+    if (!output.empty()) {
+        appendBody(output.data(), output.size());
+        output.clear();
+    }
+}
+
+// Appelé une fois la sortie du CGI fermée et le process récupéré
+void ClientConnection::finishCGIOutput() {
+    if (_streaming) {
+        relayCGIOutput();
+        endStreaming();
+        return;
+    }
+
+    // Aucun bloc d'en-têtes complet : toute la sortie sert de corps
+    HTTPResponse* cgiResponse = new HTTPResponse();
+    if (_cgiHandler)
+        cgiResponse->parseCGIOutput(_cgiHandler->getCGIOutputBuffer());
+    if (_cacheCapture) {
+        _cacheCapture->captureHeaders(*cgiResponse);
+        _cacheCapture->captureBody(cgiResponse->getBody().data(), cgiResponse->getBody().size());
+        cgiResponse->setHeader("X-Cache-Status", "MISS");
+    }
+    cgiResponse->setHeader("Connection", "keep-alive");
+    if (_response)
+        delete _response;
+    _response = cgiResponse;
+    prepareResponse();
+}
+
+void ClientConnection::setCacheCapture(ResponseCache::Capture* capture) {
+    delete _cacheCapture;
+    _cacheCapture = capture;
+}
+
+// Script terminé avec succès : sa réponse rejoint le cache si elle le permet,
+// et les requêtes identiques qui l'attendaient sont réveillées
+void ClientConnection::commitCacheCapture() {
+    if (_cacheCapture)
+        ResponseCache::instance().store(*_cacheCapture, curr_time_ms());
+    dropCacheCapture();
+}
+
+void ClientConnection::dropCacheCapture() {
+    delete _cacheCapture;
+    _cacheCapture = NULL;
+    _awaitingFlight = false;
+    ResponseCache::instance().releaseFlight(this);
+}
+
+void ClientConnection::setSharedBody(const SharedBuffer& body) {
+    _sharedBody = body;
+    _sharedOffset = 0;
+}
+
+void ClientConnection::setAwaitingFlight(bool value) {
+    _awaitingFlight = value;
+}
+
+bool ClientConnection::isAwaitingFlight() const {
+    return _awaitingFlight;
+}
+
+// Après handleHttpRequest : un vol mené sans CGI lancé (erreur, réponse
+// servie autrement) est terminé tout de suite
+void ClientConnection::settleCacheFlight() {
+    if (!_cacheCapture && !_awaitingFlight && !_queuedFor)
+        ResponseCache::instance().releaseFlight(this);
+}
+
+// En-têtes partis et rien de la sortie du script en attente côté serveur :
+// le corps peut aller directement du pipe au socket
+bool ClientConnection::canSpliceCGIOutput() const {
+    return _streaming && _cgiHandler && _cgiHandler->canSplice() && !_cacheCapture
+        && !_response->isBodyless() && _cgiHandler->getCGIOutputBuffer().empty();
+}
+
+bool ClientConnection::isRelayBlocked() const {
+    return _relayBlocked;
+}
+
+// Relaie le corps du CGI par splice(). Le cadrage (reste des en-têtes, tailles
+// de chunk) passe toujours par _responseBuffer, écrit avant chaque bloc.
+// Retourne false quand le pipe est vide : l'appelant fait alors un read()
+// classique, qui détecte la fin de sortie.
+bool ClientConnection::spliceCGIOutput(int client_fd) {
+    int pipeFd = _cgiHandler->getOutputPipeFd();
+    size_t budget = SPLICE_BUDGET;
+
+    while (budget) {
+        size_t pending = getPendingOutputSize();
+        if (pending) {
+            ssize_t sent = write(client_fd, _responseBuffer.data() + _responseOffset, pending);
+            if (sent > 0)
+                _responseOffset += sent;
+            if (sent != static_cast<ssize_t>(pending)) {
+                _relayBlocked = true;
+                return true;
+            }
+            _responseBuffer.clear();
+            _responseOffset = 0;
+        }
+
+        // Octets présents dans le pipe : un EAGAIN de splice() viendra alors
+        // forcément du socket client
+        int available = 0;
+        if (ioctl(pipeFd, FIONREAD, &available) == -1 || available <= 0)
+            return false;
+
+        size_t length = std::min(static_cast<size_t>(available), budget);
+        if (_chunked) {
+            if (_chunkRemaining == 0) {
+                std::ostringstream chunkHeader;
+                chunkHeader << std::hex << available << "\r\n";
+                _responseBuffer = chunkHeader.str();
+                _chunkRemaining = available;
+                continue;
+            }
+            length = std::min(length, _chunkRemaining);
+        }
+
+        ssize_t moved = _cgiHandler->spliceOutput(client_fd, length);
+        if (moved <= 0) {
+            // Socket plein, ou client parti : POLLOUT ou POLLERR trancheront
+            _relayBlocked = true;
+            return true;
+        }
+        budget -= std::min(budget, static_cast<size_t>(moved));
+        if (_chunked) {
+            _chunkRemaining -= moved;
+            if (_chunkRemaining == 0)
+                _responseBuffer = "\r\n";
+        }
+    }
+    return true;
+}
+
+void ClientConnection::setCGISlot(const Location* location) {
+    _cgiSlot = location;
+    _queuedFor = NULL;
+}
+
+void ClientConnection::setQueuedFor(const Location* location) {
+    _queuedFor = location;
+}
+
+bool ClientConnection::isQueued() const {
+    return _queuedFor != NULL || _uploadQueuedFor != NULL;
+}
+
+// Après handleHttpRequest : le slot suit le CGI lancé, sinon il est rendu
+void ClientConnection::settleCGISlot() {
+    if (!_cgiSlot)
+        return;
+    if (_cgiHandler)
+        _cgiHandler->setConcurrencySlot(_cgiSlot);
+    else
+        CGILimiter::instance().release(_cgiSlot);
+    _cgiSlot = NULL;
+}
+
+void ClientConnection::releaseCGIAdmission() {
+    if (_cgiSlot)
+        CGILimiter::instance().release(_cgiSlot);
+    if (_queuedFor)
+        CGILimiter::instance().cancel(_queuedFor, this);
+    _cgiSlot = NULL;
+    _queuedFor = NULL;
+}
+
+void ClientConnection::setUploadSlot(const Location* location, size_t bytes) {
+    _uploadSlot = location;
+    _uploadSlotBytes = bytes;
+    _uploadQueuedFor = NULL;
+}
+
+void ClientConnection::setUploadQueuedFor(const Location* location) {
+    _uploadQueuedFor = location;
+}
+
+bool ClientConnection::hasUploadSlot() const {
+    return _uploadSlot != NULL;
+}
+
+// Après handleHttpRequest : le slot reste tant que le corps de l'upload
+// arrive, sinon il est rendu
+void ClientConnection::settleUploadSlot() {
+    if (_uploadSlot && !_upload)
+        releaseUploadAdmission();
+}
+
+void ClientConnection::releaseUploadAdmission() {
+    if (_uploadSlot)
+        UploadLimiter::instance().release(_uploadSlot, _uploadSlotBytes);
+    if (_uploadQueuedFor)
+        UploadLimiter::instance().cancel(_uploadQueuedFor, this);
+    _uploadSlot = NULL;
+    _uploadSlotBytes = 0;
+    _uploadQueuedFor = NULL;
+}
@@ -3,12 +3,15 @@
 #define CLIENTCONNECTION_HPP
 
 #include <string>
+#include "ResponseCache.hpp"
 
 // Forward declarations
 class Server;
 class HTTPRequest;
 class HTTPResponse;
 class CGIHandler;
+class UploadStream;
+struct Location;
 
 class ClientConnection {
 private:
@@ -16,16 +19,68 @@ private:
     HTTPRequest* _request;
     HTTPResponse* _response;
     CGIHandler* _cgiHandler;
+    // Upload (multipart, reprenable) dont le corps est encore en cours de réception
+    UploadStream* _upload;
 
     // Attributes for managing response sending
     std::string _responseBuffer;
     size_t _responseOffset;
+    // Corps servi depuis le cache, partagé avec l'entrée et les autres
+    // clients : envoyé après _responseBuffer, sans copie
+    SharedBuffer _sharedBody;
+    size_t _sharedOffset;
     bool _isSending;
     bool _exchangeOver;
     bool _used;
+    bool _headRequest;
+
+    // Réponse CGI transmise au fil de l'eau : les en-têtes sont partis,
+    // le corps est ajouté à _responseBuffer à mesure qu'il arrive
+    bool _streaming;
+    bool _chunked;
+
+    // Relais splice() : octets du chunk en cours restant à déplacer, et
+    // socket client plein (on attend POLLOUT plutôt que la sortie du CGI)
+    size_t _chunkRemaining;
+    bool _relayBlocked;
+
+    // cgi_max_concurrent : slot obtenu pour la requête en cours, pas encore
+    // confié au CGIHandler, ou location dont on attend un slot
+    const Location* _cgiSlot;
+    const Location* _queuedFor;
+    // upload_max_concurrent / upload_max_inflight : slot (et octets réservés)
+    // tenu jusqu'à la fin de l'upload, ou location dont on attend un slot
+    const Location* _uploadSlot;
+    size_t _uploadSlotBytes;
+    const Location* _uploadQueuedFor;
+
+    // cgi_cache : copie de la réponse du CGI, rangée une fois le script
+    // terminé avec succès
+    ResponseCache::Capture* _cacheCapture;
+    // En attente de la réponse d'un CGI identique déjà en vol
+    bool _awaitingFlight;
+
+    void releaseCGIAdmission();
+    void releaseUploadAdmission();
+    void dropCacheCapture();
+    int sendSharedBody(int client_fd);
+
+    void beginStreaming(HTTPResponse* response);
+    void appendBody(const char* data, size_t size);
+    void endStreaming();
 
 
 public:
+    // Au-delà, on arrête de lire le CGI tant que le client n'a pas consommé
+    static const size_t OUTPUT_HIGH_WATERMARK = 65536;
+    // Corps de requête en attente d'écriture vers le CGI au-delà duquel on
+    // arrête de lire le client
+    static const size_t INPUT_HIGH_WATERMARK = 65536;
+    // Taille max d'un bloc d'en-têtes CGI avant de tout traiter comme du corps
+    static const size_t MAX_CGI_HEADER_SIZE = 16384;
+    // Octets déplacés par splice() avant de rendre la main à la boucle
+    static const size_t SPLICE_BUDGET = 1048576;
+
     ClientConnection(Server* server);
     ~ClientConnection();
 
@@ -33,14 +88,18 @@ public:
     HTTPRequest* getRequest() const;
     HTTPResponse* getResponse() const;
     CGIHandler* getCgiHandler() const;
+    UploadStream* getUpload() const;
     bool getExchangeOver() const;   
     bool getUsed() const;
 
     void setExchangeOver(bool value);
     void setCgiHandler(CGIHandler* cgiHandler);
+    // Remplace (et détruit) l'upload en cours
+    void setUpload(UploadStream* upload);
     void setRequest(HTTPRequest* request);
     void setResponse(HTTPResponse* response);
     void setRequestActivity(unsigned long time);
+    void setHeadRequest(bool value);
 
     // Methods to manage sending the response
     void prepareResponse();
@@ -48,6 +107,36 @@ public:
     bool isResponseComplete() const;
     void resetConnection();
 
+    // Streaming de la sortie CGI
+    bool isStreaming() const;
+    size_t getPendingOutputSize() const;
+    void relayCGIOutput();
+    void finishCGIOutput();
+    bool canSpliceCGIOutput() const;
+    bool spliceCGIOutput(int client_fd);
+    bool isRelayBlocked() const;
+    void setCacheCapture(ResponseCache::Capture* capture);
+    void commitCacheCapture();
+    void setSharedBody(const SharedBuffer& body);
+
+    // Coalescence des requêtes identiques (ResponseCache)
+    void setAwaitingFlight(bool value);
+    bool isAwaitingFlight() const;
+    void settleCacheFlight();
+
+    // File d'attente CGI (CGILimiter)
+    void setCGISlot(const Location* location);
+    void setQueuedFor(const Location* location);
+    // En file, pour un slot CGI ou d'upload
+    bool isQueued() const;
+    void settleCGISlot();
+
+    // File d'attente des uploads (UploadLimiter)
+    void setUploadSlot(const Location* location, size_t bytes);
+    void setUploadQueuedFor(const Location* location);
+    bool hasUploadSlot() const;
+    void settleUploadSlot();
+
 };
 
 #endif // CLIENTCONNECTION_HPP
@@ -3,10 +3,13 @@
 #include <sstream>
 #include <iostream>
 #include <cctype>
+#include <cstdlib>
 #include <algorithm>
 #include "ConfigParser.hpp"
+#include "Digest.hpp"
 #include "ServerConfig.hpp"
 #include "Logger.hpp"
+#include "UpstreamPool.hpp"
 
 ConfigParser::ConfigParser() {}
 
@@ -41,6 +44,7 @@ void ConfigParser::parseConfigFile(const std::string &filename) {
                     if (serverConfig.ports.empty()) {
 						throw ConfigParserException("Missing required directive 'listen' in server block.");
 					}
+                    serverConfig.buildCGIEnvironment();
                     break;
                 }
 
@@ -97,8 +101,8 @@ void ConfigParser::validateDirectiveValue(const std::string &directive, const st
             throw ConfigParserException("Invalid server name: " + value);
         }
     } else if (directive == "method") {
-        std::string validMethodsArray[] = {"GET", "POST", "DELETE"};
-        std::vector<std::string> validMethods(validMethodsArray, validMethodsArray + 3);
+        std::string validMethodsArray[] = {"GET", "HEAD", "POST", "PUT", "DELETE", "PATCH", "OPTIONS"};
+        std::vector<std::string> validMethods(validMethodsArray, validMethodsArray + 7);
 
         if (std::find(validMethods.begin(), validMethods.end(), value) == validMethods.end()) {
             throw ConfigParserException("Invalid HTTP method: " + value);
@@ -116,9 +120,18 @@ void ConfigParser::validateDirectiveValue(const std::string &directive, const st
     	if (maxSize < 0) {
         	throw ConfigParserException("Invalid value for 'client_max_body_size': " + value);
     	}
-	} else if (directive == "upload_on") {
+	} else if (directive == "upload_on" || directive == "upload_resumable" || directive == "upload_dedup" || directive == "cgi_spawner" || directive == "cgi_request_buffering" || directive == "cgi_splice" || directive == "cgi_cache" || directive == "metrics") {
         if (value != "on" && value != "off") {
-            throw ConfigParserException("Invalid value for 'upload_on': " + value);
+            throw ConfigParserException("Invalid value for '" + directive + "': " + value);
+        }
+    } else if (directive == "upload_fsync") {
+        if (value != "off" && value != "file" && value != "full") {
+            throw ConfigParserException("Invalid value for 'upload_fsync' (off, file or full): " + value);
+        }
+    } else if (directive == "upload_digest") {
+        unsigned int algorithms;
+        if (value != "off" && (!ContentDigest::parseAlgorithms(value, algorithms) || !algorithms)) {
+            throw ConfigParserException("Invalid value for 'upload_digest' (off, or sha-256, crc32c, md5): " + value);
         }
     } else if (directive == "autoindex") {
     if (value != "on" && value != "off") {
@@ -128,6 +141,72 @@ void ConfigParser::validateDirectiveValue(const std::string &directive, const st
         if (value.empty()) {
             throw ConfigParserException("Invalid CGI interpreter path: " + value);
         }
+    } else if (directive == "cgi_pipe_size") {
+        if (std::atoi(value.c_str()) <= 0) {
+            throw ConfigParserException("Invalid value for 'cgi_pipe_size': " + value);
+        }
+    } else if (directive == "cgi_max_concurrent" || directive == "cgi_queue_size" || directive == "upload_max_concurrent" || directive == "upload_queue_size") {
+        if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos) {
+            throw ConfigParserException("Invalid value for '" + directive + "': " + value);
+        }
+    } else if (directive == "session_history_size" || directive == "session_max_entries") {
+        if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos || std::atoi(value.c_str()) <= 0) {
+            throw ConfigParserException("Invalid value for '" + directive + "' (at least 1): " + value);
+        }
+    } else if (directive == "cgi_queue_timeout" || directive == "upload_queue_timeout") {
+        if (parseDuration(value) < 0) {
+            throw ConfigParserException("Invalid value for '" + directive + "': " + value);
+        }
+    } else if (directive == "cgi_read_timeout" || directive == "cgi_send_timeout") {
+        if (parseDuration(value) <= 0) {
+            throw ConfigParserException("Invalid value for '" + directive + "': " + value);
+        }
+    } else if (directive == "cgi_rlimit_cpu") {
+        if (parseDuration(value) < 1000) {
+            throw ConfigParserException("Invalid value for 'cgi_rlimit_cpu' (at least 1s): " + value);
+        }
+    } else if (directive == "cgi_rlimit_as") {
+        if (parseSize(value) <= 0) {
+            throw ConfigParserException("Invalid value for 'cgi_rlimit_as': " + value);
+        }
+    } else if (directive == "cgi_rlimit_nofile") {
+        if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos || std::atoi(value.c_str()) <= 0) {
+            throw ConfigParserException("Invalid value for 'cgi_rlimit_nofile': " + value);
+        }
+    } else if (directive == "cgi_nice") {
+        char* end;
+        long nice = std::strtol(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || nice < -20 || nice > 19) {
+            throw ConfigParserException("Invalid value for 'cgi_nice' (-20 to 19): " + value);
+        }
+    } else if (directive == "cgi_max_output" || directive == "upload_resumable_max_size" || directive == "upload_max_inflight") {
+        if (parseSize(value) < 0) {
+            throw ConfigParserException("Invalid value for '" + directive + "': " + value);
+        }
+    } else if (directive == "cgi_cache_valid" || directive == "cgi_cache_stale" || directive == "cgi_cache_lock_timeout" || directive == "session_flush_interval"
+               || directive == "upload_resumable_expire") {
+        if (parseDuration(value) < 0) {
+            throw ConfigParserException("Invalid value for '" + directive + "': " + value);
+        }
+    } else if (directive == "cgi_cache_max_size") {
+        if (parseSize(value) <= 0) {
+            throw ConfigParserException("Invalid value for 'cgi_cache_max_size': " + value);
+        }
+    } else if (directive == "fastcgi_pass" || directive == "scgi_pass" || directive == "uwsgi_pass") {
+        if (!UpstreamPool::isValidAddress(value)) {
+            throw ConfigParserException("Invalid " + directive + " address: " + value);
+        }
+    } else if (directive == "cgi_param") {
+        std::istringstream valueStream(value);
+        std::string name;
+        valueStream >> name;
+        if (name.empty() || name.find('=') != std::string::npos) {
+            throw ConfigParserException("Invalid cgi_param: " + value);
+        }
+    } else if (directive == "default_type" || directive == "types") {
+        if (value.empty() || value.find('/') == std::string::npos) {
+            throw ConfigParserException("Invalid MIME type: " + value);
+        }
     }
 
 }
@@ -163,6 +242,8 @@ void ConfigParser::processServerDirective(std::ifstream &file, const std::string
         if (directive == "location") {
             trim(value);
             processLocationBlock(file, value, serverConfig);
+        } else if (directive == "types" && value.empty()) {
+            processTypesBlock(file, serverConfig);
         } else {
             throw ConfigParserException("Unexpected '{' after directive '" + directive + "'");
         }
@@ -247,6 +328,37 @@ void ConfigParser::processServerDirective(std::ifstream &file, const std::string
 
         serverConfig.cgiInterpreters[extension] = interpreterPath;
         Logger::instance().log(DEBUG, "Set cgi_interpreter for " + extension + " to " + interpreterPath);
+    } else if (directive == "cgi_param") {
+        validateDirectiveValue(directive, value);
+        std::string name;
+        std::string paramValue;
+        splitCGIParam(value, name, paramValue);
+        serverConfig.cgiParams[name] = paramValue;
+        Logger::instance().log(DEBUG, "Set cgi_param " + name + " in server config");
+    } else if (directive == "cgi_spawner") {
+        validateDirectiveValue(directive, value);
+        serverConfig.cgiSpawner = (value == "on");
+        Logger::instance().log(DEBUG, "Set cgi_spawner to " + value + " in server config");
+    } else if (directive == "cgi_cache_max_size") {
+        validateDirectiveValue(directive, value);
+        serverConfig.cgiCacheMaxSize = parseSize(value);
+        Logger::instance().log(DEBUG, "Set cgi_cache_max_size to " + value + " in server config");
+    } else if (directive == "session_flush_interval") {
+        validateDirectiveValue(directive, value);
+        serverConfig.sessionFlushInterval = parseDuration(value);
+        Logger::instance().log(DEBUG, "Set session_flush_interval to " + value + " in server config");
+    } else if (directive == "session_history_size") {
+        validateDirectiveValue(directive, value);
+        serverConfig.sessionHistorySize = std::atoi(value.c_str());
+        Logger::instance().log(DEBUG, "Set session_history_size to " + value + " in server config");
+    } else if (directive == "session_max_entries") {
+        validateDirectiveValue(directive, value);
+        serverConfig.sessionMaxEntries = std::atoi(value.c_str());
+        Logger::instance().log(DEBUG, "Set session_max_entries to " + value + " in server config");
+    } else if (directive == "default_type") {
+        validateDirectiveValue(directive, value);
+        serverConfig.mimeTypes.setDefaultType(value);
+        Logger::instance().log(DEBUG, "Set default_type to " + value + " in server config");
     } else {
             throw ConfigParserException("Unknown directive: \"" + directive + "\"");
         }
@@ -323,10 +435,122 @@ void ConfigParser::processLocationBlock(std::ifstream &file, const std::string&
             } else if (directive == "upload_path") {
                 validateDirectiveValue(directive, value);
                 location.uploadPath = value;
+            } else if (directive == "upload_resumable") {
+                validateDirectiveValue(directive, value);
+                location.uploadResumable = (value == "on");
+                Logger::instance().log(DEBUG, "Set upload_resumable to " + value + " in location " + location.path);
+            } else if (directive == "upload_resumable_max_size") {
+                validateDirectiveValue(directive, value);
+                location.uploadResumableMaxSize = parseSize(value);
+                Logger::instance().log(DEBUG, "Set upload_resumable_max_size to " + value + " in location " + location.path);
+            } else if (directive == "upload_resumable_expire") {
+                validateDirectiveValue(directive, value);
+                location.uploadResumableExpire = parseDuration(value);
+                Logger::instance().log(DEBUG, "Set upload_resumable_expire to " + value + " in location " + location.path);
+            } else if (directive == "upload_fsync") {
+                validateDirectiveValue(directive, value);
+                location.uploadFsync = value == "full" ? UPLOAD_FSYNC_FULL : value == "file" ? UPLOAD_FSYNC_FILE : UPLOAD_FSYNC_OFF;
+                Logger::instance().log(DEBUG, "Set upload_fsync to " + value + " in location " + location.path);
+            } else if (directive == "upload_dedup") {
+                validateDirectiveValue(directive, value);
+                location.uploadDedup = (value == "on");
+                Logger::instance().log(DEBUG, "Set upload_dedup to " + value + " in location " + location.path);
+            } else if (directive == "upload_max_concurrent") {
+                validateDirectiveValue(directive, value);
+                location.uploadMaxConcurrent = std::atoi(value.c_str());
+                Logger::instance().log(DEBUG, "Set upload_max_concurrent to " + value + " in location " + location.path);
+            } else if (directive == "upload_max_inflight") {
+                validateDirectiveValue(directive, value);
+                location.uploadMaxInflight = parseSize(value);
+                Logger::instance().log(DEBUG, "Set upload_max_inflight to " + value + " in location " + location.path);
+            } else if (directive == "upload_queue_size") {
+                validateDirectiveValue(directive, value);
+                location.uploadQueueSize = std::atoi(value.c_str());
+                Logger::instance().log(DEBUG, "Set upload_queue_size to " + value + " in location " + location.path);
+            } else if (directive == "upload_queue_timeout") {
+                validateDirectiveValue(directive, value);
+                location.uploadQueueTimeout = parseDuration(value);
+                Logger::instance().log(DEBUG, "Set upload_queue_timeout to " + value + " in location " + location.path);
+            } else if (directive == "upload_digest") {
+                validateDirectiveValue(directive, value);
+                location.uploadDigest = 0;
+                if (value != "off")
+                    ContentDigest::parseAlgorithms(value, location.uploadDigest);
+                Logger::instance().log(DEBUG, "Set upload_digest to " + value + " in location " + location.path);
             } else if (directive == "autoindex") {
                 validateDirectiveValue(directive, value);
                 location.autoindex = (value == "on");
                 Logger::instance().log(DEBUG, "Set autoindex to " + value + " in location " + location.path);
+            } else if (directive == "cgi_param") {
+                std::string name;
+                std::string paramValue;
+                splitCGIParam(value, name, paramValue);
+                location.cgiParams[name] = paramValue;
+                Logger::instance().log(DEBUG, "Set cgi_param " + name + " in location " + location.path);
+            } else if (directive == "cgi_request_buffering") {
+                location.cgiRequestBuffering = (value == "on");
+                Logger::instance().log(DEBUG, "Set cgi_request_buffering to " + value + " in location " + location.path);
+            } else if (directive == "cgi_splice") {
+                location.cgiSplice = (value == "on");
+                Logger::instance().log(DEBUG, "Set cgi_splice to " + value + " in location " + location.path);
+            } else if (directive == "cgi_pipe_size") {
+                location.cgiPipeSize = std::atoi(value.c_str());
+                Logger::instance().log(DEBUG, "Set cgi_pipe_size to " + value + " in location " + location.path);
+            } else if (directive == "cgi_max_concurrent") {
+                location.cgiMaxConcurrent = std::atoi(value.c_str());
+                Logger::instance().log(DEBUG, "Set cgi_max_concurrent to " + value + " in location " + location.path);
+            } else if (directive == "cgi_queue_size") {
+                location.cgiQueueSize = std::atoi(value.c_str());
+                Logger::instance().log(DEBUG, "Set cgi_queue_size to " + value + " in location " + location.path);
+            } else if (directive == "cgi_queue_timeout") {
+                location.cgiQueueTimeout = parseDuration(value);
+                Logger::instance().log(DEBUG, "Set cgi_queue_timeout to " + value + " in location " + location.path);
+            } else if (directive == "cgi_read_timeout") {
+                location.cgiReadTimeout = parseDuration(value);
+                Logger::instance().log(DEBUG, "Set cgi_read_timeout to " + value + " in location " + location.path);
+            } else if (directive == "cgi_send_timeout") {
+                location.cgiSendTimeout = parseDuration(value);
+                Logger::instance().log(DEBUG, "Set cgi_send_timeout to " + value + " in location " + location.path);
+            } else if (directive == "cgi_max_output") {
+                location.cgiMaxOutput = parseSize(value);
+                Logger::instance().log(DEBUG, "Set cgi_max_output to " + value + " in location " + location.path);
+            } else if (directive == "cgi_rlimit_cpu") {
+                // Arrondi à la seconde supérieure, la granularité de RLIMIT_CPU
+                location.cgiRlimitCpu = (parseDuration(value) + 999) / 1000;
+                Logger::instance().log(DEBUG, "Set cgi_rlimit_cpu to " + value + " in location " + location.path);
+            } else if (directive == "cgi_rlimit_as") {
+                location.cgiRlimitAs = parseSize(value);
+                Logger::instance().log(DEBUG, "Set cgi_rlimit_as to " + value + " in location " + location.path);
+            } else if (directive == "cgi_rlimit_nofile") {
+                location.cgiRlimitNofile = std::atoi(value.c_str());
+                Logger::instance().log(DEBUG, "Set cgi_rlimit_nofile to " + value + " in location " + location.path);
+            } else if (directive == "cgi_nice") {
+                location.cgiNice = std::atoi(value.c_str());
+                Logger::instance().log(DEBUG, "Set cgi_nice to " + value + " in location " + location.path);
+            } else if (directive == "cgi_cache") {
+                location.cgiCache = (value == "on");
+                Logger::instance().log(DEBUG, "Set cgi_cache to " + value + " in location " + location.path);
+            } else if (directive == "cgi_cache_valid") {
+                location.cgiCacheValid = parseDuration(value);
+                Logger::instance().log(DEBUG, "Set cgi_cache_valid to " + value + " in location " + location.path);
+            } else if (directive == "cgi_cache_stale") {
+                location.cgiCacheStale = parseDuration(value);
+                Logger::instance().log(DEBUG, "Set cgi_cache_stale to " + value + " in location " + location.path);
+            } else if (directive == "cgi_cache_lock_timeout") {
+                location.cgiCacheLockTimeout = parseDuration(value);
+                Logger::instance().log(DEBUG, "Set cgi_cache_lock_timeout to " + value + " in location " + location.path);
+            } else if (directive == "metrics") {
+                location.metrics = (value == "on");
+                Logger::instance().log(DEBUG, "Set metrics to " + value + " in location " + location.path);
+            } else if (directive == "fastcgi_pass") {
+                location.fastcgiPass = value;
+                Logger::instance().log(DEBUG, "Set fastcgi_pass to " + value + " in location " + location.path);
+            } else if (directive == "scgi_pass") {
+                location.scgiPass = value;
+                Logger::instance().log(DEBUG, "Set scgi_pass to " + value + " in location " + location.path);
+            } else if (directive == "uwsgi_pass") {
+                location.uwsgiPass = value;
+                Logger::instance().log(DEBUG, "Set uwsgi_pass to " + value + " in location " + location.path);
             } if (directive == "cgi_interpreter") {
 				std::istringstream valueStream(value);
         		std::string extension, interpreterPath;
@@ -353,7 +577,84 @@ void ConfigParser::processLocationBlock(std::ifstream &file, const std::string&
 }
 
 
+long ConfigParser::parseDuration(const std::string& value) {
+    size_t unitPos = value.find_first_not_of("0123456789");
+    if (unitPos == 0 || value.empty())
+        return -1;
+    long amount = std::atol(value.substr(0, unitPos).c_str());
+    std::string unit = unitPos == std::string::npos ? "s" : value.substr(unitPos);
+    if (unit == "ms")
+        return amount;
+    if (unit == "s")
+        return amount * 1000;
+    if (unit == "m")
+        return amount * 60000;
+    if (unit == "h")
+        return amount * 3600000;
+    return -1;
+}
+
+long ConfigParser::parseSize(const std::string& value) {
+    size_t unitPos = value.find_first_not_of("0123456789");
+    if (unitPos == 0 || value.empty())
+        return -1;
+    long amount = std::atol(value.substr(0, unitPos).c_str());
+    if (unitPos == std::string::npos)
+        return amount;
+    std::string unit = value.substr(unitPos);
+    if (unit == "k" || unit == "K")
+        return amount * 1024;
+    if (unit == "m" || unit == "M")
+        return amount * 1024 * 1024;
+    if (unit == "g" || unit == "G")
+        return amount * 1024 * 1024 * 1024;
+    return -1;
+}
+
+// `cgi_param NOM valeur éventuellement avec espaces;`
+void ConfigParser::splitCGIParam(const std::string& value, std::string& name, std::string& paramValue) {
+    size_t nameEnd = value.find_first_of(" \t");
+    name = value.substr(0, nameEnd);
+    paramValue = (nameEnd == std::string::npos) ? "" : value.substr(nameEnd + 1);
+    trim(paramValue);
+}
+
+
+// Bloc `types { text/css css; image/svg+xml svg svgz; }` : complète ou
+// remplace les types par défaut du serveur.
+void ConfigParser::processTypesBlock(std::ifstream &file, ServerConfig& serverConfig) {
+    std::string line;
+    while (std::getline(file, line)) {
+        trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        if (line == "}") {
+            Logger::instance().log(DEBUG, "Loaded " + to_string(serverConfig.mimeTypes.size()) + " MIME types in server config");
+            return;
+        }
+        if (line[line.size() - 1] != ';') {
+            throw ConfigParserException("Missing ';' at the end of line: '" + line + "'");
+        }
+
+        std::istringstream iss(line.substr(0, line.size() - 1));
+        std::string type;
+        std::string extension;
+        iss >> type;
+        validateDirectiveValue("types", type);
+
+        bool hasExtension = false;
+        while (iss >> extension) {
+            serverConfig.mimeTypes.add(extension, type);
+            hasExtension = true;
+        }
+        if (!hasExtension) {
+            throw ConfigParserException("Missing extension for MIME type: " + type);
+        }
+    }
 
+    throw ConfigParserException("Error: unexpected end of file in types block.");
+}
 
 void ConfigParser::trim(std::string &s) {
     size_t start = s.find_first_not_of(" \t\r\n");
@@ -37,6 +37,15 @@ private:
 
     void processLocationBlock(std::ifstream &file, const std::string& locationPath, ServerConfig& serverConfig);
 
+    void processTypesBlock(std::ifstream &file, ServerConfig& serverConfig);
+
+    void splitCGIParam(const std::string& value, std::string& name, std::string& paramValue);
+
+    // "500ms", "30s", "2m" ; sans unité : secondes. -1 si invalide
+    static long parseDuration(const std::string& value);
+    // "512k", "10m", "1g" ; sans unité : octets. -1 si invalide
+    static long parseSize(const std::string& value);
+
     void validateDirectiveValue(const std::string &directive, const std::string &value);
 
     void trim(std::string &s);
@@ -0,0 +1,166 @@
+// ContentStore.cpp
+#include "ContentStore.hpp"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "Logger.hpp"
+#include "Metrics.hpp"
+#include "SpoolFile.hpp"
+#include "Utils.hpp"
+#include <vector>
+
+std::multiset<std::string> ContentStore::_pinned;
+std::set<std::string> ContentStore::_reclaimable;
+
+std::string ContentStore::objectPath(const std::string& uploadDir, const std::string& digest) {
+    static const char hexDigits[] = "0123456789abcdef";
+    std::string hex;
+    for (size_t i = 0; i < digest.size(); ++i) {
+        hex += hexDigits[(static_cast<unsigned char>(digest[i]) >> 4) & 0xF];
+        hex += hexDigits[static_cast<unsigned char>(digest[i]) & 0xF];
+    }
+    return uploadDir + "/.objects/" + hex.substr(0, 2) + "/" + hex;
+}
+
+bool ContentStore::contains(const std::string& uploadDir, const std::string& digest) {
+    struct stat st;
+    return stat(objectPath(uploadDir, digest).c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+bool ContentStore::commit(SpoolFile& spool, const std::string& uploadDir, const std::string& digest,
+                          const std::string& destPath, UploadFsync fsyncPolicy) {
+    std::string object = objectPath(uploadDir, digest);
+    struct stat st;
+    // Même taille exigée : un objet modifié sur place par un tiers est remplacé
+    if (stat(object.c_str(), &st) == 0 && S_ISREG(st.st_mode) && static_cast<size_t>(st.st_size) == spool.size()) {
+        spool.discard();
+        Metrics::instance().increment(Metrics::labeled("upload_dedup_total", "result", "hit"));
+        Logger::instance().log(INFO, "Upload already stored, linking " + destPath + " to " + object);
+    } else {
+        std::string directory = object.substr(0, object.find_last_of('/'));
+        if (!makeDirectory(uploadDir + "/.objects") || !makeDirectory(directory))
+            return false;
+        if (!spool.commit(object, fsyncPolicy)) {
+            errno = spool.getError();
+            return false;
+        }
+        if (fsyncPolicy == UPLOAD_FSYNC_FULL)
+            syncDirectory(directory);
+        Metrics::instance().increment(Metrics::labeled("upload_dedup_total", "result", "miss"));
+    }
+    return link(uploadDir, digest, destPath, fsyncPolicy);
+}
+
+bool ContentStore::link(const std::string& uploadDir, const std::string& digest, const std::string& destPath,
+                        UploadFsync fsyncPolicy) {
+    static unsigned long counter = 0;
+    std::string object = objectPath(uploadDir, digest);
+    std::string directory = destPath.substr(0, destPath.find_last_of('/'));
+
+    // Lien sous un nom temporaire puis renommage : destPath n'est jamais absent
+    std::string temp;
+    for (int attempt = 0; ; ++attempt) {
+        temp = directory + "/.link." + to_string(getpid()) + "." + to_string(counter++);
+        if (::link(object.c_str(), temp.c_str()) == 0)
+            break;
+        if (errno != EEXIST || attempt >= 100) {
+            Logger::instance().log(ERROR, "Failed to link " + destPath + " to " + object);
+            return false;
+        }
+    }
+    if (rename(temp.c_str(), destPath.c_str()) == -1) {
+        int error = errno;
+        unlink(temp.c_str());
+        errno = error;
+        Logger::instance().log(ERROR, "Failed to move link to " + destPath);
+        return false;
+    }
+    // rename() entre deux liens du même objet ne fait rien : le temporaire resterait
+    unlink(temp.c_str());
+    // destPath pointait peut-être vers un autre objet
+    markReclaimable(uploadDir);
+    if (fsyncPolicy == UPLOAD_FSYNC_FULL)
+        syncDirectory(directory);
+    return true;
+}
+
+void ContentStore::pin(const std::string& uploadDir, const std::string& digest) {
+    _pinned.insert(objectPath(uploadDir, digest));
+}
+
+void ContentStore::unpin(const std::string& uploadDir, const std::string& digest) {
+    std::multiset<std::string>::iterator it = _pinned.find(objectPath(uploadDir, digest));
+    if (it != _pinned.end())
+        _pinned.erase(it);
+}
+
+void ContentStore::markReclaimable(const std::string& uploadDir) {
+    _reclaimable.insert(uploadDir);
+}
+
+bool ContentStore::needsReclaim(const std::string& uploadDir) {
+    return _reclaimable.count(uploadDir) != 0;
+}
+
+void ContentStore::reclaim(const std::string& uploadDir) {
+    _reclaimable.erase(uploadDir);
+    std::string root = uploadDir + "/.objects";
+    DIR* dir = opendir(root.c_str());
+    if (!dir)
+        return;
+    std::vector<std::string> prefixes;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.')
+            prefixes.push_back(root + "/" + entry->d_name);
+    }
+    closedir(dir);
+
+    size_t count = 0;
+    size_t bytes = 0;
+    for (size_t i = 0; i < prefixes.size(); ++i) {
+        DIR* sub = opendir(prefixes[i].c_str());
+        if (!sub)
+            continue;
+        std::vector<std::string> orphans;
+        while ((entry = readdir(sub)) != NULL) {
+            std::string object = prefixes[i] + "/" + entry->d_name;
+            struct stat st;
+            if (entry->d_name[0] != '.' && lstat(object.c_str(), &st) == 0 && S_ISREG(st.st_mode)
+                && st.st_nlink == 1 && !_pinned.count(object)) {
+                orphans.push_back(object);
+                bytes += st.st_size;
+            }
+        }
+        closedir(sub);
+        for (size_t j = 0; j < orphans.size(); ++j) {
+            if (unlink(orphans[j].c_str()) == 0)
+                ++count;
+        }
+        // Échoue tant que le préfixe contient un objet
+        rmdir(prefixes[i].c_str());
+    }
+    if (count) {
+        Metrics::instance().increment("upload_dedup_reclaimed_total", count);
+        Metrics::instance().increment("upload_dedup_reclaimed_bytes_total", bytes);
+        Logger::instance().log(INFO, "Reclaimed " + to_string(count) + " unreferenced objects in " + root);
+    }
+}
+
+bool ContentStore::makeDirectory(const std::string& path) {
+    if (mkdir(path.c_str(), 0755) == 0 || errno == EEXIST)
+        return true;
+    Logger::instance().log(ERROR, "Failed to create content store directory: " + path);
+    return false;
+}
+
+void ContentStore::syncDirectory(const std::string& path) {
+    int dirFd = open(path.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dirFd != -1) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+}
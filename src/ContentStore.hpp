@@ -0,0 +1,52 @@
+// ContentStore.hpp
+#ifndef CONTENTSTORE_HPP
+#define CONTENTSTORE_HPP
+
+#include <set>
+#include <string>
+#include "Location.hpp"
+
+class SpoolFile;
+
+/*
+ * Stockage des uploads par contenu (upload_dedup on) : chaque fichier vit une
+ * seule fois sous <upload_path>/.objects/<2 hex>/<sha-256 hex>, et le nom vu
+ * par l'utilisateur en est un lien physique. Un fichier déjà présent n'est
+ * donc pas réécrit : le temporaire est jeté et seul un lien est ajouté.
+ * Supprimer ou remplacer un nom ne touche que ce lien ; un objet dont plus
+ * aucun nom ne dépend (un seul lien) est supprimé par reclaim(), que la
+ * boucle principale lance après une suppression ou un remplacement.
+ */
+class ContentStore {
+public:
+    // `digest` : SHA-256 binaire du contenu
+    static std::string objectPath(const std::string& uploadDir, const std::string& digest);
+    static bool contains(const std::string& uploadDir, const std::string& digest);
+    // Fichier complet : rangé dans le store s'il n'y est pas encore, sinon
+    // jeté ; destPath devient un lien vers l'objet. errno renseigné en cas
+    // d'échec
+    static bool commit(SpoolFile& spool, const std::string& uploadDir, const std::string& digest,
+                       const std::string& destPath, UploadFsync fsyncPolicy);
+    // destPath devient (ou est remplacé atomiquement par) un lien vers l'objet
+    static bool link(const std::string& uploadDir, const std::string& digest, const std::string& destPath,
+                     UploadFsync fsyncPolicy);
+
+    // Un objet annoncé par un PUT en cours ne doit pas disparaître avant
+    // que son lien soit posé
+    static void pin(const std::string& uploadDir, const std::string& digest);
+    static void unpin(const std::string& uploadDir, const std::string& digest);
+    // Un nom a pu perdre son lien vers un objet de ce store
+    static void markReclaimable(const std::string& uploadDir);
+    static bool needsReclaim(const std::string& uploadDir);
+    // Supprime les objets sans autre lien que le leur
+    static void reclaim(const std::string& uploadDir);
+
+private:
+    static std::multiset<std::string> _pinned;
+    static std::set<std::string> _reclaimable;
+
+    static bool makeDirectory(const std::string& path);
+    static void syncDirectory(const std::string& path);
+};
+
+#endif
@@ -0,0 +1,422 @@
+// Digest.cpp
+#include "Digest.hpp"
+#include <algorithm>
+#include <string.h>
+#include "HTTPRequest.hpp"
+#include "Utils.hpp"
+
+namespace {
+    inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+    inline uint32_t rotl(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+    const uint32_t SHA256_K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+
+    const uint32_t MD5_K[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+    };
+
+    const int MD5_SHIFT[64] = {
+        7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+        5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+        4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+        6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+    };
+
+    // Tables « slice-by-8 » du CRC32C (polynôme réfléchi 0x82F63B78)
+    uint32_t crcTable[8][256];
+    bool crcTableReady = false;
+
+    void buildCrcTable() {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t crc = n;
+            for (int k = 0; k < 8; ++k)
+                crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+            crcTable[0][n] = crc;
+        }
+        for (uint32_t n = 0; n < 256; ++n)
+            for (int t = 1; t < 8; ++t)
+                crcTable[t][n] = (crcTable[t - 1][n] >> 8) ^ crcTable[0][crcTable[t - 1][n] & 0xFF];
+        crcTableReady = true;
+    }
+
+    uint32_t crcSoftware(uint32_t crc, const unsigned char* data, size_t size) {
+        if (!crcTableReady)
+            buildCrcTable();
+        while (size >= 8) {
+            uint32_t low = crc ^ (data[0] | data[1] << 8 | data[2] << 16 | static_cast<uint32_t>(data[3]) << 24);
+            crc = crcTable[7][low & 0xFF] ^ crcTable[6][(low >> 8) & 0xFF]
+                ^ crcTable[5][(low >> 16) & 0xFF] ^ crcTable[4][low >> 24]
+                ^ crcTable[3][data[4]] ^ crcTable[2][data[5]]
+                ^ crcTable[1][data[6]] ^ crcTable[0][data[7]];
+            data += 8;
+            size -= 8;
+        }
+        while (size--)
+            crc = crcTable[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+        return crc;
+    }
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    __attribute__((target("sse4.2")))
+    uint32_t crcHardware(uint32_t crc, const unsigned char* data, size_t size) {
+        uint64_t crc64 = crc;
+        while (size >= 8) {
+            uint64_t word;
+            memcpy(&word, data, 8);
+            crc64 = __builtin_ia32_crc32di(crc64, word);
+            data += 8;
+            size -= 8;
+        }
+        crc = static_cast<uint32_t>(crc64);
+        while (size--)
+            crc = __builtin_ia32_crc32qi(crc, *data++);
+        return crc;
+    }
+
+    bool hasCrcInstruction() {
+        static int supported = -1;
+        if (supported < 0) {
+            __builtin_cpu_init();
+            supported = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+        }
+        return supported == 1;
+    }
+#endif
+
+    std::string bigEndian(const uint32_t* words, size_t count) {
+        std::string out;
+        for (size_t i = 0; i < count; ++i)
+            for (int shift = 24; shift >= 0; shift -= 8)
+                out += static_cast<char>((words[i] >> shift) & 0xFF);
+        return out;
+    }
+
+    std::string trim(const std::string& s) {
+        size_t begin = s.find_first_not_of(" \t");
+        if (begin == std::string::npos)
+            return "";
+        return s.substr(begin, s.find_last_not_of(" \t") - begin + 1);
+    }
+
+    std::string toLower(std::string s) {
+        for (size_t i = 0; i < s.size(); ++i)
+            if (s[i] >= 'A' && s[i] <= 'Z')
+                s[i] = s[i] - 'A' + 'a';
+        return s;
+    }
+
+    // Noms RFC 9530 ; Upload-Checksum (tus) écrit "sha256"
+    unsigned int algorithmFromName(const std::string& name) {
+        std::string lower = toLower(name);
+        if (lower == "sha-256" || lower == "sha256")
+            return ContentDigest::SHA256;
+        if (lower == "crc32c")
+            return ContentDigest::CRC32C;
+        if (lower == "md5")
+            return ContentDigest::MD5;
+        return 0;
+    }
+
+    size_t digestSize(unsigned int algorithm) {
+        if (algorithm == ContentDigest::SHA256)
+            return 32;
+        if (algorithm == ContentDigest::MD5)
+            return 16;
+        return 4;
+    }
+}
+
+Sha256::Sha256() : _blockSize(0), _length(0) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(_state, initial, sizeof(_state));
+}
+
+void Sha256::transform(const unsigned char* block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i)
+        w[i] = static_cast<uint32_t>(block[i * 4]) << 24 | block[i * 4 + 1] << 16 | block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    for (int i = 16; i < 64; ++i) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = _state[0], b = _state[1], c = _state[2], d = _state[3];
+    uint32_t e = _state[4], f = _state[5], g = _state[6], h = _state[7];
+    for (int i = 0; i < 64; ++i) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    _state[0] += a; _state[1] += b; _state[2] += c; _state[3] += d;
+    _state[4] += e; _state[5] += f; _state[6] += g; _state[7] += h;
+}
+
+void Sha256::update(const unsigned char* data, size_t size) {
+    _length += size;
+    if (_blockSize) {
+        size_t take = std::min(size, sizeof(_block) - _blockSize);
+        memcpy(_block + _blockSize, data, take);
+        _blockSize += take;
+        data += take;
+        size -= take;
+        if (_blockSize < sizeof(_block))
+            return;
+        transform(_block);
+        _blockSize = 0;
+    }
+    // Blocs complets traités directement depuis le tampon de l'appelant
+    for (; size >= sizeof(_block); data += sizeof(_block), size -= sizeof(_block))
+        transform(data);
+    memcpy(_block, data, size);
+    _blockSize = size;
+}
+
+std::string Sha256::finish() {
+    uint64_t bits = _length * 8;
+    unsigned char padding[72] = { 0x80 };
+    size_t padSize = (_blockSize < 56 ? 56 : 120) - _blockSize;
+    for (int i = 0; i < 8; ++i)
+        padding[padSize + i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+    update(padding, padSize + 8);
+    return bigEndian(_state, 8);
+}
+
+Md5::Md5() : _blockSize(0), _length(0) {
+    _state[0] = 0x67452301;
+    _state[1] = 0xefcdab89;
+    _state[2] = 0x98badcfe;
+    _state[3] = 0x10325476;
+}
+
+void Md5::transform(const unsigned char* block) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; ++i)
+        m[i] = block[i * 4] | block[i * 4 + 1] << 8 | block[i * 4 + 2] << 16 | static_cast<uint32_t>(block[i * 4 + 3]) << 24;
+    uint32_t a = _state[0], b = _state[1], c = _state[2], d = _state[3];
+    for (int i = 0; i < 64; ++i) {
+        uint32_t f;
+        int g;
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) % 16;
+        }
+        uint32_t rotated = b + rotl(a + f + MD5_K[i] + m[g], MD5_SHIFT[i]);
+        a = d;
+        d = c;
+        c = b;
+        b = rotated;
+    }
+    _state[0] += a; _state[1] += b; _state[2] += c; _state[3] += d;
+}
+
+void Md5::update(const unsigned char* data, size_t size) {
+    _length += size;
+    if (_blockSize) {
+        size_t take = std::min(size, sizeof(_block) - _blockSize);
+        memcpy(_block + _blockSize, data, take);
+        _blockSize += take;
+        data += take;
+        size -= take;
+        if (_blockSize < sizeof(_block))
+            return;
+        transform(_block);
+        _blockSize = 0;
+    }
+    for (; size >= sizeof(_block); data += sizeof(_block), size -= sizeof(_block))
+        transform(data);
+    memcpy(_block, data, size);
+    _blockSize = size;
+}
+
+std::string Md5::finish() {
+    uint64_t bits = _length * 8;
+    unsigned char padding[72] = { 0x80 };
+    size_t padSize = (_blockSize < 56 ? 56 : 120) - _blockSize;
+    for (int i = 0; i < 8; ++i)
+        padding[padSize + i] = static_cast<unsigned char>(bits >> (8 * i));
+    update(padding, padSize + 8);
+    // MD5 est little-endian
+    std::string out;
+    for (int i = 0; i < 4; ++i)
+        for (int shift = 0; shift < 32; shift += 8)
+            out += static_cast<char>((_state[i] >> shift) & 0xFF);
+    return out;
+}
+
+Crc32c::Crc32c() : _crc(0xFFFFFFFF) {}
+
+void Crc32c::update(const unsigned char* data, size_t size) {
+#if defined(__GNUC__) && defined(__x86_64__)
+    if (hasCrcInstruction()) {
+        _crc = crcHardware(_crc, data, size);
+        return;
+    }
+#endif
+    _crc = crcSoftware(_crc, data, size);
+}
+
+std::string Crc32c::finish() {
+    uint32_t crc = ~_crc;
+    return bigEndian(&crc, 1);
+}
+
+ContentDigest::ContentDigest(unsigned int algorithms)
+    : _algorithms(algorithms), _finished(false) {}
+
+bool ContentDigest::hasExpectations() const { return !_expected.empty(); }
+
+bool ContentDigest::expectValue(unsigned int algorithm, const std::string& base64) {
+    std::string value;
+    if (!base64Decode(trim(base64), value) || value.size() != digestSize(algorithm))
+        return false;
+    _expected[algorithm] = value;
+    _algorithms |= algorithm;
+    return true;
+}
+
+bool ContentDigest::expect(const HTTPRequest& request) {
+    std::map<std::string, std::string> headers = request.getHeaders();
+    std::map<std::string, std::string>::const_iterator it;
+
+    // Content-Digest: sha-256=:<base64>:, crc32c=:<base64>: ; les
+    // algorithmes inconnus sont ignorés (RFC 9530, section 2)
+    if ((it = headers.find("Content-Digest")) != headers.end()) {
+        std::string list = it->second;
+        size_t start = 0;
+        while (start <= list.size()) {
+            size_t comma = list.find(',', start);
+            std::string member = trim(list.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+            start = comma == std::string::npos ? list.size() + 1 : comma + 1;
+            if (member.empty())
+                continue;
+            size_t equal = member.find('=');
+            if (equal == std::string::npos)
+                return false;
+            std::string value = trim(member.substr(equal + 1));
+            if (value.size() < 2 || value[0] != ':' || value[value.size() - 1] != ':')
+                return false;
+            unsigned int algorithm = algorithmFromName(trim(member.substr(0, equal)));
+            if (algorithm && !expectValue(algorithm, value.substr(1, value.size() - 2)))
+                return false;
+        }
+    }
+    // Content-MD5: <base64> (RFC 1864)
+    if ((it = headers.find("Content-MD5")) != headers.end() && !expectValue(MD5, it->second))
+        return false;
+    // Upload-Checksum: sha256 <base64> (extension checksum de tus)
+    if ((it = headers.find("Upload-Checksum")) != headers.end()) {
+        std::string value = trim(it->second);
+        size_t space = value.find(' ');
+        unsigned int algorithm = space == std::string::npos ? 0 : algorithmFromName(value.substr(0, space));
+        if (!algorithm || !expectValue(algorithm, value.substr(space + 1)))
+            return false;
+    }
+    return true;
+}
+
+void ContentDigest::update(const char* data, size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    if (_algorithms & SHA256)
+        _sha256.update(bytes, size);
+    if (_algorithms & CRC32C)
+        _crc32c.update(bytes, size);
+    if (_algorithms & MD5)
+        _md5.update(bytes, size);
+}
+
+void ContentDigest::finish() {
+    if (_finished)
+        return;
+    _finished = true;
+    if (_algorithms & SHA256)
+        _values[SHA256] = _sha256.finish();
+    if (_algorithms & CRC32C)
+        _values[CRC32C] = _crc32c.finish();
+    if (_algorithms & MD5)
+        _values[MD5] = _md5.finish();
+}
+
+unsigned int ContentDigest::verify() {
+    finish();
+    for (std::map<unsigned int, std::string>::const_iterator it = _expected.begin(); it != _expected.end(); ++it)
+        if (_values[it->first] != it->second)
+            return it->first;
+    return 0;
+}
+
+std::string ContentDigest::header() {
+    finish();
+    std::string header;
+    for (std::map<unsigned int, std::string>::const_iterator it = _values.begin(); it != _values.end(); ++it) {
+        if (!header.empty())
+            header += ", ";
+        header += name(it->first) + "=:" + base64Encode(it->second) + ":";
+    }
+    return header;
+}
+
+std::string ContentDigest::value(unsigned int algorithm) {
+    finish();
+    std::map<unsigned int, std::string>::const_iterator it = _values.find(algorithm);
+    return it == _values.end() ? "" : it->second;
+}
+
+std::string ContentDigest::expectedValue(unsigned int algorithm) const {
+    std::map<unsigned int, std::string>::const_iterator it = _expected.find(algorithm);
+    return it == _expected.end() ? "" : it->second;
+}
+
+bool ContentDigest::parseAlgorithms(const std::string& names, unsigned int& algorithms) {
+    std::istringstream stream(names);
+    std::string name;
+    algorithms = 0;
+    while (stream >> name) {
+        unsigned int algorithm = algorithmFromName(name);
+        if (!algorithm)
+            return false;
+        algorithms |= algorithm;
+    }
+    return true;
+}
+
+std::string ContentDigest::name(unsigned int algorithm) {
+    if (algorithm == SHA256)
+        return "sha-256";
+    if (algorithm == CRC32C)
+        return "crc32c";
+    return "md5";
+}
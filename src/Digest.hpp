@@ -0,0 +1,98 @@
+// Digest.hpp
+#ifndef DIGEST_HPP
+#define DIGEST_HPP
+
+#include <map>
+#include <string>
+#include <stdint.h>
+
+class HTTPRequest;
+
+// Empreintes calculées au fil de l'eau : update() sur chaque morceau, puis
+// finish() donne la valeur binaire (big-endian pour CRC32C)
+class Sha256 {
+public:
+    Sha256();
+    void update(const unsigned char* data, size_t size);
+    std::string finish();
+
+private:
+    uint32_t _state[8];
+    unsigned char _block[64];
+    size_t _blockSize;
+    uint64_t _length;
+
+    void transform(const unsigned char* block);
+};
+
+class Md5 {
+public:
+    Md5();
+    void update(const unsigned char* data, size_t size);
+    std::string finish();
+
+private:
+    uint32_t _state[4];
+    unsigned char _block[64];
+    size_t _blockSize;
+    uint64_t _length;
+
+    void transform(const unsigned char* block);
+};
+
+// CRC32C (Castagnoli) : instruction SSE4.2 quand le processeur l'a
+class Crc32c {
+public:
+    Crc32c();
+    void update(const unsigned char* data, size_t size);
+    std::string finish();
+
+private:
+    uint32_t _crc;
+};
+
+/*
+ * Empreintes d'un contenu (corps de requête, fichier) pour Content-Digest /
+ * Repr-Digest (RFC 9530) : seuls les algorithmes demandés sont calculés.
+ * Les valeurs attendues par le client (Content-Digest, Content-MD5, et
+ * Upload-Checksum de tus) sont vérifiées une fois le contenu complet.
+ */
+class ContentDigest {
+public:
+    enum Algorithm { SHA256 = 1, CRC32C = 2, MD5 = 4 };
+
+    explicit ContentDigest(unsigned int algorithms = 0);
+
+    // Valeurs annoncées par le client ; false si un en-tête est malformé.
+    // Les algorithmes concernés sont ajoutés à ceux calculés.
+    bool expect(const HTTPRequest& request);
+    bool hasExpectations() const;
+    void update(const char* data, size_t size);
+    // Contenu complet ; retourne l'algorithme en défaut, 0 si tout concorde
+    unsigned int verify();
+    // "sha-256=:<base64>:, crc32c=:<base64>:" des algorithmes calculés
+    std::string header();
+    // Valeur binaire calculée (contenu complet), ou annoncée par le client ;
+    // "" si l'algorithme n'est pas concerné
+    std::string value(unsigned int algorithm);
+    std::string expectedValue(unsigned int algorithm) const;
+
+    // Noms RFC 9530 ("sha-256 crc32c") -> masque ; false si inconnu
+    static bool parseAlgorithms(const std::string& names, unsigned int& algorithms);
+    static std::string name(unsigned int algorithm);
+
+private:
+    unsigned int _algorithms;
+    Sha256 _sha256;
+    Crc32c _crc32c;
+    Md5 _md5;
+    bool _finished;
+    // Algorithme -> valeur binaire, calculée puis attendue
+    std::map<unsigned int, std::string> _values;
+    std::map<unsigned int, std::string> _expected;
+
+    void finish();
+    bool expectValue(unsigned int algorithm, const std::string& base64);
+};
+
+#endif
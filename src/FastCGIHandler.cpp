@@ -0,0 +1,167 @@
+// FastCGIHandler.cpp
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <cstring>
+#include "FastCGIHandler.hpp"
+#include "UpstreamPool.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+const size_t FastCGIHandler::MAX_RECORD_CONTENT;
+
+FastCGIHandler::FastCGIHandler(const std::string& scriptPath, const std::string& upstream, const HTTPRequest& request)
+    : UpstreamHandler(scriptPath, upstream, request), _endReceived(false) {
+}
+
+FastCGIHandler::~FastCGIHandler() {
+}
+
+const char* FastCGIHandler::protocolName() const {
+    return "FastCGI";
+}
+
+void FastCGIHandler::appendLength(std::string& out, size_t length) {
+    if (length < 128) {
+        out += static_cast<char>(length);
+    } else {
+        out += static_cast<char>(((length >> 24) & 0x7F) | 0x80);
+        out += static_cast<char>((length >> 16) & 0xFF);
+        out += static_cast<char>((length >> 8) & 0xFF);
+        out += static_cast<char>(length & 0xFF);
+    }
+}
+
+void FastCGIHandler::appendRecord(unsigned char type, const char* data, size_t size) {
+    char header[HEADER_LENGTH];
+    header[0] = 1; // FCGI_VERSION_1
+    header[1] = static_cast<char>(type);
+    header[2] = static_cast<char>((REQUEST_ID >> 8) & 0xFF);
+    header[3] = static_cast<char>(REQUEST_ID & 0xFF);
+    header[4] = static_cast<char>((size >> 8) & 0xFF);
+    header[5] = static_cast<char>(size & 0xFF);
+    header[6] = 0; // padding
+    header[7] = 0;
+    _CGIInput.append(header, HEADER_LENGTH);
+    _CGIInput.append(data, size);
+}
+
+// Un flux (PARAMS, STDIN) est découpé en records et terminé par un record vide
+void FastCGIHandler::appendStream(unsigned char type, const char* data, size_t size) {
+    for (size_t offset = 0; offset < size; offset += MAX_RECORD_CONTENT) {
+        appendRecord(type, data + offset, std::min(MAX_RECORD_CONTENT, size - offset));
+    }
+    appendRecord(type, "", 0);
+}
+
+// STDIN n'est terminé qu'une fois tout le corps reçu du client
+void FastCGIHandler::appendBody(const char* data, size_t size) {
+    if (!isAwaitingBody()) {
+        appendStream(FCGI_STDIN, data, size);
+        return;
+    }
+    for (size_t offset = 0; offset < size; offset += MAX_RECORD_CONTENT) {
+        appendRecord(FCGI_STDIN, data + offset, std::min(MAX_RECORD_CONTENT, size - offset));
+    }
+}
+
+bool FastCGIHandler::startCGI() {
+    _lastReadTime = curr_time_ms();
+    _lastSendTime = _lastReadTime;
+    Logger::instance().log(DEBUG, "Forwarding " + _scriptPath + " to FastCGI upstream " + _upstream);
+
+    // Le corps déjà reçu est réencapsulé en records STDIN
+    std::string body;
+    body.swap(_CGIInput);
+    _CGIInput.reserve(body.size() + 1024);
+
+    // Rôle RESPONDER, FCGI_KEEP_CONN : la connexion revient au pool après la réponse
+    char beginBody[8] = { 0, 1, 1, 0, 0, 0, 0, 0 };
+    appendRecord(FCGI_BEGIN_REQUEST, beginBody, sizeof(beginBody));
+
+    std::vector<std::string> env = buildEnvironment(_inputExpected);
+    std::string params;
+    for (size_t i = 0; i < env.size(); ++i) {
+        size_t separator = env[i].find('=');
+        size_t valueLength = env[i].size() - separator - 1;
+        appendLength(params, separator);
+        appendLength(params, valueLength);
+        params.append(env[i], 0, separator);
+        params.append(env[i], separator + 1, valueLength);
+    }
+    appendStream(FCGI_PARAMS, params.data(), params.size());
+    appendBody(body.data(), body.size());
+
+    return connectUpstream(true);
+}
+
+// Consomme les records complets : STDOUT alimente la sortie du script,
+// STDERR part dans les logs, END_REQUEST termine la requête.
+bool FastCGIHandler::processRecords() {
+    size_t offset = 0;
+    while (!_endReceived && _recordBuffer.size() - offset >= HEADER_LENGTH) {
+        const unsigned char* header = reinterpret_cast<const unsigned char*>(_recordBuffer.data() + offset);
+        size_t contentLength = (static_cast<size_t>(header[4]) << 8) | header[5];
+        size_t recordLength = HEADER_LENGTH + contentLength + header[6];
+        if (_recordBuffer.size() - offset < recordLength)
+            break;
+
+        size_t contentStart = offset + HEADER_LENGTH;
+        if (header[1] == FCGI_STDOUT) {
+            size_t accepted = outputAllowance(contentLength);
+            _CGIOutput.append(_recordBuffer, contentStart, accepted);
+            _outputTotal += accepted;
+        } else if (header[1] == FCGI_STDERR) {
+            logErrors(_recordBuffer.data() + contentStart, contentLength);
+        } else if (header[1] == FCGI_END_REQUEST) {
+            if (contentLength < 5)
+                return false;
+            const unsigned char* body = header + HEADER_LENGTH;
+            int appStatus = (body[0] << 24) | (body[1] << 16) | (body[2] << 8) | body[3];
+            int protocolStatus = body[4];
+            _endReceived = true;
+            _cgiFinished = true;
+            flushErrors();
+            _cgiExitStatus = protocolStatus ? protocolStatus : appStatus;
+        }
+        offset += recordLength;
+    }
+    _recordBuffer.erase(0, offset);
+    return true;
+}
+
+int FastCGIHandler::readFromCGI() {
+    if (_socketFd == -1)
+        return 0;
+
+    char buffer[16384];
+    ssize_t bytesRead = read(_socketFd, buffer, sizeof(buffer));
+    if (bytesRead == 0) {
+        fail("connection closed before the end of the response");
+        return 0;
+    }
+    if (bytesRead < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return -1;
+        // ECONNRESET & co : 502 tout de suite plutôt qu'une attente jusqu'au 504
+        fail(std::string("read error: ") + strerror(errno));
+        return 0;
+    }
+
+    _recordBuffer.append(buffer, bytesRead);
+    _lastReadTime = curr_time_ms();
+    if (!processRecords()) {
+        fail("malformed FastCGI record");
+        return 0;
+    }
+    if (_endReceived) {
+        // Réponse complète : la connexion est réutilisable si rien ne traîne derrière
+        if (_recordBuffer.empty())
+            UpstreamPool::instance().release(_upstream, _socketFd);
+        else
+            close(_socketFd);
+        _socketFd = -1;
+        return 0;
+    }
+    return bytesRead;
+}
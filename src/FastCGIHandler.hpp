@@ -0,0 +1,49 @@
+// FastCGIHandler.hpp
+#ifndef FASTCGIHANDLER_HPP
+#define FASTCGIHANDLER_HPP
+
+#include <string>
+#include "UpstreamHandler.hpp"
+
+/*
+ * Requête envoyée à un serveur FastCGI persistant (fastcgi_pass), sur une
+ * connexion du pool rendue après chaque réponse (FCGI_KEEP_CONN).
+ * Le même socket sert d'entrée (écriture des records BEGIN/PARAMS/STDIN)
+ * puis de sortie (lecture des records STDOUT/STDERR/END_REQUEST) ; la sortie
+ * standard du script suit ensuite le même chemin que celle d'un CGI classique.
+ */
+class FastCGIHandler : public UpstreamHandler {
+public:
+    FastCGIHandler(const std::string& scriptPath, const std::string& upstream, const HTTPRequest& request);
+    virtual ~FastCGIHandler();
+
+    virtual bool startCGI();
+    virtual int readFromCGI();
+
+protected:
+    virtual const char* protocolName() const;
+    virtual void appendBody(const char* data, size_t size);
+
+private:
+    enum RecordType {
+        FCGI_BEGIN_REQUEST = 1,
+        FCGI_END_REQUEST = 3,
+        FCGI_PARAMS = 4,
+        FCGI_STDIN = 5,
+        FCGI_STDOUT = 6,
+        FCGI_STDERR = 7
+    };
+    static const unsigned short REQUEST_ID = 1;
+    static const size_t HEADER_LENGTH = 8;
+    static const size_t MAX_RECORD_CONTENT = 65535;
+
+    bool _endReceived;
+    std::string _recordBuffer;
+
+    void appendRecord(unsigned char type, const char* data, size_t size);
+    void appendStream(unsigned char type, const char* data, size_t size);
+    static void appendLength(std::string& out, size_t length);
+    bool processRecords();
+};
+
+#endif
@@ -8,13 +8,13 @@
 
 HTTPRequest::HTTPRequest()
     : _complete(false), _connectionClosed(false), _maxBodySize(0),
-      _contentLength(0), _bodyReceived(0), _headersParsed(false), _requestTooLarge(false), _errorCode(0) {
+      _contentLength(0), _bodyReceived(0), _headersParsed(false), _requestTooLarge(false), _streamBody(false), _expectHandled(false), _errorCode(0) {
         setLastActivity(curr_time_ms());
       }
 
 HTTPRequest::HTTPRequest(int max_body_size)
     : _complete(false), _connectionClosed(false), _maxBodySize(max_body_size),
-      _contentLength(0), _bodyReceived(0), _headersParsed(false), _requestTooLarge(false), _errorCode(0) {
+      _contentLength(0), _bodyReceived(0), _headersParsed(false), _requestTooLarge(false), _streamBody(false), _expectHandled(false), _errorCode(0) {
         setLastActivity(curr_time_ms());
       }
 
@@ -70,9 +70,11 @@ void HTTPRequest::parseRawRequest(const ServerConfig& config) {
             header_value.erase(0, header_value.find_first_not_of(" \t"));
             header_value.erase(header_value.find_last_not_of(" \t") + 1);
 
-            if (header_name == "Content-Length") {
-                _contentLength = static_cast<size_t>(atoi(header_value.c_str()));
+            if (header_name == "Content-Length" && !parseContentLength(header_value, _contentLength)) {
+                Logger::instance().log(WARNING, "Invalid Content-Length: " + header_value);
+                _errorCode = 400;
             }
+            _headers[header_name] = header_value;
         }
     }
 
@@ -85,6 +87,16 @@ void HTTPRequest::parseRawRequest(const ServerConfig& config) {
     }
 }
 
+// Chiffres uniquement, sans dépassement : atoi rendait un corps de plus de
+// 2 Go négatif, puis énorme une fois converti en size_t
+bool HTTPRequest::parseContentLength(const std::string& value, size_t& length) {
+    if (value.empty() || value.size() > 19 || value.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    // 19 chiffres tiennent sur 64 bits
+    length = static_cast<size_t>(strtoull(value.c_str(), NULL, 10));
+    return true;
+}
+
 bool HTTPRequest::parse() {
     size_t header_end_pos = _rawRequest.find("\r\n\r\n");
     if (header_end_pos == std::string::npos) {
@@ -115,12 +127,17 @@ bool HTTPRequest::parse() {
     // Handle the body if there's a Content-Length
     std::map<std::string, std::string>::iterator it = _headers.find("Content-Length");
     if (it != _headers.end()) {
-        int content_length = std::atoi(it->second.c_str());
-        if (body_part.size() < static_cast<size_t>(content_length)) {
-            Logger::instance().log(ERROR, "Failed to read the entire body");
-            return false;
+        size_t content_length = _contentLength;
+        if (body_part.size() < content_length) {
+            if (!_streamBody) {
+                Logger::instance().log(ERROR, "Failed to read the entire body");
+                return false;
+            }
+            // Le reste du corps ira directement du socket au CGI
+            parseBody(body_part);
+        } else {
+            parseBody(body_part.substr(0, content_length));
         }
-        parseBody(body_part.substr(0, content_length));
     }
 
     return true;
@@ -243,6 +260,10 @@ void HTTPRequest::setConnectionClosed(bool value) { _connectionClosed = value; }
 void HTTPRequest::setComplete(bool value) { _complete = value; }
 
 void HTTPRequest::setLastActivity(unsigned long timestamp) { _lastActivity = timestamp; }
+bool HTTPRequest::getStreamBody() const { return _streamBody; }
+void HTTPRequest::setStreamBody(bool value) { _streamBody = value; }
+bool HTTPRequest::getExpectHandled() const { return _expectHandled; }
+void HTTPRequest::setExpectHandled(bool value) { _expectHandled = value; }
 
 int HTTPRequest::getErrorCode() const {
     return _errorCode;
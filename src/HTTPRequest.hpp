@@ -52,6 +52,15 @@ public:
 	int getErrorCode() const;
     void setErrorCode(int code);
 
+	// Corps transmis au CGI au fil de l'eau (cgi_request_buffering off) :
+	// la requête est traitée dès la fin des en-têtes
+	bool getStreamBody() const;
+	void setStreamBody(bool value);
+
+	// Expect: 100-continue traité : réponse intermédiaire envoyée, ou refus
+	bool getExpectHandled() const;
+	void setExpectHandled(bool value);
+
 private:
 	std::string _method;
 	std::string _path;
@@ -66,6 +75,8 @@ private:
     size_t _bodyReceived;
     bool _headersParsed;
     bool _requestTooLarge;
+    bool _streamBody;
+    bool _expectHandled;
 
 	unsigned long _lastActivity;
 
@@ -73,6 +84,7 @@ private:
 	bool parseRequestLine(const std::string& line);
 	void parseHeaders(const std::string& headers);
 	void parseBody(const std::string& body);
+	static bool parseContentLength(const std::string& value, size_t& length);
 	void parseQueryString();
 
 	int _errorCode;
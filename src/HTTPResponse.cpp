@@ -3,7 +3,7 @@
 #include "Server.hpp"
 #include "Utils.hpp"
 
-HTTPResponse::HTTPResponse() : _statusCode(200), _reasonPhrase("OK") {}
+HTTPResponse::HTTPResponse() : _statusCode(200), _reasonPhrase("OK"), _headOnly(false) {}
 
 HTTPResponse::~HTTPResponse() {}
 
@@ -23,15 +23,21 @@ void HTTPResponse::setStatusCode(int code) {
 		case 404: _reasonPhrase = "Not Found"; break;
 		case 405: _reasonPhrase = "Method Not Allowed"; break;
 		case 408: _reasonPhrase = "Request Timeout"; break; // le serveur ne reçoit pas de requête complète dans un délai défini.
+		case 409: _reasonPhrase = "Conflict"; break; // état de la ressource incompatible (offset d'un upload reprenable)
+		case 410: _reasonPhrase = "Gone"; break; // upload reprenable expiré
+		case 412: _reasonPhrase = "Precondition Failed"; break;
 		case 413: _reasonPhrase = "Payload Too Large"; break; // fichier téléchargé dépasse la limite autorisée.
 		case 415: _reasonPhrase = "Unsupported Media Type"; break; // Si certains types de fichiers ne sont pas acceptés.
+		case 417: _reasonPhrase = "Expectation Failed"; break; // Expect autre que 100-continue
 		case 418: _reasonPhrase = "I'm a teapot"; break; //?? Where should we implement it ?
 		case 429: _reasonPhrase = "Too Many Requests"; break; // trop grand nombre de requêtes en peu de temps (si limite)
+		case 460: _reasonPhrase = "Checksum Mismatch"; break; // extension checksum de tus : morceau refusé
 		case 500: _reasonPhrase = "Internal Server Error"; break;
 		case 501: _reasonPhrase = "Method Not Implemented"; break;
 		case 502: _reasonPhrase = "Bad Gateway"; break; // un serveur (agissant comme une passerelle ou un proxy, style NGINX) a reçu une réponse invalide ou inattendue d'un autre serveur en amont
 		case 503: _reasonPhrase = "Service Unavailable"; break; // le serveur n'est pas prêt à traiter la requête (surcharge, maintenance, etc.).
 		case 504: _reasonPhrase = "Gateway Timeout"; break; //un des serveurs, passerelle ou proxy, n'a pas reçu une réponse à temps de la part d'un autre serveur (ou interface) qu'il a interrogé pour obtenir une réponse à la requête
+		case 507: _reasonPhrase = "Insufficient Storage"; break; // plus assez de place sur le disque pour un upload
 
 		default: _reasonPhrase = "Unknown";
 	}
@@ -99,6 +105,16 @@ void HTTPResponse::setBody(const std::string& body) {
 	_body = body;
 }
 
+// Réponse à un HEAD : les en-têtes (dont Content-Length) décrivent le corps
+// qu'aurait renvoyé le GET, mais celui-ci n'est jamais émis.
+void HTTPResponse::setHeadOnly(bool value) {
+	_headOnly = value;
+}
+
+bool HTTPResponse::isBodyless() const {
+	return _headOnly || _statusCode == 204 || _statusCode == 304 || (_statusCode >= 100 && _statusCode < 200);
+}
+
 int HTTPResponse::getStatusCode() const {
 	return _statusCode;
 }
@@ -137,7 +153,8 @@ std::string HTTPResponse::toString() const {
 	oss << toStringHeaders();
 
 	oss << "\r\n";
-	oss << _body;
+	if (!isBodyless())
+		oss << _body;
 
 	return oss.str();
 }
@@ -13,6 +13,7 @@ public:
     void setReasonPhrase(const std::string& reason);
     void setHeader(const std::string& key, const std::string& value);
     void setBody(const std::string& body);
+    void setHeadOnly(bool value);
     HTTPResponse& beError(int err_code, const std::string& errorContent = "");
 
     int getStatusCode() const;
@@ -21,6 +22,7 @@ public:
     std::map<std::string, std::string> getHeaders() const;
     std::string getBody() const;
     std::string getStrHeader(std::string header) const;
+    bool isBodyless() const;
 
     std::string toString() const;
     std::string toStringHeaders() const;
@@ -34,6 +36,7 @@ private:
     std::string _reasonPhrase;
     std::map<std::string, std::string> _headers;
     std::string _body;
+    bool _headOnly;
 };
 
 std::string getSorryPath();
@@ -5,6 +5,10 @@
 #include <map>
 #include <vector>
 
+// upload_fsync : rien, fichier synchronisé avant son renommage, ou fichier
+// puis répertoire (le renommage lui-même survit à un crash)
+enum UploadFsync { UPLOAD_FSYNC_OFF, UPLOAD_FSYNC_FILE, UPLOAD_FSYNC_FULL };
+
 
 struct Location {
 	std::string path;
@@ -16,11 +20,80 @@ struct Location {
 	std::string returnUrl;
 	std::string uploadPath;
 	bool uploadOn;
+	UploadFsync uploadFsync;
+	// Empreintes calculées sur chaque upload (masque ContentDigest::Algorithm,
+	// 0 : seulement celles que le client demande de vérifier)
+	unsigned int uploadDigest;
+	// Fichiers rangés par contenu, les noms n'en étant que des liens (ContentStore)
+	bool uploadDedup;
+	// Uploads simultanés et octets annoncés en cours (0 : illimité) ; en
+	// excès, file FIFO d'au plus uploadQueueSize requêtes pendant
+	// uploadQueueTimeout ms (UploadLimiter)
+	int uploadMaxConcurrent;
+	size_t uploadMaxInflight;
+	size_t uploadQueueSize;
+	unsigned long uploadQueueTimeout;
+	// Uploads reprenables (tus) sur cette location, et leur taille max
+	// (défaut 1 Go, 0 : illimitée ; chaque PATCH reste borné par
+	// client_max_body_size). Un upload sans PATCH depuis
+	// uploadResumableExpire ms est supprimé (0 : jamais)
+	bool uploadResumable;
+	size_t uploadResumableMaxSize;
+	unsigned long uploadResumableExpire;
 	int autoindex;
 
 	std::map<std::string, std::string> cgiInterpreters;
+	std::string fastcgiPass;
+	// Serveurs d'application SCGI / uwsgi, même syntaxe que fastcgi_pass
+	std::string scgiPass;
+	std::string uwsgiPass;
+	// off : le corps des POST vers un CGI lui est transmis pendant la réception
+	bool cgiRequestBuffering;
+	// on : une fois les en-têtes du script traités, le corps passe entre pipe
+	// et socket par splice() ; cgi_pipe_size agrandit les pipes (F_SETPIPE_SZ)
+	bool cgiSplice;
+	int cgiPipeSize;
+
+	// CGI simultanés (0 : illimité) ; les requêtes en excès attendent en file
+	// FIFO, au plus cgiQueueSize requêtes pendant cgiQueueTimeout ms
+	int cgiMaxConcurrent;
+	size_t cgiQueueSize;
+	unsigned long cgiQueueTimeout;
+
+	// Délais (ms) sans sortie du script / sans progression de l'écriture de
+	// son entrée, et taille max de sa sortie (0 : valeurs par défaut)
+	unsigned long cgiReadTimeout;
+	unsigned long cgiSendTimeout;
+	size_t cgiMaxOutput;
+
+	// Limites posées au script avant execve (0 : héritées du serveur) : temps
+	// CPU (s), espace d'adressage (octets), fds ouverts, et niceness
+	unsigned long cgiRlimitCpu;
+	unsigned long cgiRlimitAs;
+	unsigned long cgiRlimitNofile;
+	int cgiNice;
+
+	// Micro-cache des réponses CGI (ResponseCache) : durée de vie imposée
+	// (ms, 0 : celle du script), délai pendant lequel une réponse périmée
+	// reste servie le temps de son rafraîchissement, et attente max d'une
+	// requête identique à un CGI déjà en vol (0 : pas de regroupement)
+	bool cgiCache;
+	unsigned long cgiCacheValid;
+	unsigned long cgiCacheStale;
+	unsigned long cgiCacheLockTimeout;
+
+	// Sert les compteurs du serveur (Metrics) au lieu de fichiers
+	bool metrics;
+
+	// cgi_param de la location, puis environnement CGI statique ("NOM=valeur")
+	// construit une fois au chargement de la config
+	std::map<std::string, std::string> cgiParams;
+	std::vector<std::string> cgiStaticEnv;
 
-	Location() : clientMaxBodySize(-1), returnCode(0), uploadOn(false), autoindex(-1) {}
+	Location() : clientMaxBodySize(-1), returnCode(0), uploadOn(false), uploadFsync(UPLOAD_FSYNC_OFF), uploadDigest(0), uploadDedup(false), uploadMaxConcurrent(0), uploadMaxInflight(0), uploadQueueSize(0), uploadQueueTimeout(10000), uploadResumable(false), uploadResumableMaxSize(1073741824), uploadResumableExpire(86400000), autoindex(-1), cgiRequestBuffering(true), cgiSplice(false), cgiPipeSize(0),
+		cgiMaxConcurrent(0), cgiQueueSize(0), cgiQueueTimeout(10000),
+		cgiReadTimeout(0), cgiSendTimeout(0), cgiMaxOutput(0),
+		cgiRlimitCpu(0), cgiRlimitAs(0), cgiRlimitNofile(0), cgiNice(0), cgiCache(false), cgiCacheValid(0), cgiCacheStale(0), cgiCacheLockTimeout(5000), metrics(false) {}
 };
 
 #endif
@@ -0,0 +1,52 @@
+// Metrics.cpp
+#include <sstream>
+#include "Metrics.hpp"
+
+Metrics& Metrics::instance() {
+    static Metrics instance;
+    return instance;
+}
+
+Metrics::Metrics() {}
+
+void Metrics::increment(const std::string& name, unsigned long value) {
+    _counters[name] += value;
+}
+
+void Metrics::setGauge(const std::string& name, long value) {
+    _gauges[name] = value;
+}
+
+void Metrics::observe(const std::string& name, unsigned long value) {
+    Summary& summary = _summaries[name];
+    ++summary.count;
+    summary.sum += value;
+    if (value > summary.max)
+        summary.max = value;
+}
+
+std::string Metrics::labeled(const std::string& name, const std::string& label, const std::string& value) {
+    return name + "{" + label + "=\"" + value + "\"}";
+}
+
+// cgi_queue_wait_ms{location="/"} + _sum -> cgi_queue_wait_ms_sum{location="/"}
+std::string Metrics::suffixed(const std::string& name, const std::string& suffix) {
+    size_t brace = name.find('{');
+    if (brace == std::string::npos)
+        return name + suffix;
+    return name.substr(0, brace) + suffix + name.substr(brace);
+}
+
+std::string Metrics::render() const {
+    std::ostringstream out;
+    for (std::map<std::string, unsigned long>::const_iterator it = _counters.begin(); it != _counters.end(); ++it)
+        out << it->first << " " << it->second << "\n";
+    for (std::map<std::string, long>::const_iterator it = _gauges.begin(); it != _gauges.end(); ++it)
+        out << it->first << " " << it->second << "\n";
+    for (std::map<std::string, Summary>::const_iterator it = _summaries.begin(); it != _summaries.end(); ++it) {
+        out << suffixed(it->first, "_count") << " " << it->second.count << "\n";
+        out << suffixed(it->first, "_sum") << " " << it->second.sum << "\n";
+        out << suffixed(it->first, "_max") << " " << it->second.max << "\n";
+    }
+    return out.str();
+}
@@ -0,0 +1,46 @@
+// Metrics.hpp
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <map>
+
+/*
+ * Compteurs et jauges du serveur, servis en texte (format Prometheus) par
+ * une location "metrics on;". Les noms portent leurs labels :
+ * cgi_queue_depth{location="/cgi-bin"}.
+ */
+class Metrics {
+public:
+    static Metrics& instance();
+
+    void increment(const std::string& name, unsigned long value = 1);
+    void setGauge(const std::string& name, long value);
+    // Valeur observée (durée, taille...) : exposée en _count, _sum et _max
+    void observe(const std::string& name, unsigned long value);
+
+    std::string render() const;
+
+    // nom{label="valeur"}
+    static std::string labeled(const std::string& name, const std::string& label, const std::string& value);
+
+private:
+    Metrics();
+    Metrics(const Metrics&);
+    Metrics& operator=(const Metrics&);
+
+    struct Summary {
+        unsigned long count;
+        unsigned long sum;
+        unsigned long max;
+        Summary() : count(0), sum(0), max(0) {}
+    };
+
+    std::map<std::string, unsigned long> _counters;
+    std::map<std::string, long> _gauges;
+    std::map<std::string, Summary> _summaries;
+
+    static std::string suffixed(const std::string& name, const std::string& suffix);
+};
+
+#endif
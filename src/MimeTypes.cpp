@@ -0,0 +1,141 @@
+// MimeTypes.cpp
+#include <cctype>
+#include "MimeTypes.hpp"
+
+namespace {
+    struct MimeEntry {
+        const char* extension;
+        const char* type;
+    };
+
+    const MimeEntry defaultEntries[] = {
+        { "html", "text/html" },
+        { "htm", "text/html" },
+        { "shtml", "text/html" },
+        { "css", "text/css" },
+        { "txt", "text/plain" },
+        { "csv", "text/csv" },
+        { "xml", "text/xml" },
+        { "js", "application/javascript" },
+        { "mjs", "application/javascript" },
+        { "json", "application/json" },
+        { "map", "application/json" },
+        { "wasm", "application/wasm" },
+        { "pdf", "application/pdf" },
+        { "zip", "application/zip" },
+        { "gz", "application/gzip" },
+        { "tar", "application/x-tar" },
+        { "png", "image/png" },
+        { "jpg", "image/jpeg" },
+        { "jpeg", "image/jpeg" },
+        { "gif", "image/gif" },
+        { "ico", "image/x-icon" },
+        { "svg", "image/svg+xml" },
+        { "svgz", "image/svg+xml" },
+        { "webp", "image/webp" },
+        { "avif", "image/avif" },
+        { "bmp", "image/bmp" },
+        { "tif", "image/tiff" },
+        { "tiff", "image/tiff" },
+        { "woff", "font/woff" },
+        { "woff2", "font/woff2" },
+        { "ttf", "font/ttf" },
+        { "otf", "font/otf" },
+        { "eot", "application/vnd.ms-fontobject" },
+        { "mp3", "audio/mpeg" },
+        { "ogg", "audio/ogg" },
+        { "wav", "audio/wav" },
+        { "m4a", "audio/mp4" },
+        { "mp4", "video/mp4" },
+        { "webm", "video/webm" },
+        { "mov", "video/quicktime" },
+        { "avi", "video/x-msvideo" },
+        { "mpeg", "video/mpeg" }
+    };
+
+    const size_t INITIAL_BUCKETS = 64;
+}
+
+MimeTypes::MimeTypes() : _buckets(INITIAL_BUCKETS), _count(0), _defaultType("application/octet-stream") {
+    loadDefaults();
+}
+
+MimeTypes::~MimeTypes() {}
+
+void MimeTypes::loadDefaults() {
+    for (size_t i = 0; i < sizeof(defaultEntries) / sizeof(defaultEntries[0]); ++i) {
+        add(defaultEntries[i].extension, defaultEntries[i].type);
+    }
+}
+
+std::string MimeTypes::normalize(const std::string& extension) {
+    std::string key = extension;
+    if (!key.empty() && key[0] == '.')
+        key.erase(0, 1);
+    for (size_t i = 0; i < key.size(); ++i)
+        key[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(key[i])));
+    return key;
+}
+
+// djb2
+unsigned long MimeTypes::hash(const std::string& key) {
+    unsigned long h = 5381;
+    for (size_t i = 0; i < key.size(); ++i)
+        h = ((h << 5) + h) + static_cast<unsigned char>(key[i]);
+    return h;
+}
+
+void MimeTypes::rehash(size_t bucketCount) {
+    std::vector<Bucket> buckets(bucketCount);
+    for (size_t i = 0; i < _buckets.size(); ++i) {
+        for (size_t j = 0; j < _buckets[i].size(); ++j) {
+            buckets[hash(_buckets[i][j].first) % bucketCount].push_back(_buckets[i][j]);
+        }
+    }
+    _buckets.swap(buckets);
+}
+
+void MimeTypes::add(const std::string& extension, const std::string& type) {
+    std::string key = normalize(extension);
+    if (key.empty() || type.empty())
+        return;
+
+    Bucket& bucket = _buckets[hash(key) % _buckets.size()];
+    for (size_t i = 0; i < bucket.size(); ++i) {
+        if (bucket[i].first == key) {
+            bucket[i].second = type;
+            return;
+        }
+    }
+    bucket.push_back(std::make_pair(key, type));
+    ++_count;
+
+    // Garde une charge moyenne <= 1 pour rester en O(1)
+    if (_count > _buckets.size())
+        rehash(_buckets.size() * 2);
+}
+
+void MimeTypes::setDefaultType(const std::string& type) {
+    _defaultType = type;
+}
+
+const std::string& MimeTypes::lookup(const std::string& extension) const {
+    std::string key = normalize(extension);
+    if (key.empty())
+        return _defaultType;
+
+    const Bucket& bucket = _buckets[hash(key) % _buckets.size()];
+    for (size_t i = 0; i < bucket.size(); ++i) {
+        if (bucket[i].first == key)
+            return bucket[i].second;
+    }
+    return _defaultType;
+}
+
+const std::string& MimeTypes::getDefaultType() const {
+    return _defaultType;
+}
+
+size_t MimeTypes::size() const {
+    return _count;
+}
@@ -0,0 +1,41 @@
+// MimeTypes.hpp
+#ifndef MIMETYPES_HPP
+#define MIMETYPES_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+
+/*
+ * Registre extension -> type MIME, construit une seule fois au chargement de
+ * la config (valeurs par défaut + bloc `types {}` du serveur).
+ * Table de hachage à chaînage : lookup en O(1) sur le chemin des fichiers
+ * statiques, sans dépendance hors C++98.
+ */
+class MimeTypes {
+public:
+    MimeTypes();
+    ~MimeTypes();
+
+    void loadDefaults();
+    void add(const std::string& extension, const std::string& type);
+    void setDefaultType(const std::string& type);
+
+    // Accepte "css" comme ".css", insensible à la casse
+    const std::string& lookup(const std::string& extension) const;
+    const std::string& getDefaultType() const;
+    size_t size() const;
+
+private:
+    typedef std::vector<std::pair<std::string, std::string> > Bucket;
+
+    std::vector<Bucket> _buckets;
+    size_t _count;
+    std::string _defaultType;
+
+    static std::string normalize(const std::string& extension);
+    static unsigned long hash(const std::string& key);
+    void rehash(size_t bucketCount);
+};
+
+#endif
@@ -0,0 +1,86 @@
+// MultipartParser.cpp
+#include "MultipartParser.hpp"
+#include <algorithm>
+
+MultipartParser::MultipartParser(const std::string& boundary, Listener& listener)
+    : _listener(listener), _delimiter("\r\n--" + boundary), _window("\r\n"), _state(PREAMBLE), _inPart(false) {
+}
+
+bool MultipartParser::isDone() const { return _state == DONE; }
+bool MultipartParser::hasFailed() const { return _state == FAILED; }
+const std::string& MultipartParser::getError() const { return _error; }
+
+bool MultipartParser::fail(const std::string& reason) {
+    if (_state != FAILED)
+        _error = reason;
+    _state = FAILED;
+    _window.clear();
+    return false;
+}
+
+bool MultipartParser::feed(const char* data, size_t size) {
+    if (_state == FAILED)
+        return false;
+    if (_state == DONE)
+        return true; // Épilogue ignoré
+    _window.append(data, size);
+    return process();
+}
+
+// Consomme la fenêtre autant que possible ; ce qui reste attend la suite
+bool MultipartParser::process() {
+    size_t offset = 0;
+    bool progress = true;
+    while (progress && _state != DONE) {
+        progress = false;
+        if (_state == PREAMBLE || _state == BODY) {
+            size_t pos = _window.find(_delimiter, offset);
+            size_t end = pos == std::string::npos ? _window.size() : pos;
+            // Sans limite trouvée, la fin peut encore en être le début
+            if (pos == std::string::npos)
+                end -= std::min(_delimiter.size() - 1, _window.size() - offset);
+            if (_state == BODY && end > offset && !_listener.onPartData(_window.data() + offset, end - offset))
+                return fail("upload aborted");
+            offset = end;
+            if (pos != std::string::npos) {
+                offset += _delimiter.size();
+                _inPart = _state == BODY;
+                _state = DELIMITER_END;
+                progress = true;
+            }
+        } else if (_state == DELIMITER_END) {
+            // Espaces tolérés avant la fin de ligne (transport padding)
+            while (offset < _window.size() && (_window[offset] == ' ' || _window[offset] == '\t'))
+                ++offset;
+            if (_window.size() - offset < 2)
+                break;
+            bool last = _window.compare(offset, 2, "--") == 0;
+            if (!last && _window.compare(offset, 2, "\r\n") != 0)
+                return fail("malformed boundary line");
+            // La partie précédente n'est close qu'une fois la limite validée
+            if (_inPart && !_listener.onPartEnd())
+                return fail("upload aborted");
+            _inPart = false;
+            offset += 2;
+            _state = last ? DONE : HEADERS;
+            progress = true;
+        } else if (_state == HEADERS) {
+            size_t headersEnd = _window.compare(offset, 2, "\r\n") == 0 ? offset : _window.find("\r\n\r\n", offset);
+            if (headersEnd == std::string::npos) {
+                if (_window.size() - offset > MAX_PART_HEADERS)
+                    return fail("part headers too large");
+                break;
+            }
+            if (!_listener.onPartBegin(_window.substr(offset, headersEnd - offset)))
+                return fail("upload aborted");
+            offset = headersEnd + (headersEnd == offset ? 2 : 4);
+            _state = BODY;
+            progress = true;
+        }
+    }
+    if (_state == DONE)
+        _window.clear();
+    else
+        _window.erase(0, offset);
+    return true;
+}
@@ -0,0 +1,53 @@
+// MultipartParser.hpp
+#ifndef MULTIPARTPARSER_HPP
+#define MULTIPARTPARSER_HPP
+
+#include <string>
+
+/*
+ * Parser multipart/form-data incrémental : le corps lui est donné par
+ * morceaux, au fil de la réception, et le contenu des parties est remis au
+ * listener dès qu'il est sûr de ne pas appartenir à une limite. Seule la
+ * fin d'un morceau qui pourrait commencer une limite est gardée d'un appel à
+ * l'autre (plus les en-têtes de la partie en cours, bornés).
+ */
+class MultipartParser {
+public:
+    class Listener {
+    public:
+        virtual ~Listener() {}
+        // false : abandon, le listener a noté la raison
+        virtual bool onPartBegin(const std::string& headers) = 0;
+        virtual bool onPartData(const char* data, size_t size) = 0;
+        virtual bool onPartEnd() = 0;
+    };
+
+    MultipartParser(const std::string& boundary, Listener& listener);
+
+    // false si le corps est invalide ou si le listener a abandonné
+    bool feed(const char* data, size_t size);
+    // Limite finale ("--boundary--") atteinte
+    bool isDone() const;
+    bool hasFailed() const;
+    const std::string& getError() const;
+
+    static const size_t MAX_PART_HEADERS = 8192;
+
+private:
+    enum State { PREAMBLE, DELIMITER_END, HEADERS, BODY, DONE, FAILED };
+
+    Listener& _listener;
+    // "\r\n--boundary" : la première limite du corps est précédée d'un \r\n
+    // fictif pour être reconnue comme les suivantes
+    std::string _delimiter;
+    std::string _window;
+    State _state;
+    // Limite trouvée après le contenu d'une partie, fin de ligne pas encore vue
+    bool _inPart;
+    std::string _error;
+
+    bool fail(const std::string& reason);
+    bool process();
+};
+
+#endif
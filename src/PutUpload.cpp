@@ -0,0 +1,135 @@
+// PutUpload.cpp
+#include "PutUpload.hpp"
+#include <errno.h>
+#include <sys/stat.h>
+#include "ContentStore.hpp"
+#include "HTTPRequest.hpp"
+#include "HTTPResponse.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+PutUpload::PutUpload(const std::string& uri, const std::string& destPath, const std::string& uploadDir, bool replacing,
+                     size_t contentLength, const Location& location)
+    : UploadStream(contentLength), _uri(uri), _destPath(destPath), _uploadDir(uploadDir), _replacing(replacing),
+      _fsyncPolicy(location.uploadFsync), _dedup(location.uploadDedup), _stored(false) {}
+
+PutUpload::~PutUpload() {
+    // PUT interrompu : la cible reste intacte
+    discard();
+    if (_stored)
+        ContentStore::unpin(_uploadDir, _digest.expectedValue(ContentDigest::SHA256));
+}
+
+PutUpload* PutUpload::create(const HTTPRequest& request, HTTPResponse& response, const Location& location, const std::string& uploadDir) {
+    std::string base = location.path;
+    if (!base.empty() && base[base.size() - 1] == '/')
+        base.erase(base.size() - 1);
+    std::string relative = request.getPath().substr(base.size());
+    if (relative.empty() || relative[relative.size() - 1] == '/') {
+        response.beError(409, "Conflict: PUT target must be a file.");
+        return NULL;
+    }
+    if (relative[0] != '/')
+        relative = "/" + relative;
+    if (!hasSafeSegments(relative)) {
+        Logger::instance().log(ERROR, "Attempt to upload outside of allowed path.");
+        response.beError(403, "Attempt to upload outside of allowed path.");
+        return NULL;
+    }
+
+    std::string destPath = uploadDir + relative;
+    std::string directory = destPath.substr(0, destPath.find_last_of('/'));
+    struct stat st;
+    if (stat(directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        response.beError(409, "Conflict: Parent directory does not exist.");
+        return NULL;
+    }
+    if (!isPathAllowed(destPath, uploadDir)) {
+        Logger::instance().log(ERROR, "Attempt to upload outside of allowed path.");
+        response.beError(403, "Attempt to upload outside of allowed path.");
+        return NULL;
+    }
+    bool replacing = stat(destPath.c_str(), &st) == 0;
+    if (replacing && S_ISDIR(st.st_mode)) {
+        response.beError(409, "Conflict: PUT target is a directory.");
+        return NULL;
+    }
+    if (replacing && !(st.st_mode & S_IWUSR)) {
+        Logger::instance().log(ERROR, "Forbidden destination error: destination file is write-protected.");
+        response.beError(403, "Forbidden: Write-protected destination.");
+        return NULL;
+    }
+
+    return new PutUpload(request.getPath(), destPath, uploadDir, replacing, request.getContentLength(), location);
+}
+
+// Ni "." ni ".." parmi les segments : la cible reste sous le répertoire d'upload
+bool PutUpload::hasSafeSegments(const std::string& relative) {
+    size_t start = 0;
+    while (start <= relative.size()) {
+        size_t end = relative.find('/', start);
+        if (end == std::string::npos)
+            end = relative.size();
+        std::string segment = relative.substr(start, end - start);
+        if (segment == "." || segment == "..")
+            return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+bool PutUpload::prepare() {
+    std::string announced = _digest.expectedValue(ContentDigest::SHA256);
+    if (_dedup && !announced.empty() && ContentStore::contains(_uploadDir, announced)) {
+        Logger::instance().log(INFO, "PUT content already stored, body will only be verified: " + _destPath);
+        _stored = true;
+        ContentStore::pin(_uploadDir, announced);
+        return true;
+    }
+    // Le temporaire est créé à côté de la cible : le renommage reste atomique
+    if (!_spool.open(_destPath.substr(0, _destPath.find_last_of('/')), _remaining))
+        return rejectWriteError(_spool.getError());
+    return true;
+}
+
+bool PutUpload::consume(const char* data, size_t size) {
+    if (_stored)
+        return true;
+    if (!_spool.write(data, size))
+        return rejectWriteError(_spool.getError());
+    return true;
+}
+
+void PutUpload::discard() {
+    _spool.discard();
+}
+
+void PutUpload::finish(HTTPResponse& response) {
+    // Empreinte vérifiée avant le renommage : la cible reste intacte en cas d'écart
+    if (!_errorStatus && verifyDigest(400)) {
+        bool committed;
+        if (_stored)
+            committed = ContentStore::link(_uploadDir, _digest.value(ContentDigest::SHA256), _destPath, _fsyncPolicy);
+        else if (_dedup)
+            committed = ContentStore::commit(_spool, _uploadDir, _digest.value(ContentDigest::SHA256), _destPath, _fsyncPolicy);
+        else if (!(committed = _spool.commit(_destPath, _fsyncPolicy)))
+            errno = _spool.getError();
+        if (!committed)
+            rejectWriteError(errno);
+    }
+    if (_errorStatus) {
+        response.beError(_errorStatus, _errorMessage);
+        return;
+    }
+    if (_replacing) {
+        response.setStatusCode(204);
+    } else {
+        response.setStatusCode(201);
+        response.setHeader("Location", _uri);
+    }
+    // Le corps est la nouvelle représentation : ses empreintes sont les siennes
+    std::string digest = _digest.header();
+    if (!digest.empty())
+        response.setHeader("Repr-Digest", digest);
+    Logger::instance().log(INFO, "PUT saved at: " + _destPath + (digest.empty() ? "" : " (" + digest + ")"));
+}
@@ -0,0 +1,52 @@
+// PutUpload.hpp
+#ifndef PUTUPLOAD_HPP
+#define PUTUPLOAD_HPP
+
+#include <string>
+#include "Location.hpp"
+#include "SpoolFile.hpp"
+#include "UploadStream.hpp"
+
+class HTTPRequest;
+
+/*
+ * PUT vers une location upload_on : le corps est le fichier lui-même, écrit
+ * sans aucun parsing dans un SpoolFile puis renommé sur la cible
+ * (<upload_path>/<chemin sous la location>). 201 si la cible est créée, 204
+ * si elle est remplacée.
+ * Avec upload_dedup on, la cible devient un lien vers le ContentStore ; si
+ * le client annonce le SHA-256 d'un contenu déjà rangé, le corps est
+ * seulement vérifié, sans être écrit.
+ */
+class PutUpload : public UploadStream {
+public:
+    // Cible validée ; sinon NULL et la réponse d'erreur est remplie
+    static PutUpload* create(const HTTPRequest& request, HTTPResponse& response, const Location& location, const std::string& uploadDir);
+
+    ~PutUpload();
+    // Fichier temporaire ouvert, sauf si le contenu annoncé est déjà rangé
+    bool prepare();
+    void finish(HTTPResponse& response);
+
+protected:
+    bool consume(const char* data, size_t size);
+    void discard();
+
+private:
+    std::string _uri;
+    std::string _destPath;
+    std::string _uploadDir;
+    bool _replacing;
+    UploadFsync _fsyncPolicy;
+    bool _dedup;
+    // Contenu déjà dans le ContentStore : rien à écrire
+    bool _stored;
+    SpoolFile _spool;
+
+    PutUpload(const std::string& uri, const std::string& destPath, const std::string& uploadDir, bool replacing,
+              size_t contentLength, const Location& location);
+
+    static bool hasSafeSegments(const std::string& relative);
+};
+
+#endif
@@ -0,0 +1,550 @@
+// ResponseCache.cpp
+#include <poll.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sstream>
+#include <algorithm>
+#include "ResponseCache.hpp"
+#include "CGIHandler.hpp"
+#include "HTTPRequest.hpp"
+#include "HTTPResponse.hpp"
+#include "Location.hpp"
+#include "Metrics.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+// Une entrée ne peut occuper plus de cette fraction du cache
+static const size_t MAX_ENTRY_SHARE = 4;
+// Sortie d'un rafraîchissement fermée, process pas encore récupéré
+static const long REAP_POLL_MS = 5;
+
+static std::string lowercase(const std::string& value) {
+    std::string result = value;
+    for (size_t i = 0; i < result.size(); ++i)
+        result[i] = tolower(static_cast<unsigned char>(result[i]));
+    return result;
+}
+
+static std::string trimmed(const std::string& value) {
+    size_t first = value.find_first_not_of(" \t");
+    if (first == std::string::npos)
+        return "";
+    return value.substr(first, value.find_last_not_of(" \t") - first + 1);
+}
+
+// Éléments d'une liste d'en-tête ("no-cache, max-age=10"), en minuscules
+static std::vector<std::string> splitList(const std::string& value) {
+    std::vector<std::string> items;
+    std::istringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        item = lowercase(trimmed(item));
+        if (!item.empty())
+            items.push_back(item);
+    }
+    return items;
+}
+
+// Codes cacheables sans indication explicite (RFC 9110, 15.1)
+static bool isCacheableStatus(int status) {
+    return status == 200 || status == 203 || status == 204 || status == 300
+        || status == 301 || status == 308 || status == 404 || status == 410;
+}
+
+ResponseCache::Capture::Capture(const Ticket& ticket)
+    : ticket(ticket), status(200), headersSeen(false), overflow(false) {}
+
+void ResponseCache::Capture::captureHeaders(const HTTPResponse& response) {
+    status = response.getStatusCode();
+    reason = response.getReasonPhrase();
+    headers = response.getHeaders();
+    headersSeen = true;
+}
+
+// Au-delà de la taille max d'une entrée, on renonce à la copie
+void ResponseCache::Capture::captureBody(const char* data, size_t size) {
+    if (overflow)
+        return;
+    if (body.size() + size > ResponseCache::instance().getMaxEntrySize()) {
+        overflow = true;
+        std::string().swap(body);
+        return;
+    }
+    body.append(data, size);
+}
+
+ResponseCache& ResponseCache::instance() {
+    static ResponseCache instance;
+    return instance;
+}
+
+ResponseCache::ResponseCache() : _size(0), _maxSize(DEFAULT_MAX_SIZE) {}
+
+ResponseCache::~ResponseCache() {
+    for (size_t i = 0; i < _refreshes.size(); ++i) {
+        _refreshes[i].handler->terminateCGI();
+        delete _refreshes[i].handler;
+    }
+}
+
+void ResponseCache::setMaxSize(size_t maxSize) {
+    _maxSize = maxSize;
+    evict();
+    publish();
+}
+
+size_t ResponseCache::getMaxEntrySize() const {
+    return _maxSize / MAX_ENTRY_SHARE;
+}
+
+bool ResponseCache::isCacheable(const HTTPRequest& request, const Location* location) {
+    if (!location || !location->cgiCache)
+        return false;
+    if (request.getMethod() != "GET" && request.getMethod() != "HEAD")
+        return false;
+    return !request.hasHeader("Authorization") && request.getContentLength() == 0;
+}
+
+ResponseCache::Ticket ResponseCache::makeTicket(const HTTPRequest& request, const Location& location) {
+    Ticket ticket;
+    ticket.method = request.getMethod();
+    ticket.base = "GET " + request.getHost() + request.getPath();
+    if (!request.getQueryString().empty())
+        ticket.base += "?" + request.getQueryString();
+    ticket.requestHeaders = request.getHeaders();
+    ticket.validity = location.cgiCacheValid;
+    ticket.stale = location.cgiCacheStale;
+    ticket.lockTimeout = location.cgiCacheLockTimeout;
+    return ticket;
+}
+
+// Les noms d'en-têtes ne sont pas sensibles à la casse
+std::string ResponseCache::headerValue(const std::map<std::string, std::string>& headers, const std::string& name) {
+    for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+        if (lowercase(it->first) == name)
+            return it->second;
+    }
+    return "";
+}
+
+static std::string variantKey(const std::string& base, const std::vector<std::string>& vary, const std::map<std::string, std::string>& requestHeaders) {
+    std::string key = base;
+    for (size_t i = 0; i < vary.size(); ++i) {
+        std::string value;
+        for (std::map<std::string, std::string>::const_iterator it = requestHeaders.begin(); it != requestHeaders.end(); ++it) {
+            if (lowercase(it->first) == vary[i]) {
+                value = it->second;
+                break;
+            }
+        }
+        key += "\n" + vary[i] + ": " + value;
+    }
+    return key;
+}
+
+std::string ResponseCache::keyFor(const Ticket& ticket) const {
+    std::map<std::string, VaryIndex>::const_iterator vary = _vary.find(ticket.base);
+    if (vary == _vary.end())
+        return ticket.base;
+    return variantKey(ticket.base, vary->second.headers, ticket.requestHeaders);
+}
+
+std::map<std::string, ResponseCache::Entry>::iterator ResponseCache::find(const Ticket& ticket) {
+    return _entries.find(keyFor(ticket));
+}
+
+void ResponseCache::remove(std::map<std::string, Entry>::iterator it) {
+    _size -= it->second.size;
+    _lru.erase(it->second.lru);
+    std::map<std::string, VaryIndex>::iterator vary = _vary.find(it->second.base);
+    if (vary != _vary.end() && --vary->second.entries == 0)
+        _vary.erase(vary);
+    _entries.erase(it);
+}
+
+void ResponseCache::evict() {
+    while (_size > _maxSize && !_lru.empty()) {
+        remove(_entries.find(_lru.back()));
+        Metrics::instance().increment("cgi_cache_evictions_total");
+    }
+}
+
+void ResponseCache::publish() const {
+    Metrics::instance().setGauge("cgi_cache_bytes", _size);
+    Metrics::instance().setGauge("cgi_cache_entries", _entries.size());
+}
+
+bool ResponseCache::canServe(const Ticket& ticket, unsigned long now) {
+    std::map<std::string, Entry>::iterator it = find(ticket);
+    return it != _entries.end() && now < it->second.staleUntil;
+}
+
+ResponseCache::Status ResponseCache::lookup(const Ticket& ticket, HTTPResponse& response, SharedBuffer& body, unsigned long now, bool& needsRefresh) {
+    needsRefresh = false;
+    std::map<std::string, Entry>::iterator it = find(ticket);
+    if (it == _entries.end() || now >= it->second.staleUntil) {
+        if (it != _entries.end()) {
+            remove(it);
+            publish();
+        }
+        Metrics::instance().increment(Metrics::labeled("cgi_cache_requests_total", "status", "miss"));
+        return MISS;
+    }
+
+    Entry& entry = it->second;
+    _lru.splice(_lru.begin(), _lru, entry.lru);
+    Status status = now < entry.expiresAt ? HIT : STALE;
+    // Le rafraîchissement rejoue la requête : seul un GET peut le lancer
+    if (status == STALE && !entry.refreshing && ticket.method == "GET") {
+        entry.refreshing = true;
+        needsRefresh = true;
+    }
+
+    response.setStatusCode(entry.status);
+    response.setReasonPhrase(entry.reason);
+    for (std::map<std::string, std::string>::const_iterator header = entry.headers.begin(); header != entry.headers.end(); ++header)
+        response.setHeader(header->first, header->second);
+    body = entry.body;
+    if (!response.isBodyless())
+        response.setHeader("Content-Length", to_string(entry.body.size()));
+    response.setHeader("Age", to_string((now - entry.storedAt) / 1000));
+    response.setHeader("X-Cache-Status", status == HIT ? "HIT" : "STALE");
+    Metrics::instance().increment(Metrics::labeled("cgi_cache_requests_total", "status", status == HIT ? "hit" : "stale"));
+    return status;
+}
+
+// Durée de vie (ms) et fenêtre stale-while-revalidate d'une réponse du script.
+// cgi_cache_valid remplace s-maxage / max-age / Expires, mais no-store,
+// no-cache, private, Set-Cookie et Vary: * excluent toujours la réponse.
+bool ResponseCache::freshness(const Capture& capture, unsigned long& ttl, unsigned long& stale) {
+    if (!isCacheableStatus(capture.status))
+        return false;
+    if (!headerValue(capture.headers, "set-cookie").empty())
+        return false;
+    std::vector<std::string> vary = splitList(headerValue(capture.headers, "vary"));
+    for (size_t i = 0; i < vary.size(); ++i) {
+        if (vary[i] == "*")
+            return false;
+    }
+
+    long maxAge = -1;
+    long sharedMaxAge = -1;
+    long staleWhileRevalidate = 0;
+    std::vector<std::string> directives = splitList(headerValue(capture.headers, "cache-control"));
+    for (size_t i = 0; i < directives.size(); ++i) {
+        const std::string& directive = directives[i];
+        if (directive == "no-store" || directive == "no-cache" || directive == "private")
+            return false;
+        size_t equal = directive.find('=');
+        if (equal == std::string::npos)
+            continue;
+        std::string name = trimmed(directive.substr(0, equal));
+        long value = atol(trimmed(directive.substr(equal + 1)).c_str());
+        if (name == "max-age")
+            maxAge = value;
+        else if (name == "s-maxage")
+            sharedMaxAge = value;
+        else if (name == "stale-while-revalidate")
+            staleWhileRevalidate = value;
+    }
+
+    ttl = 0;
+    if (sharedMaxAge >= 0)
+        ttl = sharedMaxAge * 1000UL;
+    else if (maxAge >= 0)
+        ttl = maxAge * 1000UL;
+    else {
+        std::string expires = headerValue(capture.headers, "expires");
+        struct tm date;
+        memset(&date, 0, sizeof(date));
+        if (!expires.empty() && strptime(expires.c_str(), "%a, %d %b %Y %H:%M:%S", &date)) {
+            time_t expiry = timegm(&date);
+            time_t now = time(NULL);
+            if (expiry > now)
+                ttl = (expiry - now) * 1000UL;
+        }
+    }
+    if (capture.ticket.validity)
+        ttl = capture.ticket.validity;
+    stale = std::max(capture.ticket.stale, staleWhileRevalidate > 0 ? staleWhileRevalidate * 1000UL : 0UL);
+    return ttl > 0;
+}
+
+bool ResponseCache::store(const Capture& capture, unsigned long now) {
+    const Ticket& ticket = capture.ticket;
+    if (ticket.method != "GET" || !capture.headersSeen || capture.overflow)
+        return false;
+    unsigned long ttl;
+    unsigned long stale;
+    if (!freshness(capture, ttl, stale))
+        return false;
+
+    size_t size = ticket.base.size() + capture.body.size() + capture.reason.size();
+    for (std::map<std::string, std::string>::const_iterator it = capture.headers.begin(); it != capture.headers.end(); ++it)
+        size += it->first.size() + it->second.size() + 4;
+    if (size > getMaxEntrySize())
+        return false;
+
+    std::vector<std::string> vary = splitList(headerValue(capture.headers, "vary"));
+    std::string key = variantKey(ticket.base, vary, ticket.requestHeaders);
+    std::map<std::string, Entry>::iterator previous = _entries.find(key);
+    if (previous != _entries.end())
+        remove(previous);
+
+    VaryIndex& index = _vary[ticket.base];
+    index.headers = vary;
+    ++index.entries;
+
+    _lru.push_front(key);
+    Entry& entry = _entries[key];
+    entry.base = ticket.base;
+    entry.status = capture.status;
+    entry.reason = capture.reason;
+    entry.headers = capture.headers;
+    entry.body = SharedBuffer(capture.body);
+    entry.storedAt = now;
+    entry.expiresAt = now + ttl;
+    entry.staleUntil = entry.expiresAt + stale;
+    entry.size = size;
+    entry.refreshing = false;
+    entry.lru = _lru.begin();
+    _size += size;
+
+    evict();
+    publish();
+    Metrics::instance().increment("cgi_cache_stores_total");
+    Logger::instance().log(DEBUG, "Cached response for " + ticket.base + " (" + to_string(ttl) + "ms)");
+    return true;
+}
+
+ResponseCache::Flight ResponseCache::joinFlight(const Ticket& ticket, const void* client, unsigned long now) {
+    std::string key = keyFor(ticket);
+    std::map<std::string, InFlight>::iterator it = _flights.find(key);
+    if (it == _flights.end()) {
+        _flights[key].leader = client;
+        _leaders[client] = key;
+        return LEAD;
+    }
+
+    InFlight& flight = it->second;
+    if (!flight.landed && flight.leader == client)
+        return LEAD;
+    std::map<const void*, unsigned long>::iterator waiter = flight.waiters.find(client);
+    if (waiter == flight.waiters.end() && !flight.landed) {
+        flight.waiters[client] = now + ticket.lockTimeout;
+        _waiting[client] = key;
+        Metrics::instance().increment("cgi_cache_coalesced_total");
+        return WAIT;
+    }
+    if (!flight.landed && now < waiter->second)
+        return WAIT;
+
+    // Meneur fini sans réponse servable, ou attente trop longue
+    if (!flight.landed)
+        Metrics::instance().increment("cgi_cache_lock_timeouts_total");
+    if (waiter != flight.waiters.end()) {
+        flight.waiters.erase(waiter);
+        _waiting.erase(client);
+    }
+    if (flight.landed && flight.waiters.empty())
+        _flights.erase(it);
+    return BYPASS;
+}
+
+void ResponseCache::releaseFlight(const void* client) {
+    std::map<const void*, std::string>::iterator lead = _leaders.find(client);
+    if (lead != _leaders.end()) {
+        std::map<std::string, InFlight>::iterator it = _flights.find(lead->second);
+        if (it != _flights.end()) {
+            it->second.landed = true;
+            if (it->second.waiters.empty())
+                _flights.erase(it);
+        }
+        _leaders.erase(lead);
+    }
+
+    std::map<const void*, std::string>::iterator wait = _waiting.find(client);
+    if (wait != _waiting.end()) {
+        std::map<std::string, InFlight>::iterator it = _flights.find(wait->second);
+        if (it != _flights.end()) {
+            it->second.waiters.erase(client);
+            if (it->second.landed && it->second.waiters.empty())
+                _flights.erase(it);
+        }
+        _waiting.erase(wait);
+    }
+}
+
+bool ResponseCache::isFlightSettled(const void* client, unsigned long now) const {
+    std::map<const void*, std::string>::const_iterator wait = _waiting.find(client);
+    if (wait == _waiting.end())
+        return true;
+    std::map<std::string, InFlight>::const_iterator it = _flights.find(wait->second);
+    if (it == _flights.end() || it->second.landed)
+        return true;
+    std::map<const void*, unsigned long>::const_iterator waiter = it->second.waiters.find(client);
+    return waiter == it->second.waiters.end() || now >= waiter->second;
+}
+
+long ResponseCache::flightPollTimeout(unsigned long now) const {
+    long timeout = -1;
+    for (std::map<std::string, InFlight>::const_iterator it = _flights.begin(); it != _flights.end(); ++it) {
+        const InFlight& flight = it->second;
+        for (std::map<const void*, unsigned long>::const_iterator waiter = flight.waiters.begin(); waiter != flight.waiters.end(); ++waiter) {
+            long remaining = (flight.landed || now >= waiter->second) ? 0 : static_cast<long>(waiter->second - now);
+            if (timeout < 0 || remaining < timeout)
+                timeout = remaining;
+        }
+    }
+    return timeout;
+}
+
+void ResponseCache::startRefresh(const Ticket& ticket, CGIHandler* handler) {
+    Refresh refresh;
+    refresh.ticket = ticket;
+    refresh.key = keyFor(ticket);
+    refresh.handler = handler;
+    _refreshes.push_back(refresh);
+    Logger::instance().log(DEBUG, "Background refresh started for " + ticket.base);
+}
+
+// Le CGI de rafraîchissement n'a pas pu démarrer : une prochaine requête
+// retentera
+void ResponseCache::abortRefresh(const Ticket& ticket) {
+    std::map<std::string, Entry>::iterator it = find(ticket);
+    if (it != _entries.end())
+        it->second.refreshing = false;
+    Metrics::instance().increment(Metrics::labeled("cgi_cache_refreshes_total", "result", "failed"));
+}
+
+void ResponseCache::postponeRefresh(const Ticket& ticket) {
+    std::map<std::string, Entry>::iterator it = find(ticket);
+    if (it != _entries.end())
+        it->second.refreshing = false;
+    Metrics::instance().increment(Metrics::labeled("cgi_cache_refreshes_total", "result", "postponed"));
+}
+
+void ResponseCache::pollEvents(std::map<int, short>& events) const {
+    for (size_t i = 0; i < _refreshes.size(); ++i) {
+        CGIHandler* handler = _refreshes[i].handler;
+        if (handler->getInputPipeFd() != -1 && handler->hasPendingInput())
+            events[handler->getInputPipeFd()] |= POLLOUT;
+        if (handler->getOutputPipeFd() != -1)
+            events[handler->getOutputPipeFd()] |= POLLIN;
+        if (handler->getErrorPipeFd() != -1)
+            events[handler->getErrorPipeFd()] |= POLLIN;
+    }
+}
+
+bool ResponseCache::isRefreshFd(int fd) const {
+    for (size_t i = 0; i < _refreshes.size(); ++i) {
+        CGIHandler* handler = _refreshes[i].handler;
+        if (handler->getInputPipeFd() == fd || handler->getOutputPipeFd() == fd || handler->getErrorPipeFd() == fd)
+            return true;
+    }
+    return false;
+}
+
+bool ResponseCache::handleRefreshEvent(int fd, short revents) {
+    for (size_t i = 0; i < _refreshes.size(); ++i) {
+        CGIHandler* handler = _refreshes[i].handler;
+        if (handler->getInputPipeFd() == fd) {
+            if (revents & (POLLERR | POLLHUP))
+                handler->closeInputPipe();
+            else
+                handler->writeToCGI();
+            return handler->getInputPipeFd() != fd;
+        }
+        if (handler->getOutputPipeFd() == fd) {
+            // Pas de client à attendre : on vide ce que le pipe contient
+            for (int reads = 0; reads < 16 && handler->getOutputPipeFd() == fd; ++reads) {
+                if (handler->readFromCGI() <= 0)
+                    break;
+            }
+            return handler->getOutputPipeFd() != fd;
+        }
+        if (handler->getErrorPipeFd() == fd)
+            return handler->readErrors() == 0;
+    }
+    return false;
+}
+
+void ResponseCache::reapRefreshes() {
+    for (size_t i = 0; i < _refreshes.size(); ) {
+        CGIHandler* handler = _refreshes[i].handler;
+        if (handler->checkLimits() != CGIHandler::WITHIN_LIMITS
+            || handler->getCGIOutputBuffer().size() > getMaxEntrySize()) {
+            Logger::instance().log(WARNING, "Background refresh killed for " + _refreshes[i].ticket.base);
+            handler->terminateCGI();
+            finishRefresh(i, false);
+            continue;
+        }
+        if (!handler->isOutputClosed()) {
+            ++i;
+            continue;
+        }
+        int status = handler->isCgiDone();
+        if (!handler->hasExited()) {
+            if (!handler->hasTimedOut()) {
+                ++i;
+                continue;
+            }
+            handler->terminateCGI();
+            status = handler->isCgiDone();
+        }
+        finishRefresh(i, status == 0);
+    }
+}
+
+// Réponse rangée si cacheable ; un script qui ne l'autorise plus retire
+// l'entrée, un échec la laisse servie périmée jusqu'au prochain essai
+void ResponseCache::finishRefresh(size_t index, bool succeeded) {
+    Refresh refresh = _refreshes[index];
+    _refreshes.erase(_refreshes.begin() + index);
+
+    bool stored = false;
+    if (succeeded) {
+        std::string& output = refresh.handler->getCGIOutputBuffer();
+        size_t headerEnd = output.find("\r\n\r\n");
+        size_t separatorLength = 4;
+        size_t lfHeaderEnd = output.find("\n\n");
+        if (lfHeaderEnd != std::string::npos && (headerEnd == std::string::npos || lfHeaderEnd < headerEnd)) {
+            headerEnd = lfHeaderEnd;
+            separatorLength = 2;
+        }
+        Capture capture(refresh.ticket);
+        HTTPResponse head;
+        if (headerEnd != std::string::npos) {
+            head.parseHeaders(output.substr(0, headerEnd));
+            output.erase(0, headerEnd + separatorLength);
+        }
+        capture.captureHeaders(head);
+        capture.captureBody(output.data(), output.size());
+        stored = store(capture, curr_time_ms());
+    }
+
+    std::map<std::string, Entry>::iterator it = _entries.find(refresh.key);
+    if (!stored && it != _entries.end()) {
+        if (succeeded) {
+            remove(it);
+            publish();
+        } else {
+            it->second.refreshing = false;
+        }
+    }
+    Metrics::instance().increment(Metrics::labeled("cgi_cache_refreshes_total", "result", succeeded ? "ok" : "failed"));
+    // Rend aussi son slot cgi_max_concurrent
+    delete refresh.handler;
+}
+
+long ResponseCache::refreshPollTimeout() const {
+    long timeout = -1;
+    for (size_t i = 0; i < _refreshes.size(); ++i) {
+        CGIHandler* handler = _refreshes[i].handler;
+        long remaining = handler->isOutputClosed() ? REAP_POLL_MS : static_cast<long>(handler->timeUntilLimit());
+        if (timeout < 0 || remaining < timeout)
+            timeout = remaining;
+    }
+    return timeout;
+}
@@ -0,0 +1,175 @@
+// ResponseCache.hpp
+#ifndef RESPONSECACHE_HPP
+#define RESPONSECACHE_HPP
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include "SharedBuffer.hpp"
+
+class HTTPRequest;
+class HTTPResponse;
+class CGIHandler;
+struct Location;
+
+/*
+ * Micro-cache des réponses CGI (cgi_cache on). Clé : méthode, hôte, chemin,
+ * query string, puis valeurs des en-têtes de requête listés par le Vary de
+ * la réponse ; HEAD est servi depuis les entrées de GET.
+ * La fraîcheur vient du Cache-Control du script (s-maxage, max-age) ou de
+ * son Expires, sauf si la location impose cgi_cache_valid. Au-delà de
+ * cgi_cache_max_size, les entrées les moins récemment servies sont évincées.
+ * Une entrée périmée reste servie pendant cgi_cache_stale (ou le
+ * stale-while-revalidate du script), le temps qu'un unique CGI lancé en
+ * arrière-plan la remplace.
+ * Tant qu'un CGI est en vol pour une clé, les requêtes identiques attendent
+ * sa réponse (au plus cgi_cache_lock_timeout) au lieu de lancer le leur ;
+ * toutes envoient ensuite le même corps, partagé et non recopié.
+ */
+class ResponseCache {
+public:
+    enum Status { MISS, HIT, STALE };
+    // LEAD : la requête lance le CGI ; WAIT : un CGI identique est en vol ;
+    // BYPASS : attente finie sans réponse en cache, la requête lance le sien
+    enum Flight { LEAD, WAIT, BYPASS };
+
+    // Ce qu'il faut garder de la requête pour ranger sa réponse : la requête
+    // est détruite bien avant la fin du CGI
+    struct Ticket {
+        std::string method;
+        std::string base;
+        std::map<std::string, std::string> requestHeaders;
+        unsigned long validity;
+        unsigned long stale;
+        unsigned long lockTimeout;
+        Ticket() : validity(0), stale(0), lockTimeout(0) {}
+    };
+
+    // Réponse d'un CGI recopiée au fil du relais vers le client
+    struct Capture {
+        Ticket ticket;
+        int status;
+        std::string reason;
+        std::map<std::string, std::string> headers;
+        std::string body;
+        bool headersSeen;
+        bool overflow;
+
+        explicit Capture(const Ticket& ticket);
+        void captureHeaders(const HTTPResponse& response);
+        void captureBody(const char* data, size_t size);
+    };
+
+    static ResponseCache& instance();
+
+    // Taille totale du cache, en-têtes compris (défaut : DEFAULT_MAX_SIZE)
+    void setMaxSize(size_t maxSize);
+    size_t getMaxEntrySize() const;
+
+    // GET ou HEAD sans corps ni Authorization, vers une location cgi_cache on
+    static bool isCacheable(const HTTPRequest& request, const Location* location);
+    static Ticket makeTicket(const HTTPRequest& request, const Location& location);
+
+    // Une entrée (fraîche ou servable périmée) répond à cette requête
+    bool canServe(const Ticket& ticket, unsigned long now);
+    // Remplit les en-têtes de `response` et donne le corps partagé de
+    // l'entrée. Sur STALE, needsRefresh indique que l'appelant doit lancer le
+    // rafraîchissement (un seul à la fois par entrée)
+    Status lookup(const Ticket& ticket, HTTPResponse& response, SharedBuffer& body, unsigned long now, bool& needsRefresh);
+    // Réponse complète et réussie du script : rangée si elle est cacheable
+    bool store(const Capture& capture, unsigned long now);
+
+    // Coalescence : `client` identifie la requête d'un appel à l'autre
+    Flight joinFlight(const Ticket& ticket, const void* client, unsigned long now);
+    // Le meneur a fini (réponse rangée ou non), ou le client est parti
+    void releaseFlight(const void* client);
+    // Vrai si une requête en attente doit être réexaminée (vol terminé ou
+    // délai écoulé)
+    bool isFlightSettled(const void* client, unsigned long now) const;
+    // Délai max de poll() pour réveiller les attentes, -1 s'il n'y en a pas
+    long flightPollTimeout(unsigned long now) const;
+
+    // Rafraîchissements en arrière-plan : CGI déjà lancé, sans client
+    void startRefresh(const Ticket& ticket, CGIHandler* handler);
+    void abortRefresh(const Ticket& ticket);
+    // Pas de slot cgi_max_concurrent libre : une prochaine requête retentera
+    void postponeRefresh(const Ticket& ticket);
+    // Boucle principale : fds à surveiller (fd -> événements poll)
+    void pollEvents(std::map<int, short>& events) const;
+    bool isRefreshFd(int fd) const;
+    // Retourne true si le fd a été fermé et doit quitter poll_fds
+    bool handleRefreshEvent(int fd, short revents);
+    // Range les rafraîchissements terminés, tue ceux qui dépassent leurs limites
+    void reapRefreshes();
+    // Délai max de poll() pour suivre les rafraîchissements, -1 s'il n'y en a pas
+    long refreshPollTimeout() const;
+
+    static const size_t DEFAULT_MAX_SIZE = 16777216;
+
+private:
+    ResponseCache();
+    ~ResponseCache();
+    ResponseCache(const ResponseCache&);
+    ResponseCache& operator=(const ResponseCache&);
+
+    struct Entry {
+        std::string base;
+        int status;
+        std::string reason;
+        std::map<std::string, std::string> headers;
+        SharedBuffer body;
+        unsigned long storedAt;
+        unsigned long expiresAt;
+        unsigned long staleUntil;
+        size_t size;
+        bool refreshing;
+        std::list<std::string>::iterator lru;
+    };
+
+    // En-têtes du dernier Vary vu pour une clé de base, et nombre d'entrées
+    // qui en dépendent
+    struct VaryIndex {
+        std::vector<std::string> headers;
+        size_t entries;
+        VaryIndex() : entries(0) {}
+    };
+
+    struct Refresh {
+        Ticket ticket;
+        std::string key;
+        CGIHandler* handler;
+    };
+
+    // Requêtes attendant la réponse du meneur, avec leur échéance
+    struct InFlight {
+        const void* leader;
+        bool landed;
+        std::map<const void*, unsigned long> waiters;
+        InFlight() : leader(NULL), landed(false) {}
+    };
+
+    std::map<std::string, Entry> _entries;
+    std::map<std::string, VaryIndex> _vary;
+    // Clés, de la plus récemment servie à la plus ancienne
+    std::list<std::string> _lru;
+    size_t _size;
+    size_t _maxSize;
+    std::vector<Refresh> _refreshes;
+    std::map<std::string, InFlight> _flights;
+    // Clé du vol mené ou attendu par chaque client
+    std::map<const void*, std::string> _leaders;
+    std::map<const void*, std::string> _waiting;
+
+    std::string keyFor(const Ticket& ticket) const;
+    std::map<std::string, Entry>::iterator find(const Ticket& ticket);
+    void remove(std::map<std::string, Entry>::iterator it);
+    void evict();
+    void publish() const;
+    void finishRefresh(size_t index, bool succeeded);
+
+    static std::string headerValue(const std::map<std::string, std::string>& headers, const std::string& name);
+    static bool freshness(const Capture& capture, unsigned long& ttl, unsigned long& stale);
+};
+
+#endif
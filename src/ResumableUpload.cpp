@@ -0,0 +1,432 @@
+// ResumableUpload.cpp
+#include "ResumableUpload.hpp"
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include <sys/stat.h>
+#include "HTTPRequest.hpp"
+#include "HTTPResponse.hpp"
+#include "Logger.hpp"
+#include "Metrics.hpp"
+#include "Utils.hpp"
+
+const char* const ResumableUpload::VERSION = "1.0.0";
+std::set<std::string> ResumableUpload::_active;
+
+ResumableUpload::ResumableUpload(const std::string& id, const std::string& uploadDir, const std::string& filename, size_t length,
+                                 size_t offset, int fd, size_t contentLength, UploadFsync fsyncPolicy)
+    : UploadStream(contentLength), _id(id), _uploadDir(uploadDir), _filename(filename), _length(length),
+      _offset(offset), _startOffset(offset), _fd(fd), _fsyncPolicy(fsyncPolicy), _expire(0) {
+    _active.insert(_id);
+}
+
+ResumableUpload::~ResumableUpload() {
+    // PATCH interrompu : les octets écrits restent, l'offset les compte,
+    // sauf si le morceau devait être vérifié
+    if (_remaining > 0)
+        discard();
+    if (_fd != -1)
+        close(_fd);
+    _active.erase(_id);
+}
+
+bool ResumableUpload::isResumableRequest(const HTTPRequest& request, const Location& location) {
+    if (!location.uploadResumable)
+        return false;
+    std::string method = request.getMethod();
+    if (method == "OPTIONS")
+        return true;
+    if (method == "POST")
+        return request.hasHeader("Upload-Length");
+    return (method == "HEAD" || method == "PATCH" || method == "DELETE") && !idFromPath(request, location).empty();
+}
+
+ResumableUpload* ResumableUpload::handle(const HTTPRequest& request, HTTPResponse& response, const Location& location, const std::string& uploadDir) {
+    response.setHeader("Tus-Resumable", VERSION);
+    std::string method = request.getMethod();
+    if (method == "OPTIONS") {
+        options(response, location);
+        return NULL;
+    }
+    if (request.hasHeader("Tus-Resumable") && request.getStrHeader("Tus-Resumable") != VERSION) {
+        response.beError(412, "Unsupported tus protocol version.");
+        response.setHeader("Tus-Version", VERSION);
+        return NULL;
+    }
+    if (method == "POST") {
+        create(request, response, location, uploadDir);
+        return NULL;
+    }
+
+    std::string id = idFromPath(request, location);
+    size_t length;
+    std::string filename;
+    struct stat partStat;
+    if (!readInfo(statePath(uploadDir, id, ".info"), length, filename) || stat(statePath(uploadDir, id, ".part").c_str(), &partStat) != 0) {
+        response.beError(404, "Unknown upload.");
+        return NULL;
+    }
+    if (isExpired(partStat, location) && !_active.count(id)) {
+        unlink(statePath(uploadDir, id, ".part").c_str());
+        unlink(statePath(uploadDir, id, ".info").c_str());
+        Logger::instance().log(INFO, "Resumable upload " + id + " expired");
+        response.beError(410, "Upload expired.");
+        return NULL;
+    }
+    if (method == "PATCH")
+        return append(request, response, location, uploadDir, id);
+    if (method == "DELETE") {
+        if (_active.count(id)) {
+            response.beError(409, "Conflict: Upload in progress.");
+            return NULL;
+        }
+        unlink(statePath(uploadDir, id, ".part").c_str());
+        unlink(statePath(uploadDir, id, ".info").c_str());
+        Logger::instance().log(INFO, "Resumable upload " + id + " terminated");
+        response.setStatusCode(204);
+        return NULL;
+    }
+    // HEAD : progression
+    response.setStatusCode(200);
+    response.setHeader("Upload-Offset", to_string(partStat.st_size));
+    response.setHeader("Upload-Length", to_string(length));
+    response.setHeader("Cache-Control", "no-store");
+    setExpires(response, partStat.st_mtime, location);
+    return NULL;
+}
+
+void ResumableUpload::create(const HTTPRequest& request, HTTPResponse& response, const Location& location, const std::string& uploadDir) {
+    size_t length;
+    if (!parseOffset(request.getStrHeader("Upload-Length"), length)) {
+        response.beError(400, "Bad Request: Invalid Upload-Length.");
+        return;
+    }
+    if (location.uploadResumableMaxSize && length > location.uploadResumableMaxSize) {
+        Logger::instance().log(WARNING, "Resumable upload of " + to_string(length) + " bytes exceeds upload_resumable_max_size");
+        response.beError(413);
+        return;
+    }
+    std::string stateDir = uploadDir + "/.resumable";
+    if (mkdir(stateDir.c_str(), 0755) == -1 && errno != EEXIST) {
+        Logger::instance().log(ERROR, "Failed to create " + stateDir + " Error: " + strerror(errno));
+        response.beError(500, "Internal Server Error: Error during file upload.");
+        return;
+    }
+
+    std::string id = generateId();
+    std::string filename = sanitizeFilename(metadataFilename(request.getStrHeader("Upload-Metadata")));
+    if (filename.empty())
+        filename = id;
+    std::string partPath = statePath(uploadDir, id, ".part");
+    int fd = open(partPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd == -1) {
+        Logger::instance().log(ERROR, "Failed to create " + partPath + " Error: " + strerror(errno));
+        response.beError(500, "Internal Server Error: Error during file upload.");
+        return;
+    }
+    // Rien n'est réservé avant l'arrivée des octets (voir append)
+    close(fd);
+    if (!writeInfo(statePath(uploadDir, id, ".info"), length, filename)) {
+        unlink(partPath.c_str());
+        Logger::instance().log(ERROR, "Failed to write state of resumable upload " + id);
+        response.beError(500, "Internal Server Error: Error during file upload.");
+        return;
+    }
+    Logger::instance().log(INFO, "Resumable upload " + id + " created: " + to_string(length) + " bytes for " + filename);
+    response.setStatusCode(201);
+    std::string base = location.path;
+    if (!base.empty() && base[base.size() - 1] == '/')
+        base.erase(base.size() - 1);
+    response.setHeader("Location", base + "/" + id);
+    setExpires(response, time(NULL), location);
+}
+
+ResumableUpload* ResumableUpload::append(const HTTPRequest& request, HTTPResponse& response, const Location& location,
+                                         const std::string& uploadDir, const std::string& id) {
+    if (request.getStrHeader("Content-Type") != "application/offset+octet-stream") {
+        response.beError(415, "PATCH body must be application/offset+octet-stream.");
+        return NULL;
+    }
+    size_t offset;
+    if (!parseOffset(request.getStrHeader("Upload-Offset"), offset)) {
+        response.beError(400, "Bad Request: Invalid Upload-Offset.");
+        return NULL;
+    }
+    size_t length;
+    std::string filename;
+    std::string partPath = statePath(uploadDir, id, ".part");
+    struct stat partStat;
+    if (!readInfo(statePath(uploadDir, id, ".info"), length, filename) || stat(partPath.c_str(), &partStat) != 0) {
+        response.beError(404, "Unknown upload.");
+        return NULL;
+    }
+    size_t current = partStat.st_size;
+    if (_active.count(id)) {
+        response.beError(409, "Conflict: Upload in progress.");
+        return NULL;
+    }
+    if (offset != current) {
+        response.beError(409, "Conflict: Upload-Offset does not match the upload.");
+        response.setHeader("Upload-Offset", to_string(current));
+        return NULL;
+    }
+    if (request.getContentLength() > length - current) {
+        response.beError(413, "Chunk goes past Upload-Length.");
+        return NULL;
+    }
+    int fd = open(partPath.c_str(), O_WRONLY | O_APPEND);
+    if (fd == -1) {
+        Logger::instance().log(ERROR, "Failed to open " + partPath + " Error: " + strerror(errno));
+        response.beError(500, "Internal Server Error: Error during file upload.");
+        return NULL;
+    }
+#ifdef __linux__
+    // Place du seul morceau annoncé, réservée sans changer la taille (= l'offset)
+    if (request.getContentLength() > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, current, request.getContentLength()) == -1
+        && (errno == ENOSPC || errno == EFBIG)) {
+        close(fd);
+        Logger::instance().log(ERROR, "Not enough space for " + to_string(request.getContentLength()) + " bytes of resumable upload " + id);
+        response.beError(507, "Insufficient Storage: Not enough space for the upload.");
+        return NULL;
+    }
+#endif
+    ResumableUpload* upload = new ResumableUpload(id, uploadDir, filename, length, current, fd, request.getContentLength(), location.uploadFsync);
+    upload->_expire = location.uploadResumableExpire;
+    return upload;
+}
+
+void ResumableUpload::options(HTTPResponse& response, const Location& location) {
+    response.setStatusCode(204);
+    response.setHeader("Tus-Version", VERSION);
+    response.setHeader("Tus-Extension", location.uploadResumableExpire ? "creation,termination,checksum,expiration" : "creation,termination,checksum");
+    response.setHeader("Tus-Checksum-Algorithm", "sha256,md5,crc32c");
+    if (location.uploadResumableMaxSize)
+        response.setHeader("Tus-Max-Size", to_string(location.uploadResumableMaxSize));
+}
+
+bool ResumableUpload::consume(const char* data, size_t size) {
+    if (!writeAll(_fd, data, size)) {
+        int error = errno;
+        Logger::instance().log(ERROR, "Error while appending to resumable upload " + _id + ": " + strerror(error));
+        return rejectWriteError(error);
+    }
+    _offset += size;
+    return true;
+}
+
+void ResumableUpload::discard() {
+    if (_fd == -1 || !_digest.hasExpectations() || _offset == _startOffset)
+        return;
+    if (ftruncate(_fd, _startOffset) == -1) {
+        Logger::instance().log(ERROR, "Failed to roll back resumable upload " + _id + ": " + strerror(errno));
+        return;
+    }
+    _offset = _startOffset;
+}
+
+void ResumableUpload::finish(HTTPResponse& response) {
+    if (!_errorStatus)
+        verifyDigest(460);
+    if (!_errorStatus && _offset == _length)
+        complete();
+    if (_errorStatus)
+        response.beError(_errorStatus, _errorMessage);
+    else
+        response.setStatusCode(204);
+    response.setHeader("Upload-Offset", to_string(_offset));
+    response.setHeader("Tus-Resumable", VERSION);
+    if (_offset < _length && _expire)
+        response.setHeader("Upload-Expires", httpDate(time(NULL) + _expire / 1000));
+}
+
+bool ResumableUpload::complete() {
+    if (_fsyncPolicy != UPLOAD_FSYNC_OFF && fsync(_fd) == -1) {
+        Logger::instance().log(ERROR, std::string("Failed to sync uploaded file: ") + strerror(errno));
+        return reject(500, "Internal Server Error: Error during file upload.");
+    }
+    close(_fd);
+    _fd = -1;
+
+    std::string destPath = _uploadDir + "/" + _filename;
+    if (!isPathAllowed(destPath, _uploadDir)) {
+        Logger::instance().log(ERROR, "Attempt to upload outside of allowed path.");
+        return reject(403, "Attempt to upload outside of allowed path.");
+    }
+    struct stat fileStat;
+    if (stat(destPath.c_str(), &fileStat) == 0 && !(fileStat.st_mode & S_IWUSR)) {
+        Logger::instance().log(ERROR, "Forbidden destination error: destination file is write-protected.");
+        return reject(403, "Forbidden: Write-protected destination.");
+    }
+    if (rename(statePath(_uploadDir, _id, ".part").c_str(), destPath.c_str()) == -1) {
+        Logger::instance().log(ERROR, "Failed to move upload to " + destPath + " Error: " + strerror(errno));
+        return reject(500, "Internal Server Error: Error during file upload.");
+    }
+    unlink(statePath(_uploadDir, _id, ".info").c_str());
+    if (_fsyncPolicy == UPLOAD_FSYNC_FULL) {
+        int dirFd = open(_uploadDir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dirFd != -1) {
+            fsync(dirFd);
+            close(dirFd);
+        }
+    }
+    Logger::instance().log(INFO, "Resumable upload " + _id + " completed: " + destPath);
+    return true;
+}
+
+// <location>/<32 caractères hex>, sinon ""
+std::string ResumableUpload::idFromPath(const HTTPRequest& request, const Location& location) {
+    std::string base = location.path;
+    if (!base.empty() && base[base.size() - 1] == '/')
+        base.erase(base.size() - 1);
+    std::string path = request.getPath();
+    if (path.size() != base.size() + 33 || path.compare(0, base.size(), base) != 0 || path[base.size()] != '/')
+        return "";
+    std::string id = path.substr(base.size() + 1);
+    if (id.find_first_not_of("0123456789abcdef") != std::string::npos)
+        return "";
+    return id;
+}
+
+// L'id sert de capacité : il doit être imprévisible
+std::string ResumableUpload::generateId() {
+    unsigned char bytes[16];
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd == -1 || read(fd, bytes, sizeof(bytes)) != static_cast<ssize_t>(sizeof(bytes))) {
+        for (size_t i = 0; i < sizeof(bytes); ++i)
+            bytes[i] = static_cast<unsigned char>(rand() % 256);
+    }
+    if (fd != -1)
+        close(fd);
+    static const char hex[] = "0123456789abcdef";
+    std::string id;
+    for (size_t i = 0; i < sizeof(bytes); ++i) {
+        id += hex[bytes[i] >> 4];
+        id += hex[bytes[i] & 0x0F];
+    }
+    return id;
+}
+
+std::string ResumableUpload::statePath(const std::string& uploadDir, const std::string& id, const std::string& extension) {
+    return uploadDir + "/.resumable/" + id + extension;
+}
+
+// Format : "length <octets>\nfilename <nom>\n"
+bool ResumableUpload::readInfo(const std::string& path, size_t& length, std::string& filename) {
+    std::ifstream file(path.c_str());
+    std::string line;
+    bool hasLength = false;
+    filename.clear();
+    while (std::getline(file, line)) {
+        if (line.compare(0, 7, "length ") == 0)
+            hasLength = parseOffset(line.substr(7), length);
+        else if (line.compare(0, 9, "filename ") == 0)
+            filename = line.substr(9);
+    }
+    return hasLength && !filename.empty();
+}
+
+// Écrit à côté puis renommé : jamais d'état à moitié écrit
+bool ResumableUpload::writeInfo(const std::string& path, size_t length, const std::string& filename) {
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath.c_str());
+        file << "length " << length << "\nfilename " << filename << "\n";
+        file.flush();
+        if (!file)
+            return false;
+    }
+    if (rename(tempPath.c_str(), path.c_str()) == -1) {
+        unlink(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ResumableUpload::parseOffset(const std::string& value, size_t& offset) {
+    if (value.empty() || value.size() > 19 || value.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    offset = static_cast<size_t>(strtoull(value.c_str(), NULL, 10));
+    return true;
+}
+
+// Upload-Metadata : "clé base64,clé base64..." ; "filename" (ou "name"),
+// sans caractères de contrôle
+std::string ResumableUpload::metadataFilename(const std::string& metadata) {
+    std::string name;
+    std::string fallback;
+    size_t start = 0;
+    while (start < metadata.size()) {
+        size_t end = metadata.find(',', start);
+        if (end == std::string::npos)
+            end = metadata.size();
+        std::string pair = metadata.substr(start, end - start);
+        pair.erase(0, pair.find_first_not_of(" \t"));
+        size_t space = pair.find(' ');
+        std::string key = pair.substr(0, space);
+        std::string decoded;
+        if (space != std::string::npos && base64Decode(pair.substr(space + 1), decoded)) {
+            if (key == "filename")
+                name = decoded;
+            else if (key == "name")
+                fallback = decoded;
+        }
+        start = end + 1;
+    }
+    if (name.empty())
+        name = fallback;
+    std::string clean;
+    for (size_t i = 0; i < name.size(); ++i) {
+        if (static_cast<unsigned char>(name[i]) >= 0x20 && name[i] != 0x7f)
+            clean += name[i];
+    }
+    return clean;
+}
+
+bool ResumableUpload::isExpired(const struct stat& partStat, const Location& location) {
+    return location.uploadResumableExpire && time(NULL) - partStat.st_mtime >= static_cast<time_t>(location.uploadResumableExpire / 1000);
+}
+
+// Échéance d'un upload inachevé : dernière écriture + upload_resumable_expire
+void ResumableUpload::setExpires(HTTPResponse& response, time_t lastActivity, const Location& location) {
+    if (location.uploadResumableExpire)
+        response.setHeader("Upload-Expires", httpDate(lastActivity + location.uploadResumableExpire / 1000));
+}
+
+// L'âge d'un upload est celui de son .part : chaque PATCH le rajeunit
+void ResumableUpload::expire(const std::string& uploadDir, const Location& location) {
+    if (!location.uploadResumableExpire)
+        return;
+    DIR* dir = opendir((uploadDir + "/.resumable").c_str());
+    if (!dir)
+        return;
+    std::vector<std::string> expired;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        std::string name = entry->d_name;
+        if (name.size() <= 5 || name.compare(name.size() - 5, 5, ".info") != 0)
+            continue;
+        std::string id = name.substr(0, name.size() - 5);
+        struct stat st;
+        if (_active.count(id))
+            continue;
+        if (stat(statePath(uploadDir, id, ".part").c_str(), &st) != 0 && stat(statePath(uploadDir, id, ".info").c_str(), &st) != 0)
+            continue;
+        if (isExpired(st, location))
+            expired.push_back(id);
+    }
+    closedir(dir);
+
+    for (size_t i = 0; i < expired.size(); ++i) {
+        unlink(statePath(uploadDir, expired[i], ".part").c_str());
+        unlink(statePath(uploadDir, expired[i], ".info").c_str());
+        Logger::instance().log(INFO, "Resumable upload " + expired[i] + " expired");
+    }
+    if (!expired.empty())
+        Metrics::instance().increment(Metrics::labeled("upload_resumable_expired_total", "location", location.path), expired.size());
+}
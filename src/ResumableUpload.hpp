@@ -0,0 +1,88 @@
+// ResumableUpload.hpp
+#ifndef RESUMABLEUPLOAD_HPP
+#define RESUMABLEUPLOAD_HPP
+
+#include <set>
+#include <string>
+#include <time.h>
+#include "Location.hpp"
+#include "UploadStream.hpp"
+
+class HTTPRequest;
+
+/*
+ * Uploads reprenables (protocole tus 1.0.0, extensions creation,
+ * termination et checksum) sur une location upload_resumable on :
+ *   POST   <location>       Upload-Length (+ Upload-Metadata filename) : création
+ *   HEAD   <location>/<id>  Upload-Offset courant
+ *   PATCH  <location>/<id>  Upload-Offset + morceau à ajouter
+ *   DELETE <location>/<id>  abandon
+ *   OPTIONS                 capacités du serveur
+ * L'état vit sur le disque, dans <upload_path>/.resumable : <id>.info (taille
+ * annoncée, nom final) et <id>.part (octets reçus, dont la taille est
+ * l'offset). Un upload survit donc à un redémarrage, et un PATCH interrompu
+ * garde ce qu'il a écrit. Complet, le fichier est renommé à sa place.
+ * Un morceau accompagné d'une empreinte (Upload-Checksum, Content-Digest)
+ * n'est gardé que si elle concorde : sinon le .part revient à son offset
+ * de départ (460).
+ * La place n'est réservée qu'à l'arrivée de chaque morceau, et un upload
+ * sans PATCH depuis upload_resumable_expire est supprimé (extension
+ * expiration : Upload-Expires, puis 410).
+ */
+class ResumableUpload : public UploadStream {
+public:
+    static const char* const VERSION;
+
+    static bool isResumableRequest(const HTTPRequest& request, const Location& location);
+    // Remplit la réponse, sauf pour un PATCH accepté : le flux retourné reçoit
+    // alors le corps et répondra une fois celui-ci écrit
+    static ResumableUpload* handle(const HTTPRequest& request, HTTPResponse& response, const Location& location, const std::string& uploadDir);
+
+    // Supprime les uploads expirés de uploadDir (boucle principale)
+    static void expire(const std::string& uploadDir, const Location& location);
+
+    ~ResumableUpload();
+    void finish(HTTPResponse& response);
+
+protected:
+    bool consume(const char* data, size_t size);
+    // Morceau vérifiable mais refusé ou incomplet : retiré du .part
+    void discard();
+
+private:
+    std::string _id;
+    std::string _uploadDir;
+    std::string _filename;
+    size_t _length;
+    size_t _offset;
+    size_t _startOffset;
+    int _fd;
+    UploadFsync _fsyncPolicy;
+    unsigned long _expire;
+
+    // Uploads ayant un PATCH en cours : un seul à la fois par upload
+    static std::set<std::string> _active;
+
+    ResumableUpload(const std::string& id, const std::string& uploadDir, const std::string& filename, size_t length,
+                    size_t offset, int fd, size_t contentLength, UploadFsync fsyncPolicy);
+
+    // Octets tous reçus : le .part devient le fichier final
+    bool complete();
+
+    static void create(const HTTPRequest& request, HTTPResponse& response, const Location& location, const std::string& uploadDir);
+    static ResumableUpload* append(const HTTPRequest& request, HTTPResponse& response, const Location& location,
+                                   const std::string& uploadDir, const std::string& id);
+    static void options(HTTPResponse& response, const Location& location);
+
+    static std::string idFromPath(const HTTPRequest& request, const Location& location);
+    static std::string generateId();
+    static std::string statePath(const std::string& uploadDir, const std::string& id, const std::string& extension);
+    static bool readInfo(const std::string& path, size_t& length, std::string& filename);
+    static bool writeInfo(const std::string& path, size_t length, const std::string& filename);
+    static bool parseOffset(const std::string& value, size_t& offset);
+    static std::string metadataFilename(const std::string& metadata);
+    static bool isExpired(const struct stat& partStat, const Location& location);
+    static void setExpires(HTTPResponse& response, time_t lastActivity, const Location& location);
+};
+
+#endif
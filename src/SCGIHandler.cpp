@@ -0,0 +1,162 @@
+// SCGIHandler.cpp
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include "SCGIHandler.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+const size_t SCGIHandler::UWSGI_MAX_VARS;
+
+SCGIHandler::SCGIHandler(const std::string& scriptPath, const std::string& upstream, Protocol protocol, const HTTPRequest& request)
+    : UpstreamHandler(scriptPath, upstream, request), _protocol(protocol), _headChecked(false) {
+}
+
+SCGIHandler::~SCGIHandler() {
+}
+
+const char* SCGIHandler::protocolName() const {
+    return _protocol == SCGI ? "SCGI" : "uwsgi";
+}
+
+void SCGIHandler::appendBody(const char* data, size_t size) {
+    _CGIInput.append(data, size);
+}
+
+// Netstring "<taille>:<variables>," ; CONTENT_LENGTH doit venir en premier,
+// suivi de SCGI=1
+bool SCGIHandler::encodeSCGI(const std::vector<std::string>& env) {
+    std::string headers;
+    headers.append("CONTENT_LENGTH", 15);
+    headers += to_string(_inputExpected);
+    headers += '\0';
+    headers.append("SCGI\0" "1", 7);
+    for (size_t i = 0; i < env.size(); ++i) {
+        if (env[i].compare(0, 15, "CONTENT_LENGTH=") == 0)
+            continue;
+        size_t separator = env[i].find('=');
+        headers.append(env[i], 0, separator);
+        headers += '\0';
+        headers.append(env[i], separator + 1, std::string::npos);
+        headers += '\0';
+    }
+    _CGIInput += to_string(headers.size()) + ":";
+    _CGIInput += headers;
+    _CGIInput += ',';
+    return true;
+}
+
+void SCGIHandler::appendLittleEndian16(std::string& out, size_t value) {
+    out += static_cast<char>(value & 0xFF);
+    out += static_cast<char>((value >> 8) & 0xFF);
+}
+
+// En-tête de 4 octets (modifier1 0 : requête WSGI, taille du bloc en little
+// endian, modifier2 0) puis chaque variable en <taille><nom><taille><valeur>
+bool SCGIHandler::encodeUWSGI(const std::vector<std::string>& env) {
+    std::string vars;
+    for (size_t i = 0; i < env.size(); ++i) {
+        size_t separator = env[i].find('=');
+        size_t valueLength = env[i].size() - separator - 1;
+        if (separator > UWSGI_MAX_VARS || valueLength > UWSGI_MAX_VARS)
+            return false;
+        appendLittleEndian16(vars, separator);
+        vars.append(env[i], 0, separator);
+        appendLittleEndian16(vars, valueLength);
+        vars.append(env[i], separator + 1, valueLength);
+    }
+    if (vars.size() > UWSGI_MAX_VARS)
+        return false;
+    _CGIInput += '\0';
+    appendLittleEndian16(_CGIInput, vars.size());
+    _CGIInput += '\0';
+    _CGIInput += vars;
+    return true;
+}
+
+bool SCGIHandler::startCGI() {
+    _lastReadTime = curr_time_ms();
+    _lastSendTime = _lastReadTime;
+    Logger::instance().log(DEBUG, "Forwarding " + _scriptPath + " to " + protocolName() + " upstream " + _upstream);
+
+    // Le corps déjà reçu suit le bloc de variables
+    std::string body;
+    body.swap(_CGIInput);
+    _CGIInput.reserve(body.size() + 1024);
+
+    std::vector<std::string> env = buildEnvironment(_inputExpected);
+    bool encoded = _protocol == SCGI ? encodeSCGI(env) : encodeUWSGI(env);
+    if (!encoded) {
+        Logger::instance().log(ERROR, std::string(protocolName()) + " upstream " + _upstream + ": request variables too large");
+        return false;
+    }
+    _CGIInput += body;
+    return connectUpstream(false);
+}
+
+// "HTTP/1.1 404 Not Found" -> "Status: 404 Not Found"
+void SCGIHandler::checkStatusLine(bool complete) {
+    size_t lineEnd = _head.find("\r\n");
+    if (lineEnd == std::string::npos && !complete && _head.size() < MAX_STATUS_LINE)
+        return;
+    if (lineEnd != std::string::npos && _head.compare(0, 5, "HTTP/") == 0) {
+        size_t space = _head.find(' ');
+        if (space != std::string::npos && space < lineEnd)
+            _head.replace(0, space + 1, "Status: ");
+    }
+    _headChecked = true;
+}
+
+bool SCGIHandler::deliver(const char* data, size_t size) {
+    size_t accepted = outputAllowance(size);
+    _CGIOutput.append(data, accepted);
+    _outputTotal += accepted;
+    return !_outputExceeded;
+}
+
+// La réponse se termine à la fermeture de la connexion par l'upstream
+int SCGIHandler::readFromCGI() {
+    if (_socketFd == -1)
+        return 0;
+
+    char buffer[16384];
+    ssize_t bytesRead = read(_socketFd, buffer, sizeof(buffer));
+    if (bytesRead < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return -1;
+        fail(std::string("read error: ") + strerror(errno));
+        return 0;
+    }
+    if (bytesRead == 0) {
+        if (!_headChecked && !_head.empty()) {
+            checkStatusLine(true);
+            deliver(_head.data(), _head.size());
+            _head.clear();
+        }
+        if (_outputTotal == 0) {
+            fail("connection closed without a response");
+            return 0;
+        }
+        close(_socketFd);
+        _socketFd = -1;
+        _cgiFinished = true;
+        _cgiExitStatus = 0;
+        return 0;
+    }
+
+    _lastReadTime = curr_time_ms();
+    bool withinLimit;
+    if (_headChecked) {
+        withinLimit = deliver(buffer, bytesRead);
+    } else {
+        _head.append(buffer, bytesRead);
+        checkStatusLine(false);
+        if (!_headChecked)
+            return bytesRead;
+        withinLimit = deliver(_head.data(), _head.size());
+        _head.clear();
+    }
+    if (!withinLimit)
+        return -1; // cgi_max_output : la boucle tue la requête
+    return bytesRead;
+}
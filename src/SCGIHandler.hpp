@@ -0,0 +1,48 @@
+// SCGIHandler.hpp
+#ifndef SCGIHANDLER_HPP
+#define SCGIHANDLER_HPP
+
+#include <string>
+#include "UpstreamHandler.hpp"
+
+/*
+ * Requête envoyée à un serveur d'application SCGI (scgi_pass) ou uwsgi
+ * (uwsgi_pass) : un bloc de variables CGI encodé, suivi du corps brut.
+ * La réponse est la sortie CGI du script, jusqu'à ce que l'upstream ferme la
+ * connexion : aucun des deux protocoles ne marque la fin d'une réponse, la
+ * connexion n'est donc pas rendue au pool. Une ligne de statut HTTP en tête
+ * (uWSGI) est convertie en en-tête Status.
+ */
+class SCGIHandler : public UpstreamHandler {
+public:
+    enum Protocol { SCGI, UWSGI };
+
+    SCGIHandler(const std::string& scriptPath, const std::string& upstream, Protocol protocol, const HTTPRequest& request);
+    virtual ~SCGIHandler();
+
+    virtual bool startCGI();
+    virtual int readFromCGI();
+
+protected:
+    virtual const char* protocolName() const;
+    virtual void appendBody(const char* data, size_t size);
+
+private:
+    // Taille max du bloc de variables uwsgi (champ de 16 bits)
+    static const size_t UWSGI_MAX_VARS = 65535;
+    // Au-delà, le début de la réponse n'est plus examiné
+    static const size_t MAX_STATUS_LINE = 1024;
+
+    Protocol _protocol;
+    // Début de la réponse, gardé tant que sa première ligne n'est pas complète
+    std::string _head;
+    bool _headChecked;
+
+    bool encodeSCGI(const std::vector<std::string>& env);
+    bool encodeUWSGI(const std::vector<std::string>& env);
+    static void appendLittleEndian16(std::string& out, size_t value);
+    void checkStatusLine(bool complete);
+    bool deliver(const char* data, size_t size);
+};
+
+#endif
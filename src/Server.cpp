@@ -4,11 +4,21 @@
 #include "HTTPRequest.hpp"
 #include "HTTPResponse.hpp"
 #include "CGIHandler.hpp"
+#include "FastCGIHandler.hpp"
+#include "SCGIHandler.hpp"
+#include "CGILimiter.hpp"
+#include "UploadLimiter.hpp"
+#include "ResponseCache.hpp"
+#include "Metrics.hpp"
 #include "ServerConfig.hpp"
 #include "UploadHandler.hpp"
+#include "ResumableUpload.hpp"
+#include "PutUpload.hpp"
+#include "ContentStore.hpp"
 #include "Logger.hpp"
 #include <sys/stat.h>  // Pour utiliser la fonction stat
 #include <sstream>
+#include <cctype>
 #include <fcntl.h>
 #include <time.h>
 #include "Utils.hpp"
@@ -16,8 +26,9 @@
 #include <stdlib.h>    // Pour realpath
 #include <dirent.h>
 #include <string.h>
+#include <arpa/inet.h>
 
-Server::Server(const ServerConfig& config) : _config(config) {
+Server::Server(const ServerConfig& config) : _config(config), _lastUploadSweep(0) {
 	if (!_config.isValid()) {
         Logger::instance().log(ERROR, "Server configuration is invalid.");
 	} else {
@@ -73,6 +84,8 @@ void Server::receiveRequest(int client_fd, HTTPRequest& request) {
     readFromSocket(client_fd, request);
     if (!request.getHeadersParsed()) {
         request.parseRawRequest(_config);
+        if (request.getErrorCode() != 0)
+            return;
         if (request.getRequestTooLarge()) {
 			request.setErrorCode(413);
             return;
@@ -103,6 +116,9 @@ void Server::receiveRequest(int client_fd, HTTPRequest& request) {
 }
 
 void Server::handleHttpRequest(int client_fd, ClientConnection& connection) {
+    if (!awaitCoalescedRequest(connection) || !admitCGIRequest(connection) || !admitUpload(connection))
+        return;
+
     HTTPRequest& request = *connection.getRequest();
     HTTPResponse* response = connection.getResponse();
 
@@ -114,9 +130,19 @@ void Server::handleHttpRequest(int client_fd, ClientConnection& connection) {
     session.getManager(&request, response, client_fd, session);
 
     const Location* location = _config.findLocation(request.getPath());
+    connection.setHeadRequest(request.getMethod() == "HEAD");
+
+    if (isReservedPath(request.getPath())) {
+        response->beError(404);
+        Logger::instance().log(WARNING, "404 error (Not Found): reserved path " + request.getPath());
+        return;
+    }
 
     if (location && !location->allowedMethods.empty()) {
-        if (std::find(location->allowedMethods.begin(), location->allowedMethods.end(), request.getMethod()) == location->allowedMethods.end()) {
+        // HEAD suit les droits de GET
+        std::string method = request.getMethod() == "HEAD" ? "GET" : request.getMethod();
+        if (std::find(location->allowedMethods.begin(), location->allowedMethods.end(), request.getMethod()) == location->allowedMethods.end()
+            && std::find(location->allowedMethods.begin(), location->allowedMethods.end(), method) == location->allowedMethods.end()) {
             response->beError(405); // Méthode non autorisée
             Logger::instance().log(WARNING, "405 error (Forbidden) sent on request : \n" + request.toString());
             return;
@@ -150,8 +176,17 @@ void Server::handleHttpRequest(int client_fd, ClientConnection& connection) {
     }
 
     // Traitement de la requête selon la méthode
-    if (request.getMethod() == "GET" || request.getMethod() == "POST") {
+    if (location && location->metrics && (request.getMethod() == "GET" || request.getMethod() == "HEAD")) {
+        response->setStatusCode(200);
+        response->setHeader("Content-Type", "text/plain; version=0.0.4");
+        response->setHeader("Cache-Control", "no-store");
+        response->setBody(Metrics::instance().render());
+    } else if (location && ResumableUpload::isResumableRequest(request, *location)) {
+        handleResumableUpload(connection, *location);
+    } else if (request.getMethod() == "GET" || request.getMethod() == "HEAD" || request.getMethod() == "POST") {
         handleGetOrPostRequest(client_fd, connection);
+    } else if (request.getMethod() == "PUT") {
+        handlePutRequest(connection, location);
     } else if (request.getMethod() == "DELETE") {
         handleDeleteRequest(connection);
     } else {
@@ -161,8 +196,13 @@ void Server::handleHttpRequest(int client_fd, ClientConnection& connection) {
 
     response = connection.getResponse();
 
+    // Le corps va être lu par l'upload ou le CGI : le client peut l'envoyer
+    if (request.getStreamBody() && (connection.getUpload() || connection.getCgiHandler()))
+        sendContinue(client_fd, request);
+
     // Détermination du keep-alive
     std::string connectionHeader = request.getStrHeader("Connection");
+    bool streamBody = request.getStreamBody();
     delete connection.getRequest();
     connection.setRequest(NULL);
     bool keepAlive = true;
@@ -170,6 +210,10 @@ void Server::handleHttpRequest(int client_fd, ClientConnection& connection) {
     if (!connectionHeader.empty() && (connectionHeader == "close" || connectionHeader == "Close")) {
         keepAlive = false;
     }
+    // Corps annoncé mais jamais lu : la connexion ne peut pas resservir
+    if (streamBody && !connection.getCgiHandler() && !connection.getUpload()) {
+        keepAlive = false;
+    }
 
     // Définir l'en-tête Connection dans la réponse
     if (response && keepAlive) {
@@ -178,8 +222,9 @@ void Server::handleHttpRequest(int client_fd, ClientConnection& connection) {
         response->setHeader("Connection", "close");
     }
 
-    // Ajouter Content-Length si absent
-    if (response && response->getStrHeader("Content-Length").empty()) {
+    // Ajouter Content-Length si absent (jamais sur 204/304)
+    if (response && response->getStrHeader("Content-Length").empty()
+        && response->getStatusCode() != 204 && response->getStatusCode() != 304) {
         response->setHeader("Content-Length", to_string(response->getBody().size()));
     }
 }
@@ -244,43 +289,145 @@ std::string Server::sanitizeFilename(const std::string& filename) {
     return safeFilename;
 }
 
-void Server::handleFileUpload(const HTTPRequest& request, HTTPResponse& response, const std::string& boundary) {
-    const Location* location = _config.findLocation(request.getPath());
+// Répertoire d'upload de la location (relatif à la racine du serveur) ;
+// sinon la réponse d'erreur est remplie
+bool Server::resolveUploadDir(const Location* location, HTTPResponse& response, std::string& uploadDir) const {
     if (!location || !location->uploadOn) {
         Logger::instance().log(ERROR, "Upload not allowed for this location.");
         response.beError(403, "Upload not allowed.");
-        return;
+        return false;
     }
     if (location->uploadPath.empty()) {
         Logger::instance().log(ERROR, "Upload path not specified for this location.");
         response.beError(403, "Upload path not specified.");
-        return;
+        return false;
     }
 
     // Préparer le répertoire de téléchargement
-    std::string uploadDir = location->uploadPath;
-    if (!uploadDir.empty() && uploadDir[0] != '/') {
-        uploadDir = _config.root + "/" + uploadDir;
-    }
+    uploadDir = uploadDirFor(*location);
 
     // Vérifier que le répertoire de téléchargement existe
     struct stat st;
     if (stat(uploadDir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
         Logger::instance().log(ERROR, "Upload directory does not exist or is not a directory: " + uploadDir);
         response.beError(500, "Internal Server Error: Upload directory does not exist.");
+        return false;
+    }
+    return true;
+}
+
+std::string Server::uploadDirFor(const Location& location) const {
+    if (!location.uploadPath.empty() && location.uploadPath[0] != '/')
+        return _config.root + "/" + location.uploadPath;
+    return location.uploadPath;
+}
+
+// Au plus une fois par minute ; un upload expiré non encore purgé est de
+// toute façon refusé (410) à son prochain accès. Le premier passage vide
+// aussi les ContentStore des objets orphelins laissés par un arrêt
+void Server::sweepUploads(unsigned long now) {
+    if (now - _lastUploadSweep < 60000)
+        return;
+    bool startup = _lastUploadSweep == 0;
+    _lastUploadSweep = now;
+    for (size_t i = 0; i < _config.locations.size(); ++i) {
+        const Location& location = _config.locations[i];
+        if (!location.uploadOn || location.uploadPath.empty())
+            continue;
+        std::string uploadDir = uploadDirFor(location);
+        if (location.uploadResumable)
+            ResumableUpload::expire(uploadDir, location);
+        if (location.uploadDedup && (startup || ContentStore::needsReclaim(uploadDir)))
+            ContentStore::reclaim(uploadDir);
+    }
+}
+
+void Server::handleFileUpload(ClientConnection& connection, const std::string& boundary) {
+    const HTTPRequest& request = *connection.getRequest();
+    const Location* location = _config.findLocation(request.getPath());
+    std::string uploadDir;
+    if (!resolveUploadDir(location, *connection.getResponse(), uploadDir))
+        return;
+
+    // Déléguer le traitement à UploadHandler
+    streamUpload(connection, new UploadHandler(boundary, uploadDir, request.getContentLength(), location->uploadFsync, location->uploadDedup), *location);
+}
+
+// Upload reprenable (tus) : seul un PATCH accepté a un corps à écrire
+void Server::handleResumableUpload(ClientConnection& connection, const Location& location) {
+    HTTPResponse& response = *connection.getResponse();
+    std::string uploadDir;
+    if (!resolveUploadDir(&location, response, uploadDir))
+        return;
+    ResumableUpload* upload = ResumableUpload::handle(*connection.getRequest(), response, location, uploadDir);
+    if (upload)
+        streamUpload(connection, upload, location);
+}
+
+// PUT : le corps est écrit tel quel sur la cible, sous le répertoire d'upload
+void Server::handlePutRequest(ClientConnection& connection, const Location* location) {
+    HTTPResponse& response = *connection.getResponse();
+    if (!location || !location->uploadOn) {
+        response.beError(405);
+        Logger::instance().log(WARNING, "405 error (Method Not Allowed): PUT outside of an upload location.");
         return;
     }
+    std::string uploadDir;
+    if (!resolveUploadDir(location, response, uploadDir))
+        return;
+    PutUpload* upload = PutUpload::create(*connection.getRequest(), response, *location, uploadDir);
+    if (upload)
+        streamUpload(connection, upload, *location);
+}
 
-    try {
-        // Déléguer le traitement à UploadHandler
-        UploadHandler uploadHandler(request, response, boundary, uploadDir, _config);
-        uploadHandler.handleUpload();
-    } catch (const std::exception& e) {
-        // Logger::instance().log(ERROR, std::string("Error while handling file upload: ") + e.what());
-        // response.setStatusCode(500);
-        // response.setBody("Internal Server Error: Error during file upload.");
+// Donne au flux la partie du corps arrivée avec les en-têtes. S'il en reste
+// à recevoir, le flux est confié à la connexion (receiveUploadBody) et la
+// réponse viendra après ; sinon elle est remplie tout de suite.
+void Server::streamUpload(ClientConnection& connection, UploadStream* upload, const Location& location) {
+    const HTTPRequest& request = *connection.getRequest();
+    std::string body = request.getBody();
+    // Le stockage par contenu a besoin du SHA-256 de chaque fichier
+    unsigned int algorithms = location.uploadDigest | (location.uploadDedup ? ContentDigest::SHA256 : 0);
+    if (upload->setDigest(request, algorithms) && upload->prepare())
+        upload->feed(body.data(), body.size());
+    if (request.getStreamBody() && upload->getRemainingBody() > 0 && !upload->hasFailed()) {
+        connection.setUpload(upload);
+        delete connection.getResponse();
+        connection.setResponse(NULL);
         return;
     }
+    upload->finish(*connection.getResponse());
+    delete upload;
+}
+
+// Réponse d'un upload dont le corps a été lu au fil de l'eau
+void Server::finishUpload(ClientConnection& connection) {
+    UploadStream* upload = connection.getUpload();
+    HTTPResponse* response = new HTTPResponse();
+    upload->finish(*response);
+    // Corps pas entièrement lu après une erreur : la connexion ne peut pas resservir
+    response->setHeader("Connection", upload->getRemainingBody() > 0 ? "close" : "keep-alive");
+    if (response->getStatusCode() != 204)
+        response->setHeader("Content-Length", to_string(response->getBody().size()));
+    connection.setUpload(NULL);
+    if (connection.getResponse())
+        delete connection.getResponse();
+    connection.setResponse(response);
+    connection.prepareResponse();
+}
+
+// Paramètre boundary du Content-Type, sans guillemets ni paramètres suivants
+std::string Server::multipartBoundary(const std::string& contentType) {
+    size_t boundaryPos = contentType.find("boundary=");
+    if (boundaryPos == std::string::npos)
+        return "";
+    std::string boundary = contentType.substr(boundaryPos + 9);
+    if (!boundary.empty() && boundary[0] == '"') {
+        size_t closing = boundary.find('"', 1);
+        return closing == std::string::npos ? "" : boundary.substr(1, closing - 1);
+    }
+    size_t end = boundary.find_first_of("; \t");
+    return boundary.substr(0, end);
 }
 
 
@@ -317,7 +464,7 @@ void Server::handleGetOrPostRequest(int client_fd, ClientConnection& connection)
     Logger::instance().log(DEBUG, "handleGetOrPostRequest: fullPath = " + fullPath);
 
     // Check if the method is supported
-    if (request.getMethod() != "GET" && request.getMethod() != "POST" && request.getMethod() != "DELETE") {
+    if (request.getMethod() != "GET" && request.getMethod() != "HEAD" && request.getMethod() != "POST" && request.getMethod() != "DELETE") {
         response.beError(501); // Not Implemented
         Logger::instance().log(WARNING, "501 error (Not Implemented): Method not supported.");
         return;
@@ -336,10 +483,9 @@ void Server::handleGetOrPostRequest(int client_fd, ClientConnection& connection)
     if (isFileUpload) {
         // Handle file upload
         if (location && location->uploadOn) {
-            size_t boundaryPos = contentType.find("boundary=");
-            if (boundaryPos != std::string::npos) {
-                std::string boundary = contentType.substr(boundaryPos + 9);
-                handleFileUpload(request, response, boundary);
+            std::string boundary = multipartBoundary(contentType);
+            if (!boundary.empty()) {
+                handleFileUpload(connection, boundary);
                 return;
             } else {
                 // Missing boundary in Content-Type
@@ -355,29 +501,68 @@ void Server::handleGetOrPostRequest(int client_fd, ClientConnection& connection)
         }
     }
 
-    // Check if the file has a CGI extension
-       // Check if the file has a CGI extension
+    // Check if the file has a CGI extension, or is followed by a PATH_INFO
     std::string extension = getFileExtension(fullPath);
+    std::string pathInfo;
+    if (!hasCgiExtension(extension) && splitScriptPath(fullPath, pathInfo))
+        extension = getFileExtension(fullPath);
     if (hasCgiExtension(extension)) {
         Logger::instance().log(DEBUG, "CGI extension detected for path: " + fullPath);
 
-        // Get the interpreter for this extension
-        std::string interpreter = getInterpreterForExtension(extension, location);
-        if (interpreter.empty()) {
+        // Get the interpreter for this extension (not needed with fastcgi_pass,
+        // scgi_pass or uwsgi_pass)
+        bool useUpstream = location && (!location->fastcgiPass.empty() || !location->scgiPass.empty() || !location->uwsgiPass.empty());
+        std::string interpreter = useUpstream ? "" : getInterpreterForExtension(extension, location);
+        if (!useUpstream && interpreter.empty()) {
             Logger::instance().log(ERROR, "No interpreter found for extension: " + extension);
             response.beError(500, "No interpreter configured for this CGI extension.");
             return;
         }
 
+        // cgi_cache : une copie encore servable évite le CGI ; périmée, elle
+        // part quand même et un CGI sans client la rafraîchit
+        ResponseCache::Ticket cacheTicket;
+        bool cacheable = ResponseCache::isCacheable(request, location);
+        if (cacheable) {
+            cacheTicket = ResponseCache::makeTicket(request, *location);
+            bool needsRefresh;
+            SharedBuffer body;
+            if (ResponseCache::instance().lookup(cacheTicket, response, body, curr_time_ms(), needsRefresh) != ResponseCache::MISS) {
+                connection.setSharedBody(body);
+                // Le rafraîchissement compte dans cgi_max_concurrent, sans
+                // jamais attendre en file : pas de slot libre, il est remis
+                if (needsRefresh && location->cgiMaxConcurrent > 0 && !CGILimiter::instance().tryAcquire(*location)) {
+                    ResponseCache::instance().postponeRefresh(cacheTicket);
+                } else if (needsRefresh) {
+                    CGIHandler* refresh = createCGIHandler(client_fd, request, location, fullPath, pathInfo, interpreter, root);
+                    if (location->cgiMaxConcurrent > 0)
+                        refresh->setConcurrencySlot(location);
+                    if (refresh->startCGI()) {
+                        ResponseCache::instance().startRefresh(cacheTicket, refresh);
+                    } else {
+                        delete refresh;
+                        ResponseCache::instance().abortRefresh(cacheTicket);
+                    }
+                }
+                return;
+            }
+        }
+
         if (access(fullPath.c_str(), F_OK) == -1) {
             Logger::instance().log(DEBUG, "CGI script not found: " + fullPath);
             response.beError(404); // Not Found
         } else {
-            CGIHandler* cgiHandler = new CGIHandler(fullPath, interpreter, request);
+            CGIHandler* cgiHandler = createCGIHandler(client_fd, request, location, fullPath, pathInfo, interpreter, root);
+
+            if (request.getStreamBody())
+                cgiHandler->setStreamedBody(request.getContentLength());
+
             connection.setCgiHandler(cgiHandler);
             if (!cgiHandler->startCGI()) {
-                response.beError(500, "Unable to start CGI Process");
+                response.beError(cgiHandler->getFailureStatus(), useUpstream ? "Unable to reach application upstream" : "Unable to start CGI Process");
             } else {
+                if (cacheable && request.getMethod() == "GET")
+                    connection.setCacheCapture(new ResponseCache::Capture(cacheTicket));
                 //?? Here is the leak !! But if i delete, it causes invalid read in Server ;ethods later, i have to find why...
                 // Invalid reads are located in
                 if (connection.getResponse())
@@ -389,8 +574,8 @@ void Server::handleGetOrPostRequest(int client_fd, ClientConnection& connection)
         }
     }
 
-    // Handle GET and POST methods
-    if (request.getMethod() == "GET") {
+    // Handle GET, HEAD and POST methods
+    if (request.getMethod() == "GET" || request.getMethod() == "HEAD") {
         // Serve the static file
         Logger::instance().log(DEBUG, "Serving static file for path: " + fullPath);
         serveStaticFile(client_fd, fullPath, response, request);
@@ -422,12 +607,13 @@ void Server::handleDeleteRequest(ClientConnection& connection) {
         Logger::instance().log(WARNING, "403 Forbidden on DELETE request for: " + fullPath);
         response.beError(403, "No permission to delete file : " + request.getPath());
     } else {
+        // Un lien vers un objet d'upload_dedup disparaît : l'objet est peut-être orphelin
+        const Location* location = _config.findLocation(request.getPath());
+        struct stat st;
+        if (location && location->uploadDedup && stat(fullPath.c_str(), &st) == 0 && st.st_nlink > 1)
+            ContentStore::markReclaimable(uploadDirFor(*location));
 		if (remove(fullPath.c_str()) == 0) {
 			response.setStatusCode(204);
-			response.setHeader("Content-Type", "text/html");
-			std::string body = "<html><body><h1>File deleted successfully</h1></body></html>";
-			response.setHeader("Content-Length", to_string(body.size()));
-			response.setBody(body);
             Logger::instance().log(INFO, "Successful DELETE on resource : " + fullPath);
 			//sendResponse(client_fd, response);
 		} else {
@@ -443,7 +629,8 @@ void Server::handleDeleteRequest(ClientConnection& connection) {
 void Server::serveStaticFile(int client_fd, const std::string& filePath,
                              HTTPResponse& response, const HTTPRequest& request) {
     struct stat pathStat;
-    if (stat(filePath.c_str(), &pathStat) == 0 && S_ISDIR(pathStat.st_mode)) {
+    bool exists = (stat(filePath.c_str(), &pathStat) == 0);
+    if (exists && S_ISDIR(pathStat.st_mode)) {
         // Vérifier s'il existe un fichier index
         Logger::instance().log(INFO, "Request File Path is a directory, searching for an index page...");
         std::string indexPath = filePath + "/" + _config.index;
@@ -474,6 +661,13 @@ void Server::serveStaticFile(int client_fd, const std::string& filePath,
                 response.beError(403);//Forbidden
             }
         }
+    } else if (exists && S_ISREG(pathStat.st_mode) && request.getMethod() == "HEAD" && access(filePath.c_str(), R_OK) == 0) {
+        // HEAD : stat() et access() suffisent, le fichier n'est jamais ouvert ni lu ;
+        // illisible, il retombe dans le 404 du GET
+        Logger::instance().log(INFO, "HEAD on static file found at: " + filePath);
+        response.setStatusCode(200);
+        response.setHeader("Content-Type", _config.mimeTypes.lookup(getFileExtension(filePath)));
+        response.setHeader("Content-Length", to_string(pathStat.st_size));
     } else {
         std::ifstream file(filePath.c_str(), std::ios::binary);
         if (file) {
@@ -485,24 +679,7 @@ void Server::serveStaticFile(int client_fd, const std::string& filePath,
             response.setStatusCode(200);
             response.setReasonPhrase("OK");
 
-            std::string contentType = "text/html";
-            size_t extPos = filePath.find_last_of('.');
-            if (extPos != std::string::npos) {
-                std::string extension = filePath.substr(extPos);
-                if (extension == ".css")
-                    contentType = "text/css";
-                else if (extension == ".js")
-                    contentType = "application/javascript";
-                else if (extension == ".png")
-                    contentType = "image/png";
-                else if (extension == ".jpg" || extension == ".jpeg")
-                    contentType = "image/jpeg";
-                else if (extension == ".gif")
-                    contentType = "image/gif";
-                // Vous pouvez ajouter d'autres types MIME si nécessaire
-            }
-
-            response.setHeader("Content-Type", contentType);
+            response.setHeader("Content-Type", _config.mimeTypes.lookup(getFileExtension(filePath)));
             response.setHeader("Content-Length", to_string(content.size()));
             response.setBody(content);
             Logger::instance().log(DEBUG, "Set-Cookie header: " + response.getStrHeader("Set-Cookie"));
@@ -550,15 +727,22 @@ void Server::handleClient(int client_fd, ClientConnection& connection) {
         // Une erreur a été détectée dans receiveRequest
         HTTPResponse* errorResponse = new HTTPResponse();
         errorResponse->beError(connection.getRequest()->getErrorCode());
+        // Le reste du corps n'est pas lu : la connexion ne peut pas resservir
+        errorResponse->setHeader("Connection", "close");
         if (connection.getResponse())
             delete connection.getResponse();
         connection.setResponse(errorResponse);
         connection.prepareResponse();
         return;
     }
-    if (!connection.getRequest()->isComplete()) {
-        // Request is incomplete, return and wait for more data
+    if (!connection.getRequest()->isComplete() && !checkExpectation(client_fd, connection))
         return;
+    if (!connection.getRequest()->isComplete()) {
+        // cgi_request_buffering off : le CGI démarre dès la fin des en-têtes ;
+        // un upload multipart s'écrit sur le disque à mesure qu'il arrive
+        if (!canStreamRequestBody(*connection.getRequest()) && !canStreamUpload(*connection.getRequest()))
+            return; // Request is incomplete, return and wait for more data
+        connection.getRequest()->setStreamBody(true);
     }
     if (!connection.getRequest()->parse()) {
         Logger::instance().log(ERROR, "Failed to parse client request on fd " + to_string(client_fd));
@@ -603,6 +787,27 @@ void Server::handleResponseSending(int client_fd, ClientConnection& connection)
     }
 }
 
+// Lit la sortie du CGI tant que le client suit (contre-pression) et la relaie
+// au fur et à mesure. Retourne 0 quand le CGI a fermé sa sortie.
+int Server::handleCGIOutput(int client_fd, ClientConnection& connection) {
+    CGIHandler* cgiHandler = connection.getCgiHandler();
+    if (!cgiHandler || cgiHandler->isOutputClosed())
+        return 0;
+
+    while (connection.getPendingOutputSize() < ClientConnection::OUTPUT_HIGH_WATERMARK) {
+        // cgi_splice on : read() ne sert plus qu'aux en-têtes et à la fin de sortie
+        if (connection.canSpliceCGIOutput() && connection.spliceCGIOutput(client_fd))
+            return 1;
+        int received = cgiHandler->readFromCGI();
+        connection.relayCGIOutput();
+        if (received == 0)
+            return 0;
+        if (received < 0)
+            break;
+    }
+    return 1;
+}
+
 std::string Server::generateDirectoryListing(const std::string& directoryPath, const std::string& requestPath) {
     std::string listing;
     listing += "<html><head><title>Index of " + requestPath + "</title></head><body>";
@@ -615,8 +820,8 @@ std::string Server::generateDirectoryListing(const std::string& directoryPath, c
         while ((entry = readdir(dir)) != NULL) {
             std::string name = entry->d_name;
 
-            // Ignorer les entrées spéciales "." et ".."
-            if (name == "." || name == "..")
+            // Ni "." et "..", ni les entrées cachées (état des uploads, temporaires)
+            if (name[0] == '.')
                 continue;
 
             std::string fullPath = requestPath;
@@ -649,13 +854,400 @@ const ServerConfig& Server::getConfig() const {return _config;}
 
 std::string Server::getFileExtension(const std::string& path) const {
     size_t dotPos = path.find_last_of('.');
-    if (dotPos != std::string::npos) {
+    size_t slashPos = path.find_last_of('/');
+    if (dotPos != std::string::npos && (slashPos == std::string::npos || dotPos > slashPos)) {
         return path.substr(dotPos); // Includes the dot
     }
     return "";
 }
 
 
+// "/cgi-bin/script.cgi/extra/path" : coupe après le premier segment qui est
+// un script CGI existant, le reste devient PATH_INFO
+bool Server::splitScriptPath(std::string& fullPath, std::string& pathInfo) const {
+    for (size_t slashPos = fullPath.find('/', 1); slashPos != std::string::npos; slashPos = fullPath.find('/', slashPos + 1)) {
+        std::string candidate = fullPath.substr(0, slashPos);
+        if (!hasCgiExtension(getFileExtension(candidate)))
+            continue;
+        struct stat st;
+        if (stat(candidate.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            pathInfo = fullPath.substr(slashPos);
+            fullPath = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Un segment du chemin porte une extension CGI (script éventuellement suivi
+// d'un PATH_INFO)
+bool Server::isCgiPath(const std::string& path) const {
+    size_t end = path.find('?');
+    if (end == std::string::npos)
+        end = path.size();
+    for (size_t slashPos = path.find('/', 1); slashPos < end; slashPos = path.find('/', slashPos + 1)) {
+        if (hasCgiExtension(getFileExtension(path.substr(0, slashPos))))
+            return true;
+    }
+    return hasCgiExtension(getFileExtension(path.substr(0, end)));
+}
+
+// cgi_max_concurrent : une requête vers un script de la location n'est
+// traitée qu'avec un slot libre. Retourne false tant qu'elle attend son tour,
+// ou si elle est refusée (la réponse 503 est alors prête).
+bool Server::admitCGIRequest(ClientConnection& connection) {
+    HTTPRequest& request = *connection.getRequest();
+    const Location* location = _config.findLocation(request.getPath());
+    if (!location || location->cgiMaxConcurrent <= 0 || !isCgiPath(request.getPath()))
+        return true;
+    // Réponse servie depuis cgi_cache : pas de CGI à attendre
+    if (ResponseCache::isCacheable(request, location)
+        && ResponseCache::instance().canServe(ResponseCache::makeTicket(request, *location), curr_time_ms()))
+        return true;
+
+    CGILimiter::Admission admission = CGILimiter::instance().admit(*location, &connection, curr_time_ms());
+    if (admission == CGILimiter::ADMITTED) {
+        connection.setCGISlot(location);
+        return true;
+    }
+    if (admission == CGILimiter::QUEUED) {
+        connection.setQueuedFor(location);
+        return false;
+    }
+
+    connection.setQueuedFor(NULL);
+    Logger::instance().log(WARNING, std::string("503 error (CGI queue ") + (admission == CGILimiter::REJECTED_FULL ? "full" : "timeout") + ") for " + request.getPath());
+    HTTPResponse* response = new HTTPResponse();
+    response->beError(503, "Too many CGI requests, please retry later.");
+    response->setHeader("Retry-After", to_string(std::max(1UL, location->cgiQueueTimeout / 1000)));
+    // Un corps reçu au fil de l'eau n'a pas été lu jusqu'au bout
+    bool keepAlive = !request.getStreamBody() && request.getStrHeader("Connection") != "close";
+    response->setHeader("Connection", keepAlive ? "keep-alive" : "close");
+    response->setHeader("Content-Length", to_string(response->getBody().size()));
+    if (connection.getResponse())
+        delete connection.getResponse();
+    connection.setResponse(response);
+    return false;
+}
+
+// upload_max_concurrent / upload_max_inflight : le corps d'un upload n'est
+// lu qu'une fois admis. Retourne false tant qu'il attend son tour (corps
+// laissé sur le socket), ou s'il est refusé (la réponse 503 est alors prête).
+bool Server::admitUpload(ClientConnection& connection) {
+    HTTPRequest& request = *connection.getRequest();
+    const Location* location = _config.findLocation(request.getPath());
+    if (!location || !UploadLimiter::isLimited(*location) || connection.hasUploadSlot()
+        || request.getContentLength() == 0 || !isUploadRequest(request, location))
+        return true;
+
+    UploadLimiter::Admission admission = UploadLimiter::instance().admit(*location, request.getContentLength(), &connection, curr_time_ms());
+    if (admission == UploadLimiter::ADMITTED) {
+        connection.setUploadSlot(location, request.getContentLength());
+        return true;
+    }
+    if (admission == UploadLimiter::QUEUED) {
+        connection.setUploadQueuedFor(location);
+        return false;
+    }
+
+    connection.setUploadQueuedFor(NULL);
+    Logger::instance().log(WARNING, std::string("503 error (upload queue ") + (admission == UploadLimiter::REJECTED_FULL ? "full" : "timeout") + ") for " + request.getPath());
+    HTTPResponse* response = new HTTPResponse();
+    response->beError(503, "Too many uploads in progress, please retry later.");
+    response->setHeader("Retry-After", to_string(std::max(1UL, location->uploadQueueTimeout / 1000)));
+    // Un corps reçu au fil de l'eau n'a pas été lu jusqu'au bout
+    bool keepAlive = !request.getStreamBody() && request.getStrHeader("Connection") != "close";
+    response->setHeader("Connection", keepAlive ? "keep-alive" : "close");
+    response->setHeader("Content-Length", to_string(response->getBody().size()));
+    if (connection.getResponse())
+        delete connection.getResponse();
+    connection.setResponse(response);
+    return false;
+}
+
+// Expect (RFC 9110, 10.1.1) : dès la fin des en-têtes, la requête est soit
+// refusée (réponse finale, corps jamais lu), soit acceptée ; le 100 Continue
+// part quand le corps va être lu (tout de suite s'il est mis en mémoire,
+// sinon une fois l'upload ou le CGI lancé, donc après une éventuelle file).
+// Retourne false si la réponse finale est prête.
+bool Server::checkExpectation(int client_fd, ClientConnection& connection) {
+    HTTPRequest& request = *connection.getRequest();
+    if (!request.getHeadersParsed() || !request.hasHeader("Expect") || request.getExpectHandled())
+        return true;
+
+    std::string expectation = request.getStrHeader("Expect");
+    for (size_t i = 0; i < expectation.size(); ++i)
+        expectation[i] = std::tolower(static_cast<unsigned char>(expectation[i]));
+    HTTPResponse* response = new HTTPResponse();
+    if (expectation != "100-continue") {
+        Logger::instance().log(WARNING, "417 error (Expectation Failed): " + request.getStrHeader("Expect"));
+        response->beError(417);
+    } else if (!rejectBeforeBody(request, *response)) {
+        delete response;
+        if (!canStreamRequestBody(request) && !canStreamUpload(request))
+            sendContinue(client_fd, request);
+        return true;
+    }
+
+    request.setExpectHandled(true);
+    response->setHeader("Connection", "close");
+    if (response->getStrHeader("Content-Length").empty())
+        response->setHeader("Content-Length", to_string(response->getBody().size()));
+    if (connection.getResponse())
+        delete connection.getResponse();
+    connection.setResponse(response);
+    connection.prepareResponse();
+    return false;
+}
+
+// Répertoires d'état tenus dans upload_path (uploads reprenables, objets
+// d'upload_dedup) : jamais servis, listés ni
+// modifiés par une requête (les ids d'upload y seraient lisibles)
+bool Server::isReservedPath(const std::string& path) {
+    size_t start = 0;
+    while (start < path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos)
+            end = path.size();
+        if (path.compare(start, end - start, ".resumable") == 0 || path.compare(start, end - start, ".objects") == 0)
+            return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+// Refus décidables sur les seuls en-têtes (la taille est déjà vérifiée par
+// parseRawRequest) ; retourne true si `response` est remplie
+bool Server::rejectBeforeBody(const HTTPRequest& request, HTTPResponse& response) const {
+    const Location* location = _config.findLocation(request.getPath());
+    std::string method = request.getMethod();
+    // HEAD suit les droits de GET, comme dans handleHttpRequest
+    std::string rights = method == "HEAD" ? "GET" : method;
+    if (location && !location->allowedMethods.empty()
+        && std::find(location->allowedMethods.begin(), location->allowedMethods.end(), method) == location->allowedMethods.end()
+        && std::find(location->allowedMethods.begin(), location->allowedMethods.end(), rights) == location->allowedMethods.end()) {
+        Logger::instance().log(WARNING, "405 error (Method Not Allowed) before body for " + request.getPath());
+        response.beError(405);
+        return true;
+    }
+    if (location && location->returnCode != 0) {
+        response.setStatusCode(location->returnCode);
+        response.setHeader("Location", location->returnUrl);
+        return true;
+    }
+    if (isReservedPath(request.getPath())) {
+        response.beError(404);
+        return true;
+    }
+    if (method != "GET" && method != "HEAD" && method != "POST" && method != "PUT" && method != "DELETE"
+        && !(location && ResumableUpload::isResumableRequest(request, *location))) {
+        response.beError(501);
+        return true;
+    }
+    if (method == "PUT" && (!location || !location->uploadOn)) {
+        Logger::instance().log(WARNING, "405 error (Method Not Allowed): PUT outside of an upload location.");
+        response.beError(405);
+        return true;
+    }
+    std::string uploadDir;
+    return isUploadRequest(request, location) && !resolveUploadDir(location, response, uploadDir);
+}
+
+void Server::sendContinue(int client_fd, HTTPRequest& request) {
+    if (request.getExpectHandled() || !request.hasHeader("Expect") || request.getBodyReceived() >= request.getContentLength())
+        return;
+    request.setExpectHandled(true);
+    static const char interim[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    // Rien n'a encore été envoyé sur ce socket : les 25 octets partent d'un coup
+    if (write(client_fd, interim, sizeof(interim) - 1) != static_cast<ssize_t>(sizeof(interim) - 1))
+        Logger::instance().log(WARNING, "Failed to send 100 Continue on fd " + to_string(client_fd));
+    else
+        Logger::instance().log(DEBUG, "100 Continue sent on fd " + to_string(client_fd));
+}
+
+// cgi_cache_lock_timeout : tant qu'un GET identique attend déjà la sortie de
+// son CGI, la requête attend sa réponse plutôt que de lancer le sien.
+// Retourne false pendant l'attente.
+bool Server::awaitCoalescedRequest(ClientConnection& connection) {
+    HTTPRequest& request = *connection.getRequest();
+    const Location* location = _config.findLocation(request.getPath());
+    connection.setAwaitingFlight(false);
+    if (request.getMethod() != "GET" || !ResponseCache::isCacheable(request, location)
+        || !location->cgiCacheLockTimeout || !isCgiPath(request.getPath()))
+        return true;
+
+    ResponseCache::Ticket ticket = ResponseCache::makeTicket(request, *location);
+    unsigned long now = curr_time_ms();
+    if (ResponseCache::instance().canServe(ticket, now)) {
+        ResponseCache::instance().releaseFlight(&connection);
+        return true;
+    }
+    if (ResponseCache::instance().joinFlight(ticket, &connection, now) != ResponseCache::WAIT)
+        return true;
+    connection.setAwaitingFlight(true);
+    return false;
+}
+
+// En-têtes reçus, corps en cours : on peut lancer le CGI tout de suite si la
+// location l'autorise (POST vers un script, hors upload multipart)
+bool Server::canStreamRequestBody(const HTTPRequest& request) const {
+    if (!request.getHeadersParsed() || request.getStreamBody() || request.getContentLength() == 0)
+        return false;
+    if (request.getMethod() != "POST")
+        return false;
+    const Location* location = _config.findLocation(request.getPath());
+    if (!location || location->cgiRequestBuffering)
+        return false;
+    if (location->uploadOn && request.getStrHeader("Content-Type").find("multipart/form-data") != std::string::npos)
+        return false;
+    return isCgiPath(request.getPath());
+}
+
+// Lit le corps de la requête directement vers l'entrée du CGI, tant que
+// celui-ci suit. Retourne false si le client est parti.
+bool Server::receiveCGIBody(int client_fd, ClientConnection& connection) {
+    CGIHandler* cgiHandler = connection.getCgiHandler();
+    char buffer[16384];
+
+    while (cgiHandler->isAwaitingBody() && cgiHandler->getPendingInputSize() < ClientConnection::INPUT_HIGH_WATERMARK) {
+        ssize_t spliced = cgiHandler->spliceInput(client_fd);
+        if (spliced > 0)
+            continue;
+        if (spliced < 0)
+            break; // Pipe plein : on reprendra sur son POLLOUT
+        size_t toRead = std::min(sizeof(buffer), cgiHandler->getRemainingBody());
+        ssize_t bytesRead = read(client_fd, buffer, toRead);
+        if (bytesRead > 0) {
+            cgiHandler->appendInput(buffer, bytesRead);
+        } else if (bytesRead == 0) {
+            Logger::instance().log(WARNING, "Client closed the connection during CGI body upload: FD " + to_string(client_fd));
+            return false;
+        } else {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            Logger::instance().log(ERROR, std::string("Error reading CGI body from client: ") + strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+// POST multipart/form-data ou PUT vers une location upload_on, ou PATCH d'un
+// upload reprenable : le corps est écrit sur le disque au fil de sa réception
+bool Server::canStreamUpload(const HTTPRequest& request) const {
+    if (!request.getHeadersParsed() || request.getStreamBody() || request.getContentLength() == 0)
+        return false;
+    return isUploadRequest(request, _config.findLocation(request.getPath()));
+}
+
+bool Server::isUploadRequest(const HTTPRequest& request, const Location* location) const {
+    if (!location || !location->uploadOn)
+        return false;
+    if (request.getMethod() == "PUT")
+        return true;
+    if (request.getMethod() == "PATCH")
+        return ResumableUpload::isResumableRequest(request, *location);
+    if (request.getMethod() != "POST")
+        return false;
+    std::string contentType = request.getStrHeader("Content-Type");
+    return contentType.find("multipart/form-data") != std::string::npos && !multipartBoundary(contentType).empty();
+}
+
+// Lit la suite du corps d'un upload et la donne à son flux, dans la
+// limite de READ_BUDGET par passage. Retourne false si le client est parti.
+bool Server::receiveUploadBody(int client_fd, ClientConnection& connection) {
+    UploadStream* upload = connection.getUpload();
+    char buffer[65536];
+    size_t budget = UploadStream::READ_BUDGET;
+
+    while (upload->getRemainingBody() > 0 && !upload->hasFailed() && budget > 0) {
+        size_t toRead = std::min(sizeof(buffer), upload->getRemainingBody());
+        ssize_t bytesRead = read(client_fd, buffer, toRead);
+        if (bytesRead > 0) {
+            upload->feed(buffer, bytesRead);
+            budget -= std::min(budget, static_cast<size_t>(bytesRead));
+        } else if (bytesRead == 0) {
+            Logger::instance().log(WARNING, "Client closed the connection during file upload: FD " + to_string(client_fd));
+            return false;
+        } else {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            Logger::instance().log(ERROR, std::string("Error reading upload body from client: ") + strerror(errno));
+            return false;
+        }
+    }
+    if (upload->getRemainingBody() == 0 || upload->hasFailed())
+        finishUpload(connection);
+    return true;
+}
+
+// Handler prêt à lancer, avec les réglages de la location (spawner, splice,
+// limites) et le contexte de la requête
+CGIHandler* Server::createCGIHandler(int client_fd, const HTTPRequest& request, const Location* location, const std::string& scriptPath,
+                                     const std::string& pathInfo, const std::string& interpreter, const std::string& root) const {
+    CGIHandler* cgiHandler;
+    if (location && !location->fastcgiPass.empty()) {
+        cgiHandler = new FastCGIHandler(scriptPath, location->fastcgiPass, request);
+    } else if (location && !location->scgiPass.empty()) {
+        cgiHandler = new SCGIHandler(scriptPath, location->scgiPass, SCGIHandler::SCGI, request);
+    } else if (location && !location->uwsgiPass.empty()) {
+        cgiHandler = new SCGIHandler(scriptPath, location->uwsgiPass, SCGIHandler::UWSGI, request);
+    } else {
+        cgiHandler = new CGIHandler(scriptPath, interpreter, request);
+        cgiHandler->setUseSpawner(_config.cgiSpawner);
+        if (location) {
+            cgiHandler->setPipeOptions(location->cgiSplice, location->cgiPipeSize);
+            CGIResourceLimits limits;
+            limits.cpuSeconds = location->cgiRlimitCpu;
+            limits.addressSpace = location->cgiRlimitAs;
+            limits.openFiles = location->cgiRlimitNofile;
+            limits.nice = location->cgiNice;
+            cgiHandler->setResourceLimits(limits);
+        }
+    }
+    if (location)
+        cgiHandler->setLimits(location->cgiReadTimeout, location->cgiSendTimeout, location->cgiMaxOutput);
+    CGIContext context;
+    context.staticEnv = location ? &location->cgiStaticEnv : &_config.cgiStaticEnv;
+    context.scriptName = request.getPath().substr(0, request.getPath().size() - pathInfo.size());
+    context.pathInfo = pathInfo;
+    context.documentRoot = root;
+    context.location = location ? location->path : "";
+    context.serverName = _config.serverNames.empty() ? "" : _config.serverNames[0];
+    context.requestId = requestIdFor(request);
+    fillSocketAddresses(client_fd, context);
+    cgiHandler->setContext(context);
+    return cgiHandler;
+}
+
+// X-Request-Id du client s'il est raisonnable, sinon horodatage et compteur
+// en hexadécimal : unique pour la vie du process
+std::string Server::requestIdFor(const HTTPRequest& request) {
+    static unsigned long counter = 0;
+    std::string id = request.getStrHeader("X-Request-Id");
+    bool valid = !id.empty() && id.size() <= 128;
+    for (size_t i = 0; valid && i < id.size(); ++i)
+        valid = std::isalnum(static_cast<unsigned char>(id[i])) || id[i] == '-' || id[i] == '_' || id[i] == '.';
+    if (valid)
+        return id;
+    std::ostringstream generated;
+    generated << std::hex << curr_time_ms() << '-' << ++counter;
+    return generated.str();
+}
+
+// REMOTE_ADDR/REMOTE_PORT et SERVER_PORT de la connexion
+void Server::fillSocketAddresses(int client_fd, CGIContext& context) const {
+    sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getpeername(client_fd, reinterpret_cast<sockaddr*>(&addr), &len) == 0 && addr.sin_family == AF_INET) {
+        context.remoteAddr = inet_ntoa(addr.sin_addr);
+        context.remotePort = ntohs(addr.sin_port);
+    }
+    len = sizeof(addr);
+    if (getsockname(client_fd, reinterpret_cast<sockaddr*>(&addr), &len) == 0 && addr.sin_family == AF_INET)
+        context.serverPort = ntohs(addr.sin_port);
+}
+
 std::string Server::getInterpreterForExtension(const std::string& extension, const Location* location) const {
     Logger::instance().log(DEBUG, "Looking for interpreter for extension: '" + extension + "'");
 
@@ -18,11 +18,14 @@
 #include "ClientConnection.hpp"
 
 class Socket;
+class UploadStream;
 
 class Server
 {
 private:
     const ServerConfig& _config;
+    // Dernier passage de sweepUploads
+    unsigned long _lastUploadSweep;
 
     void receiveRequest(int client_fd, HTTPRequest& request);
     void sendResponse(int client_fd, HTTPResponse response);
@@ -30,7 +33,13 @@ private:
     // void handleDeleteRequest(const HTTPRequest& request);
     void handleDeleteRequest(ClientConnection& connection);
     void serveStaticFile(int client_fd, const std::string& filePath, HTTPResponse& response, const HTTPRequest& request);
-    void handleFileUpload(const HTTPRequest& request, HTTPResponse& response, const std::string& boundary);
+    bool resolveUploadDir(const Location* location, HTTPResponse& response, std::string& uploadDir) const;
+    std::string uploadDirFor(const Location& location) const;
+    void handleFileUpload(ClientConnection& connection, const std::string& boundary);
+    void handleResumableUpload(ClientConnection& connection, const Location& location);
+    void handlePutRequest(ClientConnection& connection, const Location* location);
+    void streamUpload(ClientConnection& connection, UploadStream* upload, const Location& location);
+    void finishUpload(ClientConnection& connection);
 	bool isPathAllowed(const std::string& path, const std::string& uploadPath);
 	std::string sanitizeFilename(const std::string& filename);
 	std::string generateDirectoryListing(const std::string& directoryPath, const std::string& requestPath);
@@ -40,6 +49,23 @@ private:
     bool hasCgiExtension(const std::string& extension) const;
     bool endsWith(const std::string& str, const std::string& suffix) const;
 	std::string getInterpreterForExtension(const std::string& extension, const Location* location) const;
+    bool splitScriptPath(std::string& fullPath, std::string& pathInfo) const;
+    bool isCgiPath(const std::string& path) const;
+    bool canStreamRequestBody(const HTTPRequest& request) const;
+    bool canStreamUpload(const HTTPRequest& request) const;
+    bool isUploadRequest(const HTTPRequest& request, const Location* location) const;
+    static bool isReservedPath(const std::string& path);
+    static std::string multipartBoundary(const std::string& contentType);
+    bool admitCGIRequest(ClientConnection& connection);
+    bool admitUpload(ClientConnection& connection);
+    bool checkExpectation(int client_fd, ClientConnection& connection);
+    bool rejectBeforeBody(const HTTPRequest& request, HTTPResponse& response) const;
+    void sendContinue(int client_fd, HTTPRequest& request);
+    bool awaitCoalescedRequest(ClientConnection& connection);
+    void fillSocketAddresses(int client_fd, CGIContext& context) const;
+    static std::string requestIdFor(const HTTPRequest& request);
+    CGIHandler* createCGIHandler(int client_fd, const HTTPRequest& request, const Location* location, const std::string& scriptPath,
+                                 const std::string& pathInfo, const std::string& interpreter, const std::string& root) const;
 public:
     // Constructeur pour inclure ServerConfig
     Server(const ServerConfig& config);
@@ -53,7 +79,12 @@ public:
     // Gérer les requêtes d'un client connecté
     void handleClient(int client_fd, ClientConnection& connection);
     void handleResponseSending(int client_fd, ClientConnection& connection);
+    int handleCGIOutput(int client_fd, ClientConnection& connection);
+    bool receiveCGIBody(int client_fd, ClientConnection& connection);
+    bool receiveUploadBody(int client_fd, ClientConnection& connection);
     const ServerConfig& getConfig() const;
+    // Boucle principale : uploads reprenables expirés, objets orphelins
+    void sweepUploads(unsigned long now);
 	std::string getFileExtension(const std::string& path) const;
 };
 
@@ -1,9 +1,34 @@
 #include "ServerConfig.hpp"
 #include "Logger.hpp"
+#include "SessionStore.hpp"
 #include <iostream>
 #include <cstring>
+#include "Utils.hpp"
 
-ServerConfig::ServerConfig() : index("index.html"), host("0.0.0.0"), clientMaxBodySize(0), autoindex(false) {
+namespace {
+	// Variables CGI qui ne dépendent pas de la requête (RFC 3875), complétées
+	// ou remplacées par les cgi_param
+	std::vector<std::string> staticCGIEnvironment(const std::string& documentRoot, const std::map<std::string, std::string>& params) {
+		std::map<std::string, std::string> env;
+		env["GATEWAY_INTERFACE"] = "CGI/1.1";
+		env["SERVER_SOFTWARE"] = "webserv/1.0";
+		env["SERVER_PROTOCOL"] = "HTTP/1.1";
+		env["REDIRECT_STATUS"] = "200";
+		env["DOCUMENT_ROOT"] = absolutePath(documentRoot);
+		// L'environnement du serveur n'est plus hérité : chemin de recherche par défaut
+		env["PATH"] = "/usr/local/bin:/usr/bin:/bin";
+		for (std::map<std::string, std::string>::const_iterator it = params.begin(); it != params.end(); ++it)
+			env[it->first] = it->second;
+
+		std::vector<std::string> envp;
+		envp.reserve(env.size());
+		for (std::map<std::string, std::string>::const_iterator it = env.begin(); it != env.end(); ++it)
+			envp.push_back(it->first + "=" + it->second);
+		return envp;
+	}
+}
+
+ServerConfig::ServerConfig() : index("index.html"), host("0.0.0.0"), clientMaxBodySize(0), autoindex(false), cgiSpawner(false), cgiCacheMaxSize(0), sessionFlushInterval(SessionStore::DEFAULT_FLUSH_INTERVAL), sessionHistorySize(SessionStore::DEFAULT_HISTORY_SIZE), sessionMaxEntries(SessionStore::DEFAULT_MAX_ENTRIES) {
 	serverNames.push_back("localhost");
 }
 
@@ -18,6 +43,14 @@ ServerConfig::ServerConfig(const ServerConfig& other) {
 	cgiExtensions = other.cgiExtensions;
 	clientMaxBodySize = other.clientMaxBodySize;
 	cgiInterpreters = other.cgiInterpreters;
+	mimeTypes = other.mimeTypes;
+	cgiSpawner = other.cgiSpawner;
+	cgiCacheMaxSize = other.cgiCacheMaxSize;
+	sessionFlushInterval = other.sessionFlushInterval;
+	sessionHistorySize = other.sessionHistorySize;
+	sessionMaxEntries = other.sessionMaxEntries;
+	cgiParams = other.cgiParams;
+	cgiStaticEnv = other.cgiStaticEnv;
 }
 
 
@@ -52,12 +85,32 @@ ServerConfig& ServerConfig::operator=(const ServerConfig& other) {
 		clientMaxBodySize = other.clientMaxBodySize;
 		autoindex = other.autoindex;
 		cgiInterpreters = other.cgiInterpreters;
+		mimeTypes = other.mimeTypes;
+		cgiSpawner = other.cgiSpawner;
+		cgiCacheMaxSize = other.cgiCacheMaxSize;
+		sessionFlushInterval = other.sessionFlushInterval;
+		sessionHistorySize = other.sessionHistorySize;
+		sessionMaxEntries = other.sessionMaxEntries;
+		cgiParams = other.cgiParams;
+		cgiStaticEnv = other.cgiStaticEnv;
 	}
 	return *this;
 }
 
 ServerConfig::~ServerConfig() {}
 
+// Appelé en fin de bloc server, une fois root, locations et cgi_param connus
+void ServerConfig::buildCGIEnvironment() {
+	cgiStaticEnv = staticCGIEnvironment(root, cgiParams);
+	for (size_t i = 0; i < locations.size(); ++i) {
+		std::map<std::string, std::string> params = cgiParams;
+		for (std::map<std::string, std::string>::const_iterator it = locations[i].cgiParams.begin(); it != locations[i].cgiParams.end(); ++it)
+			params[it->first] = it->second;
+		const std::string& documentRoot = locations[i].root.empty() ? root : locations[i].root;
+		locations[i].cgiStaticEnv = staticCGIEnvironment(documentRoot, params);
+	}
+}
+
 bool ServerConfig::isValid() const {
 	if (ports.empty()) {
 		Logger::instance().log(ERROR, "Erreur : Aucun port n'est spécifié.");
@@ -3,6 +3,7 @@
 #define SERVERCONFIG_HPP
 
 #include "Location.hpp"
+#include "MimeTypes.hpp"
 #include <string>
 #include <vector>
 #include <map>
@@ -18,10 +19,23 @@ public:
     std::string host;
     int clientMaxBodySize;
     bool autoindex;
+    // Scripts CGI lancés par le helper CGISpawner plutôt que par fork()
+    bool cgiSpawner;
+    // Taille du cache de réponses CGI, partagé par tous les serveurs (0 : défaut)
+    size_t cgiCacheMaxSize;
+    // Délai d'écriture des sessions modifiées, en ms (voir SessionStore)
+    unsigned long sessionFlushInterval;
+    // Pages gardées dans l'historique de chaque session
+    size_t sessionHistorySize;
+    // Sessions gardées en mémoire au plus
+    size_t sessionMaxEntries;
 
     // Ajout d'un vecteur pour les extensions CGI
     std::vector<std::string> cgiExtensions;
 
+    // Types MIME des fichiers statiques (défauts + bloc `types {}`)
+    MimeTypes mimeTypes;
+
     ServerConfig();
     ServerConfig(const ServerConfig& other);
     ServerConfig& operator=(const ServerConfig& other);
@@ -32,6 +46,12 @@ public:
 
 	std::map<std::string, std::string> cgiInterpreters;
 
+	// cgi_param du serveur et environnement CGI statique, hérité par les
+	// locations (voir buildCGIEnvironment)
+	std::map<std::string, std::string> cgiParams;
+	std::vector<std::string> cgiStaticEnv;
+	void buildCGIEnvironment();
+
 	const std::string& getHost() const;
     const std::vector<int>& getPorts() const;
 
@@ -1,7 +1,7 @@
 // Si possible, inclure une bibliothèque de hachage MD5 ou SHA1
 #include "SessionManager.hpp"
 
-SessionManager::SessionManager(std::string session_id) {
+SessionManager::SessionManager(std::string session_id) : _session(NULL) {
     if (session_id.size() > 0) {
         _session_id = session_id;
         _first_con = false;
@@ -16,7 +16,7 @@ SessionManager::SessionManager(std::string session_id) {
 }
 
 
-SessionManager::SessionManager()
+SessionManager::SessionManager() : _first_con(true), _session(NULL)
 {
 	_session_id = generateUUID();
 }
@@ -66,21 +66,25 @@ std::string SessionManager::generateUUID() {
 	return (uuid.str());
 }
 
-void SessionManager::setData(const std::string& key, const std::string& value, bool append) {
-    if (append && _session_data.find(key) != _session_data.end()) {
-        _session_data[key] += ", " + value;  // Ajout de la nouvelle valeur
-    }
-    else {
-        _session_data[key] = value;
-    }
-    Logger::instance().log(INFO, "Data set in session: " + key + " = " + _session_data[key]);
+void SessionManager::setData(const std::string& key, const std::string& value) {
+    _session->data[key] = value;
+    Logger::instance().log(INFO, "Data set in session: " + key + " = " + value);
+}
+
+// Historique borné : seules les session_history_size dernières pages restent
+void SessionManager::recordRequest(const std::string& method, const std::string& path) {
+    ++_session->requests;
+    _session->record(method + " " + path, SessionStore::instance().getHistorySize());
+    Logger::instance().log(INFO, "Request recorded in session: " + method + " " + path);
 }
 
 
     
 std::string SessionManager::getData(const std::string& key) const {
-    std::map<std::string, std::string>::const_iterator it = _session_data.find(key);
-    if (it != _session_data.end()) {
+    if (!_session)
+        return "";
+    std::map<std::string, std::string>::const_iterator it = _session->data.find(key);
+    if (it != _session->data.end()) {
            return it->second;
     }
     return ""; // Return empty string if key is not found
@@ -95,96 +99,14 @@ bool SessionManager::getFirstCon() const {
 }
 
 
-std::string cleanValue(const std::string& value) {
-    
-    if (value.empty())
-        return value;
-
-    size_t start = 0;
-    size_t end = value.size();
-
-    while (start < end && isspace(value[start]))
-        ++start;
-    while (end > start && isspace(value[end - 1]))
-        --end;
-    return (value.substr(start, end - start));
-}
-
+// Aucune écriture ici : SessionStore écrit les sessions modifiées par lots
 void SessionManager::persistSession() {
-    std::string filepath = "sessions/" + _session_id + ".txt"; // Définition du chemin de fichier
-
-    // Avant d'écrire dans le file, nettoie les données
-    for (std::map<std::string, std::string>::iterator it = _session_data.begin(); it != _session_data.end(); ++it) {
-        it->second = cleanValue(it->second);
-    }
-
-    // Ouvre le fichier en mode ajout
-    std::ofstream file(filepath.c_str(), std::ios::app);
-    if (!file.is_open()) {
-        std::cerr << "Erreur : impossible de sauvegarder la session dans " << filepath << std::endl;
-        return;
-    }
-
-    // Ajoute une ligne vide avant [General] si le fichier n'est pas vide
-    file.seekp(0, std::ios::end); // Place le curseur à la fin
-    if (file.tellp() > 0) {
-        file << "\n"; // Ajoute une ligne vide
-    }
-
-    // Écrit les nouvelles données sous [General]
-    file << "[General]\n";
-    if (_session_data.find("last_access_time") != _session_data.end()) {
-        file << "last_access_time=" << cleanValue(curr_time()) << "\n";
-    }
-    if (_session_data.find("status") != _session_data.end()) {
-        file << "status=" << cleanValue(_session_data["status"]) << "\n";
-    }
-    if (_session_data.find("user_agent") != _session_data.end()) {
-        file << "user_agent=" << cleanValue(_session_data["user_agent"]) << "\n";
-    }
-
-    file << "\n[Requests]\n";
-
-    // Écrit les nouvelles données sous [Requests]
-    if (_session_data.find("requested_pages") != _session_data.end()) {
-        file << "Pages=" << cleanValue(_session_data["requested_pages"]) << "\n";
-    }
-    if (_session_data.find("methods") != _session_data.end()) {
-        file << "Methods=" << cleanValue(_session_data["methods"]) << "\n";
-    }
-
-    file.close();
+    SessionStore::instance().markDirty(_session_id);
 }
 
 void SessionManager::loadSession() {
-
-    std::string filepath = "sessions/" + _session_id + ".txt";
-    std::ifstream file(filepath.c_str());
-    if (!file.is_open()) {
-        _first_con = true; // Première connexion si aucun fichier existant
-        return;
-    }
-
-    _first_con = false;
-
-    std::string line, current_section;
-    while (std::getline(file, line)) {
-        if (line.empty() || line[0] == '#') // Ignore lignes vides ou commentaires
-            continue;
-        if (line[0] == '[' && line[line.size() - 1] == ']') {
-            current_section = line.substr(1, line.size() - 2);
-            continue;
-        }
-
-        size_t delimiter_pos = line.find('=');
-        if (delimiter_pos != std::string::npos) {
-            std::string key = line.substr(0, delimiter_pos);
-            std::string value = line.substr(delimiter_pos + 1);
-            _session_data[key] = value;
-        }
-    }
-
-    file.close();
+    // _first_con vaut encore true si l'id vient d'être généré
+    _session = &SessionStore::instance().acquire(_session_id, _first_con, _first_con, curr_time_ms());
 }
 
 
@@ -216,20 +138,17 @@ void    SessionManager::manageUserSession(HTTPRequest* request, HTTPResponse* re
     }
 
     // Mise à jour des informations
-    session.setData("last_access_time", to_string(session.curr_time()), true);
+    session.setData("last_access_time", to_string(session.curr_time()));
     std::string path = request->getPath();
     std::string method = request->getMethod();
     std::string user_agent = request->getStrHeader("User-Agent");
 
-    if (!path.empty())
-        session.setData("requested_pages", path, true);
-    else
+    if (path.empty())
         Logger::instance().log(WARNING, "Request path is empty for client fd: " + to_string(client_fd));
-
-    if (!method.empty())
-        session.setData("methods", method, true);
-    else
+    else if (method.empty())
         Logger::instance().log(WARNING, "Request method is empty for client fd: " + to_string(client_fd));
+    else
+        session.recordRequest(method, path);
 
     if (user_agent.empty())
         user_agent = "Unknown"; // By default
@@ -3,6 +3,7 @@
 #include "Logger.hpp"
 #include "HTTPRequest.hpp"
 #include "HTTPResponse.hpp"
+#include "SessionStore.hpp"
 #include <string>
 #include <cstring>
 #include <sstream>
@@ -21,8 +22,10 @@ class SessionManager
 private:
 	std::string		_session_id;
 	bool			_first_con;
-	std::map<std::string, std::string> _session_data;
-	void setData(const std::string& key, const std::string& value, bool append = false);
+	// Session tenue par SessionStore, valable le temps de la requête
+	SessionStore::Session*	_session;
+	void setData(const std::string& key, const std::string& value);
+	void recordRequest(const std::string& method, const std::string& path);
 	void manageUserSession(HTTPRequest* request, HTTPResponse* response, int client_fd, SessionManager& session);
 	void	persistSession();
 	void	loadSession();
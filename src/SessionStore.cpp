@@ -0,0 +1,330 @@
+// SessionStore.cpp
+#include "SessionStore.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <stdio.h>
+#include "Logger.hpp"
+#include "Metrics.hpp"
+#include "Utils.hpp"
+
+namespace {
+    // Première ligne des fichiers au format compact
+    const char* const RECORD_HEADER = "# webserv session 1";
+
+    // Une valeur tient sur une ligne du fichier
+    std::string cleanValue(const std::string& value) {
+        size_t start = 0;
+        size_t end = value.size();
+        while (start < end && isspace(static_cast<unsigned char>(value[start])))
+            ++start;
+        while (end > start && isspace(static_cast<unsigned char>(value[end - 1])))
+            --end;
+        std::string clean = value.substr(start, end - start);
+        for (size_t i = 0; i < clean.size(); ++i) {
+            if (clean[i] == '\r' || clean[i] == '\n')
+                clean[i] = ' ';
+        }
+        return clean;
+    }
+
+    std::vector<std::string> splitList(const std::string& value) {
+        std::vector<std::string> items;
+        if (value.empty())
+            return items;
+        for (size_t start = 0; ; ) {
+            size_t end = value.find(", ", start);
+            items.push_back(cleanValue(value.substr(start, end == std::string::npos ? std::string::npos : end - start)));
+            if (end == std::string::npos)
+                return items;
+            start = end + 2;
+        }
+    }
+}
+
+void SessionStore::Session::record(const std::string& visit, size_t capacity) {
+    if (history.size() < capacity) {
+        history.push_back(visit);
+        return;
+    }
+    // Anneau plein (ou réduit depuis l'écriture du fichier) : on écrase le plus ancien
+    if (history.size() > capacity) {
+        history = pages();
+        history.erase(history.begin(), history.end() - capacity);
+        next = 0;
+    }
+    if (capacity == 0)
+        return;
+    history[next] = visit;
+    next = (next + 1) % capacity;
+}
+
+std::vector<std::string> SessionStore::Session::pages() const {
+    std::vector<std::string> ordered(history.begin() + next, history.end());
+    ordered.insert(ordered.end(), history.begin(), history.begin() + next);
+    return ordered;
+}
+
+SessionStore::SessionStore()
+    : _maxEntries(DEFAULT_MAX_ENTRIES), _dirtyCount(0), _flushInterval(DEFAULT_FLUSH_INTERVAL), _lastFlush(0),
+      _historySize(DEFAULT_HISTORY_SIZE), _lastCompaction(0) {}
+
+SessionStore& SessionStore::instance() {
+    static SessionStore store;
+    return store;
+}
+
+void SessionStore::setFlushInterval(unsigned long interval) {
+    _flushInterval = interval;
+}
+
+void SessionStore::setHistorySize(size_t historySize) {
+    _historySize = historySize;
+}
+
+void SessionStore::setMaxEntries(size_t maxEntries) {
+    _maxEntries = maxEntries;
+}
+
+size_t SessionStore::getHistorySize() const {
+    return _historySize;
+}
+
+SessionStore::Session& SessionStore::acquire(const std::string& sessionId, bool generated, bool& firstConnection, unsigned long now) {
+    std::map<std::string, Entry>::iterator it = _sessions.find(sessionId);
+    if (it != _sessions.end()) {
+        firstConnection = false;
+        _lru.splice(_lru.begin(), _lru, it->second.lru);
+    } else {
+        evict();
+        it = _sessions.insert(std::make_pair(sessionId, Entry())).first;
+        _lru.push_front(sessionId);
+        it->second.lru = _lru.begin();
+        // Seul accès disque côté requête : une fois par session connue et par processus
+        bool legacy = false;
+        firstConnection = generated || !load(sessionId, it->second.session, legacy);
+        if (legacy) {
+            it->second.dirty = true;
+            ++_dirtyCount;
+        }
+        publish();
+    }
+    it->second.lastAccess = now;
+    return it->second.session;
+}
+
+// Place pour une entrée de plus : les moins récemment utilisées sortent,
+// écrites d'abord si nécessaire (seule écriture possible côté requête,
+// quand le plafond est atteint avant le prochain lot)
+void SessionStore::evict() {
+    while (!_lru.empty() && _sessions.size() >= _maxEntries) {
+        std::map<std::string, Entry>::iterator it = _sessions.find(_lru.back());
+        if (it->second.dirty) {
+            write(it->first, it->second.session);
+            Metrics::instance().increment("session_writes_total");
+        }
+        drop(it);
+        Metrics::instance().increment("session_evictions_total");
+    }
+}
+
+void SessionStore::drop(std::map<std::string, Entry>::iterator it) {
+    if (it->second.dirty)
+        --_dirtyCount;
+    _lru.erase(it->second.lru);
+    _sessions.erase(it);
+}
+
+void SessionStore::markDirty(const std::string& sessionId) {
+    std::map<std::string, Entry>::iterator it = _sessions.find(sessionId);
+    if (it == _sessions.end() || it->second.dirty)
+        return;
+    it->second.dirty = true;
+    ++_dirtyCount;
+}
+
+void SessionStore::flush(unsigned long now) {
+    compact(now);
+    if (now - _lastFlush < _flushInterval)
+        return;
+    size_t written = 0;
+    std::map<std::string, Entry>::iterator it = _sessions.begin();
+    while (it != _sessions.end()) {
+        Entry& entry = it->second;
+        if (entry.dirty && written < FLUSH_BATCH) {
+            write(it->first, entry.session);
+            entry.dirty = false;
+            --_dirtyCount;
+            ++written;
+        }
+        if (!entry.dirty && now - entry.lastAccess >= IDLE_TIMEOUT)
+            drop(it++);
+        else
+            ++it;
+    }
+    // Lot plein : le reste part au tour suivant plutôt qu'après un intervalle
+    if (_dirtyCount == 0)
+        _lastFlush = now;
+    if (written)
+        Metrics::instance().increment("session_writes_total", written);
+    publish();
+}
+
+void SessionStore::flushAll() {
+    for (std::map<std::string, Entry>::iterator it = _sessions.begin(); it != _sessions.end(); ++it) {
+        if (it->second.dirty) {
+            write(it->first, it->second.session);
+            it->second.dirty = false;
+        }
+    }
+    _dirtyCount = 0;
+}
+
+long SessionStore::pollTimeout(unsigned long now) const {
+    if (!_compactQueue.empty())
+        return 0;
+    if (_dirtyCount == 0)
+        return -1;
+    unsigned long elapsed = now - _lastFlush;
+    return elapsed >= _flushInterval ? 0 : static_cast<long>(_flushInterval - elapsed);
+}
+
+// Réécrit au format compact les fichiers encore dans l'ancien format, par
+// lots de FLUSH_BATCH ; les sessions en mémoire sont laissées à flush()
+void SessionStore::compact(unsigned long now) {
+    if (_compactQueue.empty()) {
+        if (now - _lastCompaction < COMPACT_INTERVAL)
+            return;
+        _lastCompaction = now;
+        DIR* dir = opendir("sessions");
+        if (!dir)
+            return;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            std::string name = entry->d_name;
+            if (name[0] != '.' && name.size() > 4 && name.compare(name.size() - 4, 4, ".txt") == 0)
+                _compactQueue.push_back(name.substr(0, name.size() - 4));
+        }
+        closedir(dir);
+    }
+
+    size_t compacted = 0;
+    for (size_t examined = 0; examined < FLUSH_BATCH && !_compactQueue.empty(); ++examined) {
+        std::string sessionId = _compactQueue.back();
+        _compactQueue.pop_back();
+        if (_sessions.find(sessionId) != _sessions.end())
+            continue;
+        Session session;
+        bool legacy = false;
+        if (load(sessionId, session, legacy) && legacy && write(sessionId, session))
+            ++compacted;
+    }
+    if (compacted) {
+        Metrics::instance().increment("session_compactions_total", compacted);
+        Logger::instance().log(INFO, "Compacted " + to_string(compacted) + " session files");
+    }
+}
+
+std::string SessionStore::pathFor(const std::string& sessionId) {
+    return "sessions/" + sessionId + ".txt";
+}
+
+// Format compact : lu en un temps borné par session_history_size, quel que
+// soit l'âge de la session
+bool SessionStore::load(const std::string& sessionId, Session& session, bool& legacy) const {
+    std::ifstream file(pathFor(sessionId).c_str());
+    if (!file.is_open())
+        return false;
+
+    std::string line;
+    legacy = !std::getline(file, line) || line != RECORD_HEADER;
+    if (legacy) {
+        file.clear();
+        file.seekg(0);
+        loadLegacy(file, session, _historySize);
+        return true;
+    }
+    while (std::getline(file, line)) {
+        size_t delimiter_pos = line.find('=');
+        if (delimiter_pos == std::string::npos)
+            continue;
+        std::string key = line.substr(0, delimiter_pos);
+        std::string value = line.substr(delimiter_pos + 1);
+        if (key == "visit")
+            session.record(value, _historySize);
+        else if (key == "requests")
+            session.requests = std::strtoul(value.c_str(), NULL, 10);
+        else
+            session.data[key] = value;
+    }
+    return true;
+}
+
+// Ancien format : un bloc [General]/[Requests] par requête, le dernier
+// portant les listes Pages/Methods les plus longues
+void SessionStore::loadLegacy(std::istream& file, Session& session, size_t capacity) {
+    std::string line;
+    std::string pages;
+    std::string methods;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#' || line[0] == '[') // Lignes vides, commentaires, sections
+            continue;
+        size_t delimiter_pos = line.find('=');
+        if (delimiter_pos == std::string::npos)
+            continue;
+        std::string key = line.substr(0, delimiter_pos);
+        std::string value = line.substr(delimiter_pos + 1);
+        if (key == "Pages")
+            pages = value;
+        else if (key == "Methods")
+            methods = value;
+        else
+            session.data[key] = value;
+    }
+
+    std::vector<std::string> pageList = splitList(pages);
+    std::vector<std::string> methodList = splitList(methods);
+    // Seules les `capacity` dernières pages sont gardées
+    size_t count = std::min(pageList.size(), capacity);
+    for (size_t i = pageList.size() - count; i < pageList.size(); ++i) {
+        size_t offset = pageList.size() - i;
+        std::string method = offset <= methodList.size() ? methodList[methodList.size() - offset] : "GET";
+        session.record(method + " " + pageList[i], capacity);
+    }
+    session.requests = pageList.size();
+}
+
+// Enregistrement complet écrit à côté puis renommé : un arrêt en cours
+// d'écriture laisse l'ancienne version intacte
+bool SessionStore::write(const std::string& sessionId, const Session& session) const {
+    std::string filepath = pathFor(sessionId);
+    std::string temp = "sessions/." + sessionId + ".tmp";
+    std::ofstream file(temp.c_str(), std::ios::trunc);
+    if (!file.is_open()) {
+        Logger::instance().log(ERROR, "Failed to save session in " + filepath);
+        return false;
+    }
+
+    file << RECORD_HEADER << "\n";
+    for (std::map<std::string, std::string>::const_iterator it = session.data.begin(); it != session.data.end(); ++it)
+        file << it->first << "=" << cleanValue(it->second) << "\n";
+    file << "requests=" << session.requests << "\n";
+    std::vector<std::string> pages = session.pages();
+    for (size_t i = 0; i < pages.size(); ++i)
+        file << "visit=" << cleanValue(pages[i]) << "\n";
+    file.close();
+
+    if (file.fail() || rename(temp.c_str(), filepath.c_str()) == -1) {
+        remove(temp.c_str());
+        Logger::instance().log(ERROR, "Failed to save session in " + filepath);
+        return false;
+    }
+    return true;
+}
+
+void SessionStore::publish() const {
+    Metrics::instance().setGauge("sessions_in_memory", static_cast<long>(_sessions.size()));
+    Metrics::instance().setGauge("sessions_dirty", static_cast<long>(_dirtyCount));
+}
@@ -0,0 +1,110 @@
+// SessionStore.hpp
+#ifndef SESSIONSTORE_HPP
+#define SESSIONSTORE_HPP
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Sessions gardées en mémoire, indexées par identifiant. Une requête ne lit
+ * sessions/<id>.txt que la première fois que le processus voit cet id, et
+ * n'écrit jamais : les sessions modifiées sont marquées sales puis écrites
+ * par lots depuis la boucle principale toutes les session_flush_interval ms
+ * (au plus FLUSH_BATCH fichiers par tour), et toutes à l'arrêt.
+ * Une session propre inutilisée depuis IDLE_TIMEOUT ms quitte la mémoire ;
+ * au-delà de session_max_entries, les moins récemment utilisées en sortent
+ * tout de suite (écrites d'abord si elles sont sales).
+ *
+ * Chaque fichier est un enregistrement de taille bornée, réécrit en entier :
+ * champs simples puis les session_history_size dernières pages. Les anciens
+ * fichiers, un bloc ajouté par requête, sont réécrits dans ce format au
+ * premier chargement ou par le compactage lancé au démarrage puis toutes
+ * les COMPACT_INTERVAL ms.
+ */
+class SessionStore {
+public:
+    struct Session {
+        // status, user_agent, last_access_time
+        std::map<std::string, std::string> data;
+        // Requêtes depuis la création de la session
+        unsigned long requests;
+        // Anneau des dernières pages ("METHODE chemin") ; `next` est la case
+        // à écraser une fois l'anneau plein
+        std::vector<std::string> history;
+        size_t next;
+
+        Session() : requests(0), next(0) {}
+        void record(const std::string& visit, size_t capacity);
+        // Du plus ancien au plus récent
+        std::vector<std::string> pages() const;
+    };
+
+    static SessionStore& instance();
+
+    void setFlushInterval(unsigned long interval);
+    void setHistorySize(size_t historySize);
+    void setMaxEntries(size_t maxEntries);
+
+    // Session chargée depuis le disque si elle n'est pas déjà en mémoire ;
+    // firstConnection est vrai si elle n'existait nulle part. Un id que le
+    // serveur vient de générer (`generated`) n'a pas de fichier à lire
+    Session& acquire(const std::string& sessionId, bool generated, bool& firstConnection, unsigned long now);
+    // La session a changé : elle sera écrite au prochain lot
+    void markDirty(const std::string& sessionId);
+    size_t getHistorySize() const;
+
+    // Écrit les sessions sales si l'intervalle est écoulé, purge les
+    // inactives, avance le compactage
+    void flush(unsigned long now);
+    // Arrêt du serveur : tout ce qui est sale part sur le disque
+    void flushAll();
+    // Délai max de poll() avant le prochain lot, -1 si rien n'est à écrire
+    long pollTimeout(unsigned long now) const;
+
+    static const unsigned long DEFAULT_FLUSH_INTERVAL = 1000;
+    static const size_t DEFAULT_HISTORY_SIZE = 20;
+    static const size_t DEFAULT_MAX_ENTRIES = 10000;
+    static const unsigned long IDLE_TIMEOUT = 1800000;
+    static const unsigned long COMPACT_INTERVAL = 3600000;
+    static const size_t FLUSH_BATCH = 64;
+
+private:
+    SessionStore();
+    SessionStore(const SessionStore&);
+    SessionStore& operator=(const SessionStore&);
+
+    struct Entry {
+        Session session;
+        bool dirty;
+        unsigned long lastAccess;
+        std::list<std::string>::iterator lru;
+        Entry() : dirty(false), lastAccess(0) {}
+    };
+
+    std::map<std::string, Entry> _sessions;
+    // Ids, du plus récemment utilisé au plus ancien
+    std::list<std::string> _lru;
+    size_t _maxEntries;
+    size_t _dirtyCount;
+    unsigned long _flushInterval;
+    unsigned long _lastFlush;
+    size_t _historySize;
+    // Fichiers restant à examiner par le compactage en cours
+    std::vector<std::string> _compactQueue;
+    unsigned long _lastCompaction;
+
+    void compact(unsigned long now);
+    void evict();
+    void drop(std::map<std::string, Entry>::iterator it);
+    // `legacy` : le fichier est dans l'ancien format et doit être réécrit
+    bool load(const std::string& sessionId, Session& session, bool& legacy) const;
+    bool write(const std::string& sessionId, const Session& session) const;
+    void publish() const;
+
+    static std::string pathFor(const std::string& sessionId);
+    static void loadLegacy(std::istream& file, Session& session, size_t capacity);
+};
+
+#endif
@@ -0,0 +1,46 @@
+// SharedBuffer.cpp
+#include "SharedBuffer.hpp"
+
+SharedBuffer::SharedBuffer() : _block(NULL) {}
+
+SharedBuffer::SharedBuffer(const std::string& bytes) : _block(new Block) {
+    _block->bytes = bytes;
+    _block->references = 1;
+}
+
+SharedBuffer::SharedBuffer(const SharedBuffer& other) : _block(other._block) {
+    if (_block)
+        ++_block->references;
+}
+
+SharedBuffer& SharedBuffer::operator=(const SharedBuffer& other) {
+    if (_block != other._block) {
+        release();
+        _block = other._block;
+        if (_block)
+            ++_block->references;
+    }
+    return *this;
+}
+
+SharedBuffer::~SharedBuffer() {
+    release();
+}
+
+void SharedBuffer::release() {
+    if (_block && --_block->references == 0)
+        delete _block;
+    _block = NULL;
+}
+
+const char* SharedBuffer::data() const {
+    return _block ? _block->bytes.data() : "";
+}
+
+size_t SharedBuffer::size() const {
+    return _block ? _block->bytes.size() : 0;
+}
+
+bool SharedBuffer::empty() const {
+    return size() == 0;
+}
@@ -0,0 +1,35 @@
+// SharedBuffer.hpp
+#ifndef SHAREDBUFFER_HPP
+#define SHAREDBUFFER_HPP
+
+#include <string>
+
+/*
+ * Octets immuables partagés par compteur de références : une réponse du
+ * cache part vers tous ses clients sans être recopiée. Le bloc est libéré
+ * avec son dernier détenteur (entrée évincée, envoi terminé).
+ */
+class SharedBuffer {
+public:
+    SharedBuffer();
+    explicit SharedBuffer(const std::string& bytes);
+    SharedBuffer(const SharedBuffer& other);
+    SharedBuffer& operator=(const SharedBuffer& other);
+    ~SharedBuffer();
+
+    const char* data() const;
+    size_t size() const;
+    bool empty() const;
+
+private:
+    struct Block {
+        std::string bytes;
+        long references;
+    };
+
+    Block* _block;
+
+    void release();
+};
+
+#endif
@@ -0,0 +1,106 @@
+// SpoolFile.cpp
+#include "SpoolFile.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <sys/stat.h>
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+SpoolFile::SpoolFile() : _fd(-1), _written(0), _preallocated(false), _error(0) {}
+
+SpoolFile::~SpoolFile() {
+    discard();
+}
+
+bool SpoolFile::isOpen() const { return _fd != -1; }
+size_t SpoolFile::size() const { return _written; }
+int SpoolFile::getError() const { return _error; }
+
+bool SpoolFile::fail(const std::string& what) {
+    _error = errno;
+    Logger::instance().log(ERROR, what + " Error: " + strerror(_error));
+    discard();
+    return false;
+}
+
+bool SpoolFile::open(const std::string& directory, size_t sizeHint) {
+    discard();
+    std::string pattern = directory + "/.upload.XXXXXX";
+    std::vector<char> tempPath(pattern.begin(), pattern.end());
+    tempPath.push_back('\0');
+    _fd = mkstemp(&tempPath[0]);
+    if (_fd == -1)
+        return fail("Failed to create temporary upload file in " + directory);
+    _directory = directory;
+    _path = &tempPath[0];
+    _written = 0;
+    _preallocated = false;
+    _error = 0;
+    fchmod(_fd, 0644);
+#ifdef __linux__
+    // Réservée d'un bloc pour limiter la fragmentation, et pour refuser tout
+    // de suite un disque plein
+    if (sizeHint >= PREALLOCATE_MIN) {
+        if (fallocate(_fd, 0, 0, sizeHint) == 0)
+            _preallocated = true;
+        else if (errno == ENOSPC || errno == EFBIG)
+            return fail("Not enough space for upload of " + to_string(sizeHint) + " bytes in " + directory + ".");
+    }
+#else
+    (void)sizeHint;
+#endif
+    return true;
+}
+
+bool SpoolFile::write(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(_fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return fail("Error while saving file.");
+        }
+        data += written;
+        size -= written;
+        _written += written;
+    }
+    return true;
+}
+
+bool SpoolFile::trim() {
+    if (_preallocated && ftruncate(_fd, _written) == -1)
+        return fail("Failed to truncate temporary upload file.");
+    _preallocated = false;
+    return true;
+}
+
+bool SpoolFile::commit(const std::string& destPath, UploadFsync fsyncPolicy) {
+    if (!trim())
+        return false;
+    if (fsyncPolicy != UPLOAD_FSYNC_OFF && fsync(_fd) == -1)
+        return fail("Failed to sync uploaded file.");
+    if (rename(_path.c_str(), destPath.c_str()) == -1)
+        return fail("Failed to move upload to " + destPath + ".");
+    close(_fd);
+    _fd = -1;
+    if (fsyncPolicy == UPLOAD_FSYNC_FULL) {
+        int dirFd = ::open(_directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dirFd != -1) {
+            fsync(dirFd);
+            close(dirFd);
+        }
+    }
+    return true;
+}
+
+void SpoolFile::discard() {
+    if (_fd == -1)
+        return;
+    close(_fd);
+    _fd = -1;
+    unlink(_path.c_str());
+}
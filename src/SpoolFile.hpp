@@ -0,0 +1,50 @@
+// SpoolFile.hpp
+#ifndef SPOOLFILE_HPP
+#define SPOOLFILE_HPP
+
+#include <string>
+#include "Location.hpp"
+
+/*
+ * Fichier d'upload en cours d'écriture : créé sous un nom temporaire dans le
+ * répertoire de destination, préalloué quand une borne de sa taille est
+ * connue, puis renommé sur la destination une fois complet. Un upload
+ * interrompu n'en laisse rien (discard, ou destruction).
+ */
+class SpoolFile {
+public:
+    // En dessous, pas de préallocation
+    static const size_t PREALLOCATE_MIN = 1048576;
+
+    SpoolFile();
+    ~SpoolFile();
+
+    // `sizeHint` : taille max attendue (0 : inconnue)
+    bool open(const std::string& directory, size_t sizeHint);
+    bool write(const char* data, size_t size);
+    // Fichier complet qui attend : l'espace préalloué au-delà est rendu
+    bool trim();
+    // Taille réelle, fsync selon la politique, puis renommage sur destPath
+    bool commit(const std::string& destPath, UploadFsync fsyncPolicy);
+    void discard();
+
+    bool isOpen() const;
+    size_t size() const;
+    // errno du dernier échec (ENOSPC : disque plein)
+    int getError() const;
+
+private:
+    int _fd;
+    std::string _directory;
+    std::string _path;
+    size_t _written;
+    bool _preallocated;
+    int _error;
+
+    SpoolFile(const SpoolFile&);
+    SpoolFile& operator=(const SpoolFile&);
+
+    bool fail(const std::string& what);
+};
+
+#endif
@@ -1,191 +1,138 @@
 // UploadHandler.cpp
-#include "HTTPRequest.hpp"
 #include "HTTPResponse.hpp"
 #include "UploadHandler.hpp"
-#include <fstream>
+#include <errno.h>
 #include <sys/stat.h>
+#include "ContentStore.hpp"
 #include "Logger.hpp"
+#include "Utils.hpp"
 
-UploadHandler::UploadHandler(const HTTPRequest& request, HTTPResponse& response, const std::string& boundary, const std::string& uploadDir, const ServerConfig& config)
-    : _request(request), _response(response), _boundary("--" + boundary), _uploadDir(uploadDir), _config(config), _filename("") {}
+UploadHandler::UploadHandler(const std::string& boundary, const std::string& uploadDir, size_t contentLength, UploadFsync fsyncPolicy, bool dedup)
+    : UploadStream(contentLength), _parser(boundary, *this), _uploadDir(uploadDir),
+      _fsyncPolicy(fsyncPolicy), _dedup(dedup), _spool(NULL), _filename(""), _filesSaved(0) {}
 
-void UploadHandler::handleUpload() {
-    std::string requestBody = _request.getBody();
-    size_t pos = 0;
-    size_t endPos = 0;
-
-    while (true) {
-        pos = requestBody.find(_boundary, endPos);
-        if (pos == std::string::npos) {
-            Logger::instance().log(DEBUG, "No more parts to process.");
-            break;
-        }
-        pos += _boundary.length();
-
-        if (requestBody.substr(pos, 2) == "--") {
-            Logger::instance().log(DEBUG, "End of multipart data.");
-            break;
-        }
-        if (requestBody.substr(pos, 2) == "\r\n") {
-            pos += 2;
-        }
-
-        // Extraire les en-têtes de la partie
-        size_t headersEnd = requestBody.find("\r\n\r\n", pos);
-        if (headersEnd == std::string::npos) {
-            Logger::instance().log(WARNING, "Missing \\r\\n\\r\\n in request for Upload");
-            _response.beError(400, "Bad Request: Missing headers in request for Upload");
-            return;
-        }
-        std::string partHeaders = requestBody.substr(pos, headersEnd - pos);
-        pos = headersEnd + 4; // Position du début du contenu
-
-        // Trouver la prochaine limite
-        endPos = requestBody.find(_boundary, pos);
-        if (endPos == std::string::npos) {
-            Logger::instance().log(ERROR, "End Boundary Marker not found.");
-            _response.beError(400, "Bad Request: End Boundary Marker not found.");
-            return;
-        }
-        size_t contentEnd = endPos;
-
-        // Retirer les éventuels \r\n avant la limite
-        if (requestBody.substr(contentEnd - 2, 2) == "\r\n") {
-            contentEnd -= 2;
-        }
+UploadHandler::~UploadHandler() {
+    // Upload interrompu (client parti, timeout) : pas de fichier tronqué
+    discard();
+}
 
-        // Extraire le contenu de la partie
-        std::string partContent = requestBody.substr(pos, contentEnd - pos);
+// Préallocation : _remaining borne encore la taille de la partie qui commence
+bool UploadHandler::consume(const char* data, size_t size) {
+    if (_parser.feed(data, size))
+        return true;
+    if (!_errorStatus) {
+        Logger::instance().log(WARNING, "Malformed multipart body: " + _parser.getError());
+        reject(400, "Bad Request: " + _parser.getError());
+    }
+    return false;
+}
 
-        // Vérifier si c'est un fichier
-        try {
-            handleFile(partHeaders, partContent);
-        }
-        catch (std::exception& e) {
-            throw; // Relancer l'exception pour la catch
-            return;
-        }
-        endPos = endPos + _boundary.length();
+void UploadHandler::finish(HTTPResponse& response) {
+    if (!_errorStatus && !_parser.isDone()) {
+        Logger::instance().log(ERROR, "End Boundary Marker not found.");
+        reject(400, "Bad Request: End Boundary Marker not found.");
+    }
+    if (!_errorStatus && verifyDigest(400)) {
+        for (size_t i = 0; i < _pending.size() && !_errorStatus; ++i)
+            commit(_pending[i]);
+    }
+    if (_errorStatus) {
+        response.beError(_errorStatus, _errorMessage);
+        return;
     }
-    _response.setStatusCode(201);
+    response.setStatusCode(201);
+    if (_filesSaved == 1 && !_fileDigest.empty())
+        response.setHeader("Repr-Digest", _fileDigest);
     std::string script = "<script type=\"text/javascript\">"
                          "setTimeout(function() {"
                          "    window.location.href = 'index.html';"
                          "}, 3500);"
                          "</script>";
-    _response.setBody(script + "<html><body><h1>File successfully uploaded, you'll be redirected on HomePage</h1></body></html>");
-    Logger::instance().log(INFO, "Successfully uploaded file: " + this->_filename + " to " + this->_uploadDir);
+    response.setBody(script + "<html><body><h1>File successfully uploaded, you'll be redirected on HomePage</h1></body></html>");
+    Logger::instance().log(INFO, "Successfully uploaded " + to_string(_filesSaved) + " file(s), last: " + _filename + " to " + _uploadDir);
 }
 
-void    UploadHandler::handleFile(std::string& partHeaders, std::string& partContent) {
-
-     // Vérifier si c'est un fichier
-        if (partHeaders.find("Content-Disposition") != std::string::npos &&
-            partHeaders.find("filename=\"") != std::string::npos)
-        {
-            size_t filenamePos = partHeaders.find("filename=\"") + 10;
-            size_t filenameEnd = partHeaders.find("\"", filenamePos);
-            this->_filename = partHeaders.substr(filenamePos, filenameEnd - filenamePos);
-
-            if (this->_filename.empty()) {
-                Logger::instance().log(ERROR, "No file selected for upload.");
-                _response.beError(400, "No file selected for upload.");
-                return;
-            }
-
-            // Sanitize filename to prevent directory traversal attacks
-            this->_filename = sanitizeFilename(this->_filename);
-
-            // Construct the destination path
-            std::string destPath = this->_uploadDir + "/" + this->_filename;
-
-            if (!isPathAllowed(destPath, this->_uploadDir)) {
-                Logger::instance().log(ERROR, "Attempt to upload outside of allowed path.");
-                _response.beError(403, "Attempt to upload outside of allowed path.");
-                return;
-            }
-
-            try {
-                // Save the file to the authorized path
-                saveFile(destPath, partContent);
-            } catch (const forbiddenDest& e) {
-                Logger::instance().log(ERROR, std::string("Forbidden destination error: ") + e.what());
-                _response.beError(403, "Forbidden: Write-protected destination.");
-                throw; // Relancer l'exception.
-            } catch (const std::exception& e) {
-                Logger::instance().log(ERROR, std::string("Error while saving file: ") + e.what());
-                _response.beError(500, "Internal Server Error: Error during file upload.");
-                throw; // Relancer l'exception.
-            }
-        } else {
-            Logger::instance().log(ERROR, std::string("Error while parsing the file in the request:") + partHeaders);
-            _response.beError(400, "Bad Request: File not found.");
-            throw forbiddenDest();
-        }
+void UploadHandler::discard() {
+    delete _spool;
+    _spool = NULL;
+    for (size_t i = 0; i < _pending.size(); ++i)
+        delete _pending[i].spool;
+    _pending.clear();
 }
 
-void UploadHandler::saveFile(const std::string& destPath, const std::string& fileContent) {
-    struct stat fileStat;
-    if (stat(destPath.c_str(), &fileStat) == 0) { // Le fichier existe
-        if (fileStat.st_mode & S_IWUSR) {
-            // Le fichier est accessible en écriture pour l'utilisateur
-        } else {
-            Logger::instance().log(ERROR, "Destination file is write-protected.");
-            throw forbiddenDest();
-        }
+bool UploadHandler::commit(const PendingFile& file) {
+    if (_dedup) {
+        if (!ContentStore::commit(*file.spool, _uploadDir, file.sha256, file.destPath, _fsyncPolicy))
+            return rejectWriteError(errno);
+    } else if (!file.spool->commit(file.destPath, _fsyncPolicy)) {
+        return rejectWriteError(file.spool->getError());
     }
-    
-    std::ofstream destFile(destPath.c_str(), std::ios::binary);
-    if (!destFile.is_open()) {
-        Logger::instance().log(ERROR, "Failed to open dest file on server's file system");
-        throw std::runtime_error("Failed to open destination file.");
-    }
-    destFile.write(fileContent.c_str(), fileContent.size());
-    Logger::instance().log(INFO, "File saved at: " + destPath);
-    destFile.close();
+    ++_filesSaved;
+    Logger::instance().log(INFO, "File saved at: " + file.destPath);
+    return true;
 }
 
-std::string UploadHandler::sanitizeFilename(const std::string& filename) {
-    std::string sanitized = filename;
-    // Implémenter la logique pour supprimer les caractères non autorisés, les chemins relatifs, etc.
-    // Par exemple, supprimer les ../ pour éviter la traversée de répertoires
-    size_t pos;
-    while ((pos = sanitized.find("..")) != std::string::npos) {
-        sanitized.erase(pos, 2);
+bool UploadHandler::onPartBegin(const std::string& partHeaders) {
+    // Vérifier si c'est un fichier
+    if (partHeaders.find("Content-Disposition") == std::string::npos || partHeaders.find("filename=\"") == std::string::npos) {
+        Logger::instance().log(ERROR, std::string("Error while parsing the file in the request:") + partHeaders);
+        return reject(400, "Bad Request: File not found.");
     }
-    // Supprimer les caractères spéciaux
-    const std::string invalidChars = "\\/:?\"<>|";
-    for (size_t i = 0; i < invalidChars.size(); ++i) {
-        sanitized.erase(std::remove(sanitized.begin(), sanitized.end(), invalidChars[i]), sanitized.end());
+    size_t filenamePos = partHeaders.find("filename=\"") + 10;
+    size_t filenameEnd = partHeaders.find("\"", filenamePos);
+    _filename = partHeaders.substr(filenamePos, filenameEnd - filenamePos);
+    if (_filename.empty()) {
+        Logger::instance().log(ERROR, "No file selected for upload.");
+        return reject(400, "No file selected for upload.");
     }
-    return sanitized;
-}
-
-bool UploadHandler::isPathAllowed(const std::string& path, const std::string& uploadDir) {
-    // Vérifier que le chemin est dans le répertoire autorisé
-    std::string directoryPath = path.substr(0, path.find_last_of('/'));
 
-    // Résoudre les chemins absolus
-    char resolvedDirectoryPath[PATH_MAX];
-    char resolvedUploadPath[PATH_MAX];
-
-    if (!realpath(directoryPath.c_str(), resolvedDirectoryPath)) {
-        Logger::instance().log(ERROR, "Failed to resolve directory path: " + directoryPath + " Error: " + strerror(errno));
-        return false;
+    // Sanitize filename to prevent directory traversal attacks
+    _filename = sanitizeFilename(_filename);
+    std::string destPath = _uploadDir + "/" + _filename;
+    if (!isPathAllowed(destPath, _uploadDir)) {
+        Logger::instance().log(ERROR, "Attempt to upload outside of allowed path.");
+        return reject(403, "Attempt to upload outside of allowed path.");
     }
 
-    if (!realpath(uploadDir.c_str(), resolvedUploadPath)) {
-        Logger::instance().log(ERROR, "Failed to resolve upload path: " + uploadDir + " Error: " + strerror(errno));
-        return false;
+    struct stat fileStat;
+    if (stat(destPath.c_str(), &fileStat) == 0 && !(fileStat.st_mode & S_IWUSR)) {
+        Logger::instance().log(ERROR, "Forbidden destination error: destination file is write-protected.");
+        return reject(403, "Forbidden: Write-protected destination.");
     }
+    _destPath = destPath;
+    _partDigest = ContentDigest(_digestAlgorithms);
+    // Taille max de la partie : le reste du corps. Des fichiers attendent
+    // déjà la vérification : celui-ci n'est sûrement pas seul, on ne
+    // réserve rien plutôt que de compter deux fois le même reste
+    _spool = new SpoolFile();
+    if (!_spool->open(_uploadDir, _pending.empty() ? _remaining : 0))
+        return rejectWriteError(_spool->getError());
+    return true;
+}
 
-    std::string directoryPathStr(resolvedDirectoryPath);
-    std::string uploadPathStr(resolvedUploadPath);
-
-    // Logger les chemins résolus pour le débogage
-    Logger::instance().log(DEBUG, "Resolved directory path: " + directoryPathStr);
-    Logger::instance().log(DEBUG, "Resolved upload path: " + uploadPathStr);
+bool UploadHandler::onPartData(const char* data, size_t size) {
+    if (!_spool->write(data, size))
+        return rejectWriteError(_spool->getError());
+    _partDigest.update(data, size);
+    return true;
+}
 
-    // Vérifier que le chemin du répertoire commence par le chemin autorisé
-    return directoryPathStr.find(uploadPathStr) == 0;
+bool UploadHandler::onPartEnd() {
+    PendingFile file;
+    file.spool = _spool;
+    file.destPath = _destPath;
+    file.sha256 = _partDigest.value(ContentDigest::SHA256);
+    _spool = NULL;
+    _fileDigest = _partDigest.header();
+    if (!_fileDigest.empty())
+        Logger::instance().log(INFO, "Upload digest of " + _filename + ": " + _fileDigest);
+    if (_digest.hasExpectations()) {
+        _pending.push_back(file);
+        if (!file.spool->trim())
+            return rejectWriteError(file.spool->getError());
+        return true;
+    }
+    bool committed = commit(file);
+    delete file.spool;
+    return committed;
 }
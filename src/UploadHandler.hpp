@@ -1,35 +1,67 @@
-#include <fstream>
-#include <iostream>
-#include <limits.h>
-#include <stdlib.h>
-#include <string.h>
-#include <algorithm>
-#include "ServerConfig.hpp"
+// UploadHandler.hpp
+#ifndef UPLOADHANDLER_HPP
+#define UPLOADHANDLER_HPP
 
+#include <string>
+#include <vector>
+#include "Digest.hpp"
+#include "Location.hpp"
+#include "MultipartParser.hpp"
+#include "SpoolFile.hpp"
+#include "UploadStream.hpp"
+
+/*
+ * Upload multipart/form-data reçu au fil de l'eau : chaque partie fichier est
+ * écrite sur le disque à mesure qu'elle arrive. Rien du corps n'est gardé en
+ * mémoire au-delà de la fenêtre du MultipartParser.
+ * Chaque fichier passe par un SpoolFile préalloué à la taille restante du
+ * corps (sauf derrière des fichiers en attente) : jamais de fichier tronqué,
+ * et deux uploads du même nom ne se mélangent pas (le dernier terminé
+ * l'emporte).
+ * Si le client annonce une empreinte du corps, les fichiers complets
+ * attendent sa vérification, en fin de corps, avant d'être mis en place.
+ * Avec upload_dedup on, chaque fichier est rangé dans le ContentStore.
+ */
+class UploadHandler : public UploadStream, public MultipartParser::Listener {
+public:
+    UploadHandler(const std::string& boundary, const std::string& uploadDir, size_t contentLength, UploadFsync fsyncPolicy, bool dedup);
+    ~UploadHandler();
+
+    void finish(HTTPResponse& response);
+
+    virtual bool onPartBegin(const std::string& headers);
+    virtual bool onPartData(const char* data, size_t size);
+    virtual bool onPartEnd();
+
+protected:
+    bool consume(const char* data, size_t size);
+    // Partie incomplète : le fichier temporaire est effacé
+    void discard();
 
-class UploadHandler {
 private:
-    const HTTPRequest& _request;
-    HTTPResponse& _response;
-    std::string _boundary;
+    // Fichier complet pas encore mis en place, et son SHA-256
+    struct PendingFile {
+        SpoolFile* spool;
+        std::string destPath;
+        std::string sha256;
+    };
+
+    MultipartParser _parser;
     std::string _uploadDir;
-    const ServerConfig& _config;
+    UploadFsync _fsyncPolicy;
+    bool _dedup;
+    // Fichier de la partie en cours, et ses empreintes (upload_digest)
+    SpoolFile* _spool;
+    ContentDigest _partDigest;
     std::string _filename;
+    std::string _destPath;
+    size_t _filesSaved;
+    // Fichiers complets en attente de la vérification du corps
+    std::vector<PendingFile> _pending;
+    // Empreintes du dernier fichier, rendues si c'est le seul
+    std::string _fileDigest;
 
-    void parseMultipartFormData();
-    void saveFile(const std::string& filename, const std::string& content);
-    std::string sanitizeFilename(const std::string& filename);
-    bool isPathAllowed(const std::string& path, const std::string& uploadDir);
-    void    handleFile(std::string& partHeaders, std::string& partContent);
-
-public:
-    class forbiddenDest : public std::exception {
-    public:
-        forbiddenDest() throw() {}
-        virtual const char *what() const throw() {
-            return "Access to the requested destination is forbidden.";
-        }
-    };
-    UploadHandler(const HTTPRequest& request, HTTPResponse& response, const std::string& boundary, const std::string& uploadDir, const ServerConfig& config);
-    void handleUpload();
+    bool commit(const PendingFile& file);
 };
+
+#endif
@@ -0,0 +1,114 @@
+// UploadLimiter.cpp
+#include "UploadLimiter.hpp"
+#include <algorithm>
+#include "Logger.hpp"
+#include "Metrics.hpp"
+
+UploadLimiter& UploadLimiter::instance() {
+    static UploadLimiter instance;
+    return instance;
+}
+
+UploadLimiter::UploadLimiter() {}
+
+bool UploadLimiter::isLimited(const Location& location) {
+    return location.uploadMaxConcurrent > 0 || location.uploadMaxInflight > 0;
+}
+
+bool UploadLimiter::fits(const Pool& pool, size_t bytes) {
+    const Location& location = *pool.location;
+    if (location.uploadMaxConcurrent > 0 && pool.active >= location.uploadMaxConcurrent)
+        return false;
+    return location.uploadMaxInflight == 0 || pool.active == 0 || pool.inflight + bytes <= location.uploadMaxInflight;
+}
+
+UploadLimiter::Admission UploadLimiter::admit(const Location& location, size_t bytes, const void* waiter, unsigned long now) {
+    Pool& pool = _pools[&location];
+    pool.location = &location;
+
+    std::deque<Waiter>::iterator position = pool.queue.begin();
+    while (position != pool.queue.end() && position->id != waiter)
+        ++position;
+    bool queued = position != pool.queue.end();
+
+    if (fits(pool, bytes) && (pool.queue.empty() || position == pool.queue.begin())) {
+        unsigned long waited = 0;
+        if (queued) {
+            waited = now - position->since;
+            pool.queue.pop_front();
+        }
+        ++pool.active;
+        pool.inflight += bytes;
+        Metrics::instance().observe(Metrics::labeled("upload_queue_wait_ms", "location", location.path), waited);
+        publish(pool);
+        return ADMITTED;
+    }
+
+    if (queued) {
+        if (now - position->since < location.uploadQueueTimeout)
+            return QUEUED;
+        pool.queue.erase(position);
+        Metrics::instance().increment(Metrics::labeled("upload_queue_timeouts_total", "location", location.path));
+        publish(pool);
+        return REJECTED_TIMEOUT;
+    }
+
+    if (pool.queue.size() >= location.uploadQueueSize) {
+        Metrics::instance().increment(Metrics::labeled("upload_queue_rejected_total", "location", location.path));
+        return REJECTED_FULL;
+    }
+    Waiter entry;
+    entry.id = waiter;
+    entry.bytes = bytes;
+    entry.since = now;
+    pool.queue.push_back(entry);
+    publish(pool);
+    Logger::instance().log(DEBUG, "Upload queued in " + location.path);
+    return QUEUED;
+}
+
+void UploadLimiter::release(const Location* location, size_t bytes) {
+    std::map<const Location*, Pool>::iterator it = _pools.find(location);
+    if (it == _pools.end() || it->second.active == 0)
+        return;
+    --it->second.active;
+    it->second.inflight -= std::min(bytes, it->second.inflight);
+    publish(it->second);
+}
+
+void UploadLimiter::cancel(const Location* location, const void* waiter) {
+    std::map<const Location*, Pool>::iterator it = _pools.find(location);
+    if (it == _pools.end())
+        return;
+    std::deque<Waiter>& queue = it->second.queue;
+    for (std::deque<Waiter>::iterator position = queue.begin(); position != queue.end(); ++position) {
+        if (position->id == waiter) {
+            queue.erase(position);
+            publish(it->second);
+            return;
+        }
+    }
+}
+
+long UploadLimiter::pollTimeout(unsigned long now) const {
+    long timeout = -1;
+    for (std::map<const Location*, Pool>::const_iterator it = _pools.begin(); it != _pools.end(); ++it) {
+        const Pool& pool = it->second;
+        if (pool.queue.empty())
+            continue;
+        if (fits(pool, pool.queue.front().bytes))
+            return 0;
+        // La tête de file est la plus ancienne, donc la première à expirer
+        unsigned long elapsed = now - pool.queue.front().since;
+        long remaining = elapsed >= pool.location->uploadQueueTimeout ? 0 : static_cast<long>(pool.location->uploadQueueTimeout - elapsed);
+        if (timeout == -1 || remaining < timeout)
+            timeout = remaining;
+    }
+    return timeout;
+}
+
+void UploadLimiter::publish(const Pool& pool) const {
+    Metrics::instance().setGauge(Metrics::labeled("uploads_active", "location", pool.location->path), pool.active);
+    Metrics::instance().setGauge(Metrics::labeled("upload_inflight_bytes", "location", pool.location->path), pool.inflight);
+    Metrics::instance().setGauge(Metrics::labeled("upload_queue_depth", "location", pool.location->path), pool.queue.size());
+}
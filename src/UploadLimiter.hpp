@@ -0,0 +1,60 @@
+// UploadLimiter.hpp
+#ifndef UPLOADLIMITER_HPP
+#define UPLOADLIMITER_HPP
+
+#include <deque>
+#include <map>
+#include "Location.hpp"
+
+/*
+ * Limite les uploads simultanés par location (upload_max_concurrent) et les
+ * octets annoncés (Content-Length) des uploads en cours (upload_max_inflight).
+ * Un upload en excès attend, son corps laissé sur le socket, dans une file
+ * FIFO bornée (upload_queue_size) au plus upload_queue_timeout ms, puis est
+ * refusé en 503. Seul, un upload passe même s'il dépasse upload_max_inflight.
+ */
+class UploadLimiter {
+public:
+    enum Admission { ADMITTED, QUEUED, REJECTED_FULL, REJECTED_TIMEOUT };
+
+    static UploadLimiter& instance();
+
+    // Location avec au moins une des deux limites
+    static bool isLimited(const Location& location);
+
+    // `waiter` identifie la requête en file d'un appel à l'autre
+    Admission admit(const Location& location, size_t bytes, const void* waiter, unsigned long now);
+    void release(const Location* location, size_t bytes);
+    // La requête en attente est partie (client déconnecté)
+    void cancel(const Location* location, const void* waiter);
+
+    // Délai max de poll() pour servir la file à temps : 0 si la tête de file
+    // peut passer, -1 si aucune requête n'attend
+    long pollTimeout(unsigned long now) const;
+
+private:
+    UploadLimiter();
+    UploadLimiter(const UploadLimiter&);
+    UploadLimiter& operator=(const UploadLimiter&);
+
+    struct Waiter {
+        const void* id;
+        size_t bytes;
+        unsigned long since;
+    };
+
+    struct Pool {
+        const Location* location;
+        int active;
+        size_t inflight;
+        std::deque<Waiter> queue;
+        Pool() : location(NULL), active(0), inflight(0) {}
+    };
+
+    std::map<const Location*, Pool> _pools;
+
+    static bool fits(const Pool& pool, size_t bytes);
+    void publish(const Pool& pool) const;
+};
+
+#endif
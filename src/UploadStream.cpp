@@ -0,0 +1,124 @@
+// UploadStream.cpp
+#include "UploadStream.hpp"
+#include <algorithm>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+UploadStream::UploadStream(size_t contentLength)
+    : _remaining(contentLength), _errorStatus(0), _digestAlgorithms(0), _lastActivity(curr_time_ms()) {}
+
+UploadStream::~UploadStream() {}
+
+bool UploadStream::hasFailed() const { return _errorStatus != 0; }
+size_t UploadStream::getRemainingBody() const { return _remaining; }
+unsigned long UploadStream::getLastActivity() const { return _lastActivity; }
+
+void UploadStream::discard() {}
+
+bool UploadStream::prepare() { return true; }
+
+bool UploadStream::setDigest(const HTTPRequest& request, unsigned int algorithms) {
+    _digestAlgorithms = algorithms;
+    _digest = ContentDigest(algorithms);
+    if (_digest.expect(request))
+        return true;
+    Logger::instance().log(WARNING, "Malformed digest header in upload request.");
+    return reject(400, "Bad Request: Malformed digest header.");
+}
+
+bool UploadStream::feed(const char* data, size_t size) {
+    _lastActivity = curr_time_ms();
+    if (!_errorStatus)
+        _digest.update(data, size);
+    bool consumed = !_errorStatus && consume(data, size);
+    _remaining -= std::min(size, _remaining);
+    return consumed && !_errorStatus;
+}
+
+bool UploadStream::reject(int status, const std::string& message) {
+    discard();
+    if (!_errorStatus) {
+        _errorStatus = status;
+        _errorMessage = message;
+    }
+    return false;
+}
+
+bool UploadStream::rejectWriteError(int error) {
+    if (error == ENOSPC || error == EFBIG || error == EDQUOT)
+        return reject(507, "Insufficient Storage: Not enough space for the upload.");
+    return reject(500, "Internal Server Error: Error during file upload.");
+}
+
+bool UploadStream::verifyDigest(int status) {
+    unsigned int mismatch = _digest.verify();
+    if (!mismatch)
+        return true;
+    std::string algorithm = ContentDigest::name(mismatch);
+    Logger::instance().log(WARNING, "Upload rejected: " + algorithm + " digest mismatch.");
+    return reject(status, "Digest mismatch: " + algorithm + " of the received content differs.");
+}
+
+bool UploadStream::writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+std::string UploadStream::sanitizeFilename(const std::string& filename) {
+    std::string sanitized = filename;
+    // Implémenter la logique pour supprimer les caractères non autorisés, les chemins relatifs, etc.
+    // Par exemple, supprimer les ../ pour éviter la traversée de répertoires
+    size_t pos;
+    while ((pos = sanitized.find("..")) != std::string::npos) {
+        sanitized.erase(pos, 2);
+    }
+    // Supprimer les caractères spéciaux
+    const std::string invalidChars = "\\/:?\"<>|";
+    for (size_t i = 0; i < invalidChars.size(); ++i) {
+        sanitized.erase(std::remove(sanitized.begin(), sanitized.end(), invalidChars[i]), sanitized.end());
+    }
+    return sanitized;
+}
+
+bool UploadStream::isPathAllowed(const std::string& path, const std::string& uploadDir) {
+    // Vérifier que le chemin est dans le répertoire autorisé
+    std::string directoryPath = path.substr(0, path.find_last_of('/'));
+
+    // Résoudre les chemins absolus
+    char resolvedDirectoryPath[PATH_MAX];
+    char resolvedUploadPath[PATH_MAX];
+
+    if (!realpath(directoryPath.c_str(), resolvedDirectoryPath)) {
+        Logger::instance().log(ERROR, "Failed to resolve directory path: " + directoryPath + " Error: " + strerror(errno));
+        return false;
+    }
+
+    if (!realpath(uploadDir.c_str(), resolvedUploadPath)) {
+        Logger::instance().log(ERROR, "Failed to resolve upload path: " + uploadDir + " Error: " + strerror(errno));
+        return false;
+    }
+
+    std::string directoryPathStr(resolvedDirectoryPath);
+    std::string uploadPathStr(resolvedUploadPath);
+
+    // Logger les chemins résolus pour le débogage
+    Logger::instance().log(DEBUG, "Resolved directory path: " + directoryPathStr);
+    Logger::instance().log(DEBUG, "Resolved upload path: " + uploadPathStr);
+
+    // Vérifier que le chemin du répertoire commence par le chemin autorisé
+    return directoryPathStr.find(uploadPathStr) == 0;
+}
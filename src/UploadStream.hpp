@@ -0,0 +1,74 @@
+// UploadStream.hpp
+#ifndef UPLOADSTREAM_HPP
+#define UPLOADSTREAM_HPP
+
+#include <string>
+#include "Digest.hpp"
+
+class HTTPRequest;
+class HTTPResponse;
+
+/*
+ * Corps de requête écrit sur le disque au fil de sa réception (upload
+ * multipart, envoi d'un upload reprenable) : la boucle lit le socket et
+ * donne chaque morceau à feed() ; une fois le Content-Length reçu, ou dès
+ * qu'une erreur a décidé de la réponse, finish() la remplit.
+ * Les empreintes du corps sont calculées au passage : celles annoncées par
+ * le client sont vérifiées avant que rien ne soit mis en place.
+ */
+class UploadStream {
+public:
+    // Octets lus sur le socket avant de rendre la main à la boucle
+    static const size_t READ_BUDGET = 1048576;
+
+    explicit UploadStream(size_t contentLength);
+    virtual ~UploadStream();
+
+    // Empreintes à calculer (upload_digest) et à vérifier (en-têtes du
+    // client) ; false, et réponse 400, si ces en-têtes sont malformés
+    bool setDigest(const HTTPRequest& request, unsigned int algorithms);
+    // Empreintes connues, avant le premier octet : prépare l'écriture ;
+    // false si la réponse est déjà décidée
+    virtual bool prepare();
+    // false dès qu'une erreur a décidé de la réponse : la suite est ignorée
+    bool feed(const char* data, size_t size);
+    // Corps reçu (ou upload abandonné) : réponse finale
+    virtual void finish(HTTPResponse& response) = 0;
+    bool hasFailed() const;
+    // Octets du Content-Length pas encore reçus
+    size_t getRemainingBody() const;
+    unsigned long getLastActivity() const;
+
+protected:
+    // Pendant consume(), _remaining compte encore le morceau en cours
+    size_t _remaining;
+    int _errorStatus;
+    std::string _errorMessage;
+    // Empreintes du corps reçu ; _digestAlgorithms : celles de la location
+    ContentDigest _digest;
+    unsigned int _digestAlgorithms;
+
+    virtual bool consume(const char* data, size_t size) = 0;
+    // Abandon : ce qui a été écrit et ne doit pas rester est effacé
+    virtual void discard();
+    // Retient la première erreur ; retourne toujours false
+    bool reject(int status, const std::string& message);
+    // Échec d'écriture sur le disque (errno) : 507 s'il est plein, 500 sinon
+    bool rejectWriteError(int error);
+    // Corps complet : compare aux empreintes annoncées, rejette avec `status`
+    // en cas d'écart
+    bool verifyDigest(int status);
+    // write() complet ; false (errno renseigné) en cas d'échec
+    static bool writeAll(int fd, const char* data, size_t size);
+
+    static std::string sanitizeFilename(const std::string& filename);
+    static bool isPathAllowed(const std::string& path, const std::string& uploadDir);
+
+private:
+    unsigned long _lastActivity;
+
+    UploadStream(const UploadStream&);
+    UploadStream& operator=(const UploadStream&);
+};
+
+#endif
@@ -0,0 +1,133 @@
+// UpstreamHandler.cpp
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include "UpstreamHandler.hpp"
+#include "UpstreamPool.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+UpstreamHandler::UpstreamHandler(const std::string& scriptPath, const std::string& upstream, const HTTPRequest& request)
+    : CGIHandler(scriptPath, "", request), _upstream(upstream), _socketFd(-1), _connected(false), _requestWritten(false) {
+    _failureStatus = 502;
+}
+
+UpstreamHandler::~UpstreamHandler() {
+    if (_socketFd != -1) {
+        close(_socketFd);
+        _socketFd = -1;
+    }
+}
+
+int UpstreamHandler::getInputPipeFd() const {
+    return (_socketFd != -1 && !_requestWritten) ? _socketFd : -1;
+}
+
+int UpstreamHandler::getOutputPipeFd() const {
+    return (_socketFd != -1 && _requestWritten) ? _socketFd : -1;
+}
+
+bool UpstreamHandler::isOutputClosed() const {
+    return _socketFd == -1;
+}
+
+void UpstreamHandler::appendInput(const char* data, size_t size) {
+    _inputReceived += size;
+    _lastReadTime = curr_time_ms();
+    if (_socketFd == -1 || _requestWritten)
+        return;
+    if (!getPendingInputSize())
+        _lastSendTime = _lastReadTime;
+    if (_bytesSent > _CGIInput.size() / 2) {
+        _CGIInput.erase(0, _bytesSent);
+        _bytesSent = 0;
+    }
+    appendBody(data, size);
+}
+
+bool UpstreamHandler::hasPendingInput() const {
+    return _socketFd != -1 && !_requestWritten && getPendingInputSize();
+}
+
+bool UpstreamHandler::connectUpstream(bool pooled) {
+    bool reused = false;
+    _socketFd = pooled ? UpstreamPool::instance().acquire(_upstream, reused) : UpstreamPool::instance().openConnection(_upstream);
+    if (_socketFd == -1)
+        return false;
+    _connected = reused;
+    _bytesSent = 0;
+    _started = true;
+    Logger::instance().log(DEBUG, std::string(protocolName()) + " request on " + (reused ? "pooled" : "new") + " connection fd " + to_string(_socketFd));
+    return true;
+}
+
+void UpstreamHandler::fail(const std::string& reason) {
+    Logger::instance().log(ERROR, std::string(protocolName()) + " upstream " + _upstream + ": " + reason);
+    if (_socketFd != -1) {
+        close(_socketFd);
+        _socketFd = -1;
+    }
+    if (!_cgiFinished) {
+        _cgiFinished = true;
+        _cgiExitStatus = -1;
+    }
+}
+
+int UpstreamHandler::writeToCGI() {
+    if (_socketFd == -1 || _requestWritten)
+        return -1;
+
+    if (!_connected) {
+        // Premier POLLOUT après un connect() non bloquant
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(_socketFd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err != 0) {
+            fail(std::string("connect failed: ") + strerror(err));
+            return 0;
+        }
+        _connected = true;
+    }
+
+    ssize_t bytesWritten = write(_socketFd, _CGIInput.data() + _bytesSent, _CGIInput.size() - _bytesSent);
+    if (bytesWritten > 0) {
+        _bytesSent += bytesWritten;
+        _lastSendTime = curr_time_ms();
+    } else if (bytesWritten == -1) {
+        fail(std::string("write error: ") + strerror(errno));
+        return 0;
+    }
+
+    if (_bytesSent < _CGIInput.size())
+        return 1;
+
+    _CGIInput.clear();
+    _bytesSent = 0;
+    if (!isAwaitingBody())
+        _requestWritten = true;
+    return 0;
+}
+
+int UpstreamHandler::isCgiDone() {
+    return _cgiFinished ? _cgiExitStatus : 0;
+}
+
+void UpstreamHandler::terminateCGI() {
+    if (_socketFd != -1) {
+        close(_socketFd);
+        _socketFd = -1;
+    }
+    if (!_cgiFinished) {
+        _cgiFinished = true;
+        _cgiExitStatus = -1;
+    }
+}
+
+void UpstreamHandler::closeInputPipe() {
+    if (!_requestWritten)
+        fail("connection lost while sending the request");
+}
+
+void UpstreamHandler::closeOutputPipe() {
+    terminateCGI();
+}
@@ -0,0 +1,52 @@
+// UpstreamHandler.hpp
+#ifndef UPSTREAMHANDLER_HPP
+#define UPSTREAMHANDLER_HPP
+
+#include <string>
+#include "CGIHandler.hpp"
+
+/*
+ * Base des handlers qui confient la requête à un serveur d'application
+ * persistant (FastCGI, SCGI, uwsgi) plutôt que de forker un interpréteur.
+ * Un seul socket non bloquant sert d'entrée tant que la requête s'écrit,
+ * puis de sortie ; la boucle principale le voit comme les pipes d'un CGI.
+ * Les sous-classes encodent la requête dans _CGIInput et décodent la réponse.
+ */
+class UpstreamHandler : public CGIHandler {
+public:
+    UpstreamHandler(const std::string& scriptPath, const std::string& upstream, const HTTPRequest& request);
+    virtual ~UpstreamHandler();
+
+    virtual int getInputPipeFd() const;
+    virtual int getOutputPipeFd() const;
+    virtual bool isOutputClosed() const;
+
+    virtual void closeInputPipe();
+    virtual void closeOutputPipe();
+
+    virtual int writeToCGI();
+
+    virtual void appendInput(const char* data, size_t size);
+    virtual bool hasPendingInput() const;
+
+    virtual int isCgiDone();
+    virtual void terminateCGI();
+
+protected:
+    std::string _upstream;
+    int _socketFd;
+    bool _connected;
+    bool _requestWritten;
+
+    // Nom du protocole dans les logs
+    virtual const char* protocolName() const = 0;
+    // Suite du corps reçue du client, à encoder à la suite de la requête
+    virtual void appendBody(const char* data, size_t size) = 0;
+
+    // `pooled` : connexion prise (et rendue) au pool, sinon neuve et fermée
+    // après la réponse
+    bool connectUpstream(bool pooled);
+    void fail(const std::string& reason);
+};
+
+#endif
@@ -0,0 +1,126 @@
+// UpstreamPool.cpp
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <cstdlib>
+#include "UpstreamPool.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+UpstreamPool& UpstreamPool::instance() {
+    static UpstreamPool instance;
+    return instance;
+}
+
+UpstreamPool::UpstreamPool() {}
+
+UpstreamPool::~UpstreamPool() {
+    for (std::map<std::string, std::vector<int> >::iterator it = _idle.begin(); it != _idle.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); ++i)
+            close(it->second[i]);
+    }
+}
+
+bool UpstreamPool::isValidAddress(const std::string& address) {
+    if (address.compare(0, 5, "unix:") == 0)
+        return address.size() > 5 && address.size() - 5 < sizeof(((sockaddr_un*)0)->sun_path);
+
+    size_t colonPos = address.rfind(':');
+    if (colonPos == std::string::npos || colonPos == 0)
+        return false;
+    int port = std::atoi(address.substr(colonPos + 1).c_str());
+    return port > 0 && port <= 65535;
+}
+
+int UpstreamPool::acquire(const std::string& address, bool& reused) {
+    std::vector<int>& idle = _idle[address];
+    while (!idle.empty()) {
+        int fd = idle.back();
+        idle.pop_back();
+        if (isAlive(fd)) {
+            reused = true;
+            return fd;
+        }
+        // Fermée côté upstream pendant qu'elle attendait dans le pool
+        close(fd);
+    }
+    reused = false;
+    return openConnection(address);
+}
+
+void UpstreamPool::release(const std::string& address, int fd) {
+    std::vector<int>& idle = _idle[address];
+    if (idle.size() >= MAX_IDLE_PER_UPSTREAM) {
+        close(fd);
+        return;
+    }
+    idle.push_back(fd);
+}
+
+// Une connexion au repos n'a rien à lire : si elle est lisible, c'est un EOF
+// ou une erreur.
+bool UpstreamPool::isAlive(int fd) const {
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) == 0;
+}
+
+int UpstreamPool::openConnection(const std::string& address) {
+    int fd;
+    int ret;
+
+    if (address.compare(0, 5, "unix:") == 0) {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::string path = address.substr(5);
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) {
+            Logger::instance().log(ERROR, std::string("Upstream socket creation failed: ") + strerror(errno));
+            return -1;
+        }
+        setNonBlocking(fd);
+        ret = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    } else {
+        size_t colonPos = address.rfind(':');
+        std::string host = address.substr(0, colonPos);
+        if (host == "localhost")
+            host = "127.0.0.1";
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(std::atoi(address.substr(colonPos + 1).c_str()));
+        addr.sin_addr.s_addr = inet_addr(host.c_str());
+        if (addr.sin_addr.s_addr == INADDR_NONE) {
+            Logger::instance().log(ERROR, "Invalid upstream IP address: " + host);
+            return -1;
+        }
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd == -1) {
+            Logger::instance().log(ERROR, std::string("Upstream socket creation failed: ") + strerror(errno));
+            return -1;
+        }
+        setNonBlocking(fd);
+        ret = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+
+    // La fin d'une connexion TCP en cours est signalée par POLLOUT
+    if (ret == -1 && errno != EINPROGRESS) {
+        Logger::instance().log(ERROR, "Failed to connect to upstream " + address + ": " + strerror(errno));
+        close(fd);
+        return -1;
+    }
+    Logger::instance().log(DEBUG, "New upstream connection to " + address + " on fd " + to_string(fd));
+    return fd;
+}
@@ -0,0 +1,42 @@
+// UpstreamPool.hpp
+#ifndef UPSTREAMPOOL_HPP
+#define UPSTREAMPOOL_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+/*
+ * Connexions persistantes vers les upstreams applicatifs (php-fpm, ...),
+ * adressés par "unix:/chemin" ou "hôte:port".
+ * Les sockets sont non bloquants ; une connexion rendue au pool après une
+ * réponse complète est réutilisée par la requête suivante vers la même adresse.
+ */
+class UpstreamPool {
+public:
+    static UpstreamPool& instance();
+
+    // Retourne un fd connecté (ou en cours de connexion), -1 en cas d'échec.
+    // `reused` indique si la connexion sort du pool.
+    int acquire(const std::string& address, bool& reused);
+    void release(const std::string& address, int fd);
+    // Connexion neuve, hors pool : pour SCGI et uwsgi, l'upstream ferme
+    // après chaque réponse
+    int openConnection(const std::string& address);
+
+    static bool isValidAddress(const std::string& address);
+
+private:
+    UpstreamPool();
+    ~UpstreamPool();
+    UpstreamPool(const UpstreamPool&);
+    UpstreamPool& operator=(const UpstreamPool&);
+
+    static const size_t MAX_IDLE_PER_UPSTREAM = 32;
+
+    std::map<std::string, std::vector<int> > _idle;
+
+    bool isAlive(int fd) const;
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include <string>
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 
 
 #define TIMEOUT_MS 5000
@@ -24,5 +25,12 @@ namespace serverSignal {
 enum LoggerLevel { DEBUG, INFO, WARNING, ERROR };
 
 unsigned long curr_time_ms();
+void setNonBlocking(int fd);
+std::string absolutePath(const std::string& path);
+// Base64 standard (RFC 4648), padding facultatif ; false si invalide
+bool base64Decode(const std::string& input, std::string& output);
+std::string base64Encode(const std::string& input);
+// Date HTTP (RFC 9110, IMF-fixdate)
+std::string httpDate(time_t when);
 
 #endif
@@ -8,6 +8,13 @@
 #include "Logger.hpp"
 #include "ServerConfig.hpp"
 #include "SessionManager.hpp"
+#include "SessionStore.hpp"
+#include "CGISpawner.hpp"
+#include "CGILimiter.hpp"
+#include "UploadLimiter.hpp"
+#include "Metrics.hpp"
+#include "ResponseCache.hpp"
+#include "UploadStream.hpp"
 #include <poll.h>
 #include <unistd.h>
 #include <ctime>
@@ -41,7 +48,9 @@ void modifyPollFD(std::vector<pollfd>& poll_fds, int fd, short events, bool addE
 }
 
 
-enum FDType { FD_SERVER_SOCKET, FD_CLIENT_SOCKET, FD_CGI_INPUT, FD_CGI_OUTPUT, FD_UNKNOWN };
+static const unsigned long CGI_REAP_POLL_MS = 5;
+
+enum FDType { FD_SERVER_SOCKET, FD_CLIENT_SOCKET, FD_CGI_INPUT, FD_CGI_OUTPUT, FD_CGI_ERROR, FD_CACHE_REFRESH, FD_UNKNOWN };
 
 FDType getFDType(int fd, const std::map<int, Server*>& fdToServerMap, const std::map<int, ClientConnection>& connections) {
     if (fdToServerMap.find(fd) != fdToServerMap.end()) {
@@ -59,8 +68,13 @@ FDType getFDType(int fd, const std::map<int, Server*>& fdToServerMap, const std:
             if (cgiHandler->getOutputPipeFd() == fd) {
                 return FD_CGI_OUTPUT;
             }
+            if (cgiHandler->getErrorPipeFd() == fd) {
+                return FD_CGI_ERROR;
+            }
         }
     }
+    if (ResponseCache::instance().isRefreshFd(fd))
+        return FD_CACHE_REFRESH;
     return FD_UNKNOWN;
 }
 
@@ -87,6 +101,15 @@ struct MatchCGIOutputFD {
 
 };
 
+struct MatchCGIErrorFD {
+    int fd;
+    MatchCGIErrorFD(int f) : fd(f) {}
+    bool operator()(const std::pair<const int, ClientConnection>& pair) const {
+            CGIHandler* handler = pair.second.getCgiHandler();
+            return handler && handler->getErrorPipeFd() == fd;
+        }
+};
+
 struct MatchCGIInputFD {
     int fd;
     MatchCGIInputFD(int f) : fd(f) {}
@@ -100,6 +123,201 @@ struct MatchCGIInputFD {
         }
 };
 
+void removePollFD(std::vector<pollfd>& poll_fds, int fd) {
+    if (fd == -1)
+        return;
+    std::vector<pollfd>::iterator it = std::find_if(poll_fds.begin(), poll_fds.end(), MatchFD(fd));
+    if (it != poll_fds.end())
+        poll_fds.erase(it);
+}
+
+// Pipes d'un CGI sur le point d'être tué ou détruit
+void removeCGIPollFDs(std::vector<pollfd>& poll_fds, const CGIHandler* cgiHandler) {
+    removePollFD(poll_fds, cgiHandler->getInputPipeFd());
+    removePollFD(poll_fds, cgiHandler->getOutputPipeFd());
+    removePollFD(poll_fds, cgiHandler->getErrorPipeFd());
+}
+
+void setPollFDEvents(std::vector<pollfd>& poll_fds, int fd, short events) {
+    for (size_t i = 0; i < poll_fds.size(); ++i) {
+        if (poll_fds[i].fd == fd) {
+            poll_fds[i].events = events;
+            return;
+        }
+    }
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+    poll_fds.push_back(pfd);
+}
+
+// Suit un CGI en cours : contre-pression entre son pipe de sortie et le client,
+// limites de la location (délais, taille de sortie), puis finalisation de la
+// réponse une fois la sortie fermée et le process récupéré.
+// Retourne false si la connexion doit être fermée : le script a franchi une
+// limite alors que sa réponse était déjà entamée.
+bool manageCGI(int client_fd, ClientConnection& connection, std::vector<pollfd>& poll_fds) {
+    CGIHandler* cgiHandler = connection.getCgiHandler();
+
+    CGIHandler::Limit limit = cgiHandler->checkLimits();
+    if (limit != CGIHandler::WITHIN_LIMITS) {
+        std::string reason = limit == CGIHandler::OUTPUT_TOO_LARGE ? "max_output" : (limit == CGIHandler::SEND_TIMEOUT ? "send_timeout" : "read_timeout");
+        Logger::instance().log(WARNING, "CGI killed (" + reason + ") for client FD: " + to_string(client_fd));
+        Metrics::instance().increment(Metrics::labeled("cgi_killed_total", "reason", reason));
+        removeCGIPollFDs(poll_fds, cgiHandler);
+        cgiHandler->terminateCGI();
+        delete cgiHandler;
+        connection.setCgiHandler(NULL);
+        if (connection.isStreaming())
+            return false;
+
+        HTTPResponse* cgiResponse = new HTTPResponse();
+        if (limit == CGIHandler::OUTPUT_TOO_LARGE)
+            cgiResponse->beError(502, "CGI output exceeds the configured limit");
+        else
+            cgiResponse->beError(504, "CGI script timed out");
+        cgiResponse->setHeader("Connection", "close");
+        if (connection.getResponse())
+            delete connection.getResponse();
+        connection.setResponse(cgiResponse);
+        connection.prepareResponse();
+        setPollFDEvents(poll_fds, client_fd, POLLOUT);
+        return true;
+    }
+
+    if (cgiHandler->isOutputClosed()) {
+        int cgiStatus = cgiHandler->isCgiDone();
+        if (!cgiHandler->hasExited()) {
+            if (!cgiHandler->hasTimedOut())
+                return true;
+            cgiHandler->terminateCGI();
+            cgiStatus = cgiHandler->isCgiDone();
+        }
+        removeCGIPollFDs(poll_fds, cgiHandler);
+        if (!connection.isStreaming() && cgiStatus) {
+            HTTPResponse* cgiResponse = new HTTPResponse();
+            cgiResponse->beError(cgiHandler->getFailureStatus(), std::string("CGI process was stopped unintentionnally Exit code : ") + to_string(cgiStatus));
+            if (connection.getResponse())
+                delete connection.getResponse();
+            connection.setResponse(cgiResponse);
+            connection.prepareResponse();
+        } else {
+            connection.finishCGIOutput();
+            if (cgiStatus == 0)
+                connection.commitCacheCapture();
+        }
+        delete cgiHandler;
+        connection.setCgiHandler(NULL);
+        setPollFDEvents(poll_fds, client_fd, POLLOUT);
+        return true;
+    }
+
+    // stderr est toujours lu : un script ne doit pas bloquer sur un pipe plein
+    if (cgiHandler->getErrorPipeFd() != -1)
+        setPollFDEvents(poll_fds, cgiHandler->getErrorPipeFd(), POLLIN);
+    if (cgiHandler->hasPendingInput())
+        setPollFDEvents(poll_fds, cgiHandler->getInputPipeFd(), POLLOUT);
+    else
+        removePollFD(poll_fds, cgiHandler->getInputPipeFd());
+
+    // Contre-pression : on ne lit le CGI que tant que le client consomme
+    // (un upstream FastCGI n'a pas de sortie tant que la requête s'écrit)
+    if (cgiHandler->getOutputPipeFd() == -1) {
+        // rien à lire pour l'instant
+    } else if (!connection.isRelayBlocked() && connection.getPendingOutputSize() < ClientConnection::OUTPUT_HIGH_WATERMARK) {
+        setPollFDEvents(poll_fds, cgiHandler->getOutputPipeFd(), POLLIN);
+    } else {
+        removePollFD(poll_fds, cgiHandler->getOutputPipeFd());
+        cgiHandler->resetReadTimer();
+    }
+    // Corps de requête encore attendu : on lit le client tant que le CGI suit
+    short clientEvents = (connection.getPendingOutputSize() || connection.isRelayBlocked()) ? POLLOUT : 0;
+    if (cgiHandler->isAwaitingBody() && !cgiHandler->isInputBlocked()
+        && cgiHandler->getPendingInputSize() < ClientConnection::INPUT_HIGH_WATERMARK)
+        clientEvents |= POLLIN;
+    setPollFDEvents(poll_fds, client_fd, clientEvents);
+    return true;
+}
+
+// Lecture de la sortie d'un CGI (POLLIN ou POLLHUP). Retourne true si le pipe
+// a été fermé et doit quitter poll_fds.
+bool handleCGIOutputEvent(std::map<int, ClientConnection>& connections, std::vector<pollfd>& poll_fds, int fd) {
+    std::map<int, ClientConnection>::iterator it = std::find_if(
+        connections.begin(),
+        connections.end(),
+        MatchCGIOutputFD(fd)
+    );
+    if (it == connections.end())
+        return false;
+
+    ClientConnection& connection = it->second;
+    int status = connection.getServer()->handleCGIOutput(it->first, connection);
+    if (connection.getPendingOutputSize()) {
+        for (size_t j = 0; j < poll_fds.size(); ++j) {
+            if (poll_fds[j].fd == it->first) {
+                poll_fds[j].events |= POLLOUT;
+                break;
+            }
+        }
+    }
+    return status == 0;
+}
+
+// stderr d'un CGI (POLLIN, POLLHUP ou POLLERR) vidé vers les logs. Retourne
+// true si le pipe a été fermé et doit quitter poll_fds.
+bool handleCGIErrorEvent(std::map<int, ClientConnection>& connections, int fd) {
+    std::map<int, ClientConnection>::iterator it = std::find_if(
+        connections.begin(),
+        connections.end(),
+        MatchCGIErrorFD(fd)
+    );
+    if (it == connections.end())
+        return false;
+    return it->second.getCgiHandler()->readErrors() == 0;
+}
+
+// Ferme un client dont un CGI tourne encore : ses pipes quittent poll_fds
+// avant que le handler ne les ferme.
+void dropCGIClient(std::map<int, ClientConnection>& connections, std::vector<pollfd>& poll_fds, int client_fd) {
+    std::map<int, ClientConnection>::iterator it = connections.find(client_fd);
+    if (it != connections.end() && it->second.getCgiHandler()) {
+        removeCGIPollFDs(poll_fds, it->second.getCgiHandler());
+    }
+    removePollFD(poll_fds, client_fd);
+    close(client_fd);
+    connections.erase(client_fd);
+}
+
+// Rafraîchissements cgi_cache : CGI sans client suivis par ResponseCache.
+// `watched` garde les fds qu'ils ont inscrits dans poll_fds.
+void manageCacheRefreshes(std::vector<pollfd>& poll_fds, std::map<int, short>& watched) {
+    ResponseCache::instance().reapRefreshes();
+    std::map<int, short> wanted;
+    ResponseCache::instance().pollEvents(wanted);
+    for (std::map<int, short>::iterator it = watched.begin(); it != watched.end(); ++it) {
+        if (wanted.find(it->first) == wanted.end())
+            removePollFD(poll_fds, it->first);
+    }
+    for (std::map<int, short>::iterator it = wanted.begin(); it != wanted.end(); ++it)
+        setPollFDEvents(poll_fds, it->first, it->second);
+    watched.swap(wanted);
+}
+
+// Socket du helper CGISpawner, relancé s'il a été perdu. `watched` garde le
+// fd inscrit dans poll_fds (-1 : aucun).
+void manageSpawner(std::vector<pollfd>& poll_fds, int& watched) {
+    CGISpawner::instance().restartIfLost(curr_time_ms());
+    int fd = CGISpawner::instance().getSocketFd();
+    if (fd == watched)
+        return;
+    if (watched != -1)
+        removePollFD(poll_fds, watched);
+    if (fd != -1)
+        setPollFDEvents(poll_fds, fd, POLLIN);
+    watched = fd;
+}
+
 void initialize_random_generator() {
     std::ifstream urandom("/dev/urandom", std::ios::binary);
     unsigned int seed;
@@ -138,7 +356,8 @@ void manageConnections(std::map<int, ClientConnection>& connections, std::vector
         if (connection.getRequest() && connection.getRequest()->getConnectionClosed())
         {
             connection.resetConnection();
-            connections.erase(it_conn);
+            close(client_fd);
+            connections.erase(it_conn++);
             for (size_t i = 0; i < poll_fds.size(); ++i) {
                 if (poll_fds[i].fd == client_fd) {
                     poll_fds.erase(poll_fds.begin() + i);
@@ -149,6 +368,16 @@ void manageConnections(std::map<int, ClientConnection>& connections, std::vector
         }
 
         if (connection.getExchangeOver()) {
+            // Réponse annoncée "Connection: close" (corps de requête pas lu,
+            // timeout...) : la connexion ne resservira pas
+            HTTPResponse* response = connection.getResponse();
+            if (response && response->getStrHeader("Connection") == "close") {
+                connection.resetConnection();
+                removePollFD(poll_fds, client_fd);
+                close(client_fd);
+                connections.erase(it_conn++);
+                continue;
+            }
             connection.resetConnection();
             for (size_t i = 0; i < poll_fds.size(); ++i) {
                 if (poll_fds[i].fd == client_fd) {
@@ -161,42 +390,11 @@ void manageConnections(std::map<int, ClientConnection>& connections, std::vector
             continue;
         }
 
-        if (connection.getCgiHandler() && !connection.getCgiHandler()->hasReceivedBody()) {
-            if (connection.getCgiHandler()->hasTimedOut()) {
-                connection.getCgiHandler()->terminateCGI();
-                HTTPResponse* cgiResponse = new HTTPResponse();
-                cgiResponse->beError(504, "CGI script timed out");
-                cgiResponse->setHeader("Connection", "close");
-
-                delete connection.getCgiHandler();
-                connection.setCgiHandler(NULL);
-                if (connection.getResponse())
-                    delete connection.getResponse();
-                connection.setResponse(cgiResponse);
-                connection.prepareResponse();
-                ++it_conn;
-                continue;
-            }
-            //In case of CGI, sleeps 5ms to give a little time for the process to close, Otherwise waitpid ca return 0 indefinitely;
-            usleep(5000);
-            int cgiStatus = connection.getCgiHandler()->isCgiDone();
-            if (cgiStatus) {
-                HTTPResponse* cgiResponse = new HTTPResponse();
-                cgiResponse->beError(500, std::string("CGI process was stopped unintentionnally Exit code : ") + to_string(cgiStatus));
-                connection.getCgiHandler()->terminateCGI();
-                for (size_t i = 0; i < poll_fds.size(); ++i) {
-                    if (poll_fds[i].fd == connection.getCgiHandler()->getOutputPipeFd()) {
-                        poll_fds.erase(poll_fds.begin() + i);
-                        break;
-                    }
-                }
-                delete connection.getCgiHandler();
-                connection.setCgiHandler(NULL);
-                if (connection.getResponse())
-                    delete connection.getResponse();
-                connection.setResponse(cgiResponse);
-                connection.prepareResponse();
-                ++it_conn;
+        if (connection.getCgiHandler()) {
+            if (!manageCGI(client_fd, connection, poll_fds)) {
+                removePollFD(poll_fds, client_fd);
+                close(client_fd);
+                connections.erase(it_conn++);
                 continue;
             }
             ++it_conn;
@@ -204,12 +402,9 @@ void manageConnections(std::map<int, ClientConnection>& connections, std::vector
         }
 
         if (connection.getResponse() != NULL) {
-            for (size_t i = 0; i < poll_fds.size(); ++i) {
-                if (poll_fds[i].fd == client_fd) {
-                    poll_fds[i].events |= POLLOUT;
-                    break;
-                }
-            }
+            // Pas de lecture pendant l'envoi : une requête suivante (ou un
+            // corps refusé) reste dans le socket jusqu'à la fin de l'échange
+            setPollFDEvents(poll_fds, client_fd, POLLOUT);
             ++it_conn;
             continue;
         }
@@ -223,26 +418,28 @@ void manageConnections(std::map<int, ClientConnection>& connections, std::vector
                 connection.resetConnection();
 
             }
-            connections.erase(client_fd);
-            ++it_conn;
+            close(client_fd);
+            connections.erase(it_conn++);
             continue;
         }
 
 
-        if (request && request->isComplete() && request->getErrorCode() == 0 && !connection.getCgiHandler()) {
+        // Requête regroupée sur un CGI encore en vol : rien à réexaminer
+        if (connection.isAwaitingFlight() && !ResponseCache::instance().isFlightSettled(&connection, curr_time_ms())) {
+            ++it_conn;
+            continue;
+        }
+
+        if (request && (request->isComplete() || request->getStreamBody()) && request->getErrorCode() == 0 && !connection.getCgiHandler()) {
             Logger::instance().log(INFO, "Parsing OK, handling request for client fd: " + to_string(client_fd));
             connection.getServer()->handleHttpRequest(client_fd, connection);
+            connection.settleCGISlot();
+            connection.settleUploadSlot();
+            connection.settleCacheFlight();
             if (connection.getResponse() != NULL) {
 
                 connection.prepareResponse();
-
-                // Ensure POLLOUT is enabled
-                for (size_t i = 0; i < poll_fds.size(); ++i) {
-                    if (poll_fds[i].fd == client_fd) {
-                        poll_fds[i].events |= POLLOUT;
-                        break;
-                    }
-                }
+                setPollFDEvents(poll_fds, client_fd, POLLOUT);
             } else if (connection.getCgiHandler()) {
                 int cgi_input_fd = connection.getCgiHandler()->getInputPipeFd();
                 if (cgi_input_fd != -1) {
@@ -258,6 +455,13 @@ void manageConnections(std::map<int, ClientConnection>& connections, std::vector
                         }
                     }
                 }
+            } else if (connection.getUpload()) {
+                // Le corps de l'upload continue d'arriver sur le socket
+                setPollFDEvents(poll_fds, client_fd, POLLIN);
+            } else if (connection.isQueued() || connection.isAwaitingFlight()) {
+                // En file pour un slot CGI ou d'upload, ou en attente d'un CGI
+                // identique : le corps éventuel reste chez le client
+                setPollFDEvents(poll_fds, client_fd, 0);
             } else {
                 Logger::instance().log(ERROR, "No response or CGI handler after handleHttpRequest");
             }
@@ -280,9 +484,37 @@ int manageTimeouts(std::map<int, ClientConnection>& connections, std::vector<pol
         int client_fd = it_conn->first;
         HTTPRequest* request = it_conn->second.getRequest();
         ClientConnection& connection = it_conn->second;
-        if (connection.getCgiHandler())
+        if (connection.getCgiHandler()) {
             has_active_connections = true;
-        if ((!request && !connection.getUsed())|| connection.getExchangeOver() == true || connection.getCgiHandler()) {
+            // Sortie fermée mais process pas encore récupéré : on repasse vite
+            if (connection.getCgiHandler()->isOutputClosed() && min_remaining_time > CGI_REAP_POLL_MS)
+                min_remaining_time = CGI_REAP_POLL_MS;
+            // Réveil à l'échéance de cgi_read_timeout / cgi_send_timeout
+            else if (connection.getCgiHandler()->timeUntilLimit() < min_remaining_time)
+                min_remaining_time = connection.getCgiHandler()->timeUntilLimit();
+        }
+        if (connection.getUpload()) {
+            has_active_connections = true;
+            unsigned long idle = now - connection.getUpload()->getLastActivity();
+            if (idle >= TIMEOUT_MS) {
+                Logger::instance().log(INFO, "Upload timed out for client FD: " + to_string(client_fd));
+                HTTPResponse* timeoutResponse = new HTTPResponse();
+                timeoutResponse->beError(408);
+                timeoutResponse->setHeader("Connection", "close");
+                connection.setUpload(NULL);
+                if (connection.getResponse())
+                    delete connection.getResponse();
+                connection.setResponse(timeoutResponse);
+                connection.prepareResponse();
+                setPollFDEvents(poll_fds, client_fd, POLLOUT);
+            } else if (TIMEOUT_MS - idle < min_remaining_time) {
+                min_remaining_time = TIMEOUT_MS - idle;
+            }
+            ++it_conn;
+            continue;
+        }
+        // En file : l'attente est bornée par la file elle-même
+        if ((!request && !connection.getUsed())|| connection.getExchangeOver() == true || connection.getCgiHandler() || connection.isQueued()) {
             ++it_conn;
             continue;
         }
@@ -323,6 +555,47 @@ int manageTimeouts(std::map<int, ClientConnection>& connections, std::vector<pol
         }
     }
 
+    // Requêtes en file CGI ou d'upload : réveil à la libération d'un slot ou à l'expiration
+    long queue_timeout = CGILimiter::instance().pollTimeout(now);
+    if (queue_timeout >= 0) {
+        has_active_connections = true;
+        if (static_cast<unsigned long>(queue_timeout) < min_remaining_time)
+            min_remaining_time = queue_timeout;
+    }
+    long upload_queue_timeout = UploadLimiter::instance().pollTimeout(now);
+    if (upload_queue_timeout >= 0) {
+        has_active_connections = true;
+        if (static_cast<unsigned long>(upload_queue_timeout) < min_remaining_time)
+            min_remaining_time = upload_queue_timeout;
+    }
+    // Requêtes regroupées : réveil à la fin du CGI meneur ou à l'expiration
+    long flight_timeout = ResponseCache::instance().flightPollTimeout(now);
+    if (flight_timeout >= 0) {
+        has_active_connections = true;
+        if (static_cast<unsigned long>(flight_timeout) < min_remaining_time)
+            min_remaining_time = flight_timeout;
+    }
+    // Sessions modifiées : réveil pour le prochain lot d'écriture
+    long session_timeout = SessionStore::instance().pollTimeout(now);
+    if (session_timeout >= 0) {
+        has_active_connections = true;
+        if (static_cast<unsigned long>(session_timeout) < min_remaining_time)
+            min_remaining_time = session_timeout;
+    }
+    // Helper CGISpawner perdu : réveil pour le relancer
+    long spawner_timeout = CGISpawner::instance().pollTimeout(now);
+    if (spawner_timeout >= 0) {
+        has_active_connections = true;
+        if (static_cast<unsigned long>(spawner_timeout) < min_remaining_time)
+            min_remaining_time = spawner_timeout;
+    }
+    long refresh_timeout = ResponseCache::instance().refreshPollTimeout();
+    if (refresh_timeout >= 0) {
+        has_active_connections = true;
+        if (static_cast<unsigned long>(refresh_timeout) < min_remaining_time)
+            min_remaining_time = refresh_timeout;
+    }
+
     int poll_timeout;
     if (has_active_connections) {
         poll_timeout = static_cast<int>(min_remaining_time);
@@ -374,6 +647,38 @@ int main(int argc, char* argv[]) {
     const std::vector<ServerConfig>& serverConfigs = configParser.getServerConfigs();
     Logger::instance().log(INFO, to_string(serverConfigs.size()) + " servers successfully configured");
 
+    // Le helper est forké maintenant, tant que le processus est encore léger
+    for (size_t i = 0; i < serverConfigs.size(); ++i) {
+        if (serverConfigs[i].cgiSpawner) {
+            if (!CGISpawner::instance().start())
+                Logger::instance().log(WARNING, "CGI spawner unavailable, CGI scripts will be forked");
+            break;
+        }
+    }
+
+    // Un seul cache pour tous les serveurs : le plus grand cgi_cache_max_size
+    size_t cacheMaxSize = 0;
+    for (size_t i = 0; i < serverConfigs.size(); ++i)
+        cacheMaxSize = std::max(cacheMaxSize, serverConfigs[i].cgiCacheMaxSize);
+    if (cacheMaxSize)
+        ResponseCache::instance().setMaxSize(cacheMaxSize);
+
+    // Un seul store de sessions : le plus court session_flush_interval
+    // et les plus grands session_history_size et session_max_entries
+    unsigned long flushInterval = SessionStore::DEFAULT_FLUSH_INTERVAL;
+    size_t historySize = 0;
+    size_t maxEntries = 0;
+    for (size_t i = 0; i < serverConfigs.size(); ++i) {
+        flushInterval = i == 0 ? serverConfigs[i].sessionFlushInterval : std::min(flushInterval, serverConfigs[i].sessionFlushInterval);
+        historySize = std::max(historySize, serverConfigs[i].sessionHistorySize);
+        maxEntries = std::max(maxEntries, serverConfigs[i].sessionMaxEntries);
+    }
+    SessionStore::instance().setFlushInterval(flushInterval);
+    if (historySize)
+        SessionStore::instance().setHistorySize(historySize);
+    if (maxEntries)
+        SessionStore::instance().setMaxEntries(maxEntries);
+
     if (pipe(serverSignal::pipe_fd) == -1) {
         perror("pipe");
         exit(EXIT_FAILURE);
@@ -385,8 +690,12 @@ int main(int argc, char* argv[]) {
     sigemptyset(&sa.sa_mask);
     sa.sa_flags = 0;
     sigaction(SIGINT, &sa, NULL);
+    // Un client ou un CGI qui ferme sa lecture ne doit pas tuer le serveur
+    signal(SIGPIPE, SIG_IGN);
 
     std::map<int, ClientConnection> connections;
+    std::map<int, short> refreshFds;
+    int spawnerFd = -1;
 
     std::vector<Server*> servers;
     std::vector<Socket*> sockets;
@@ -429,7 +738,13 @@ int main(int argc, char* argv[]) {
 
     while (!stopServer) {
 
+        // Avant les connexions : un fd de l'ancien helper peut avoir été réutilisé
+        manageSpawner(poll_fds, spawnerFd);
         manageConnections(connections, poll_fds);
+        manageCacheRefreshes(poll_fds, refreshFds);
+        SessionStore::instance().flush(curr_time_ms());
+        for (size_t i = 0; i < servers.size(); ++i)
+            servers[i]->sweepUploads(curr_time_ms());
         int poll_timeout = manageTimeouts(connections, poll_fds);
 
         int poll_count = poll(&poll_fds[0], poll_fds.size(), poll_timeout);
@@ -464,24 +779,66 @@ int main(int argc, char* argv[]) {
                 continue;
             }
 
+            if (poll_fds[i].fd == spawnerFd) {
+                // Réponses du helper : les CGI lancés rejoignent poll_fds au tour suivant
+                CGISpawner::instance().handleEvents();
+                if (CGISpawner::instance().getSocketFd() != spawnerFd) {
+                    spawnerFd = -1;
+                    poll_fds.erase(poll_fds.begin() + i);
+                    --i;
+                }
+                continue;
+            }
+
             FDType fdType = getFDType(poll_fds[i].fd, fdToServerMap, connections);
 
             if (fdType == FD_UNKNOWN)
                 Logger::instance().log(DEBUG, std::string("Unknown FD type sent by poll, fd = ") + to_string(poll_fds[i].fd));
 
+            if (fdType == FD_CGI_ERROR) {
+                if (handleCGIErrorEvent(connections, poll_fds[i].fd)) {
+                    poll_fds.erase(poll_fds.begin() + i);
+                    --i;
+                }
+                continue;
+            }
+
+            if (fdType == FD_CACHE_REFRESH) {
+                if (ResponseCache::instance().handleRefreshEvent(poll_fds[i].fd, poll_fds[i].revents)) {
+                    refreshFds.erase(poll_fds[i].fd);
+                    poll_fds.erase(poll_fds.begin() + i);
+                    --i;
+                }
+                continue;
+            }
+
             // Gérer les erreurs
             if (poll_fds[i].revents & POLLERR) {
                 Logger::instance().log(ERROR, "Error on file descriptor: " + to_string(poll_fds[i].fd));
                 if (fdToServerMap.find(poll_fds[i].fd) != fdToServerMap.end()) {
                     // C'est un socket serveur
                     Logger::instance().log(ERROR, "Error on server socket detected in poll");
+                } else if (fdType == FD_CGI_INPUT) {
+                    // Le CGI a fermé son entrée standard sans tout lire
+                    std::map<int, ClientConnection>::iterator it = std::find_if(
+                        connections.begin(),
+                        connections.end(),
+                        MatchCGIInputFD(poll_fds[i].fd)
+                    );
+                    poll_fds.erase(poll_fds.begin() + i);
+                    --i;
+                    if (it != connections.end())
+                        it->second.getCgiHandler()->closeInputPipe();
+                } else if (fdType == FD_CGI_OUTPUT) {
+                    if (handleCGIOutputEvent(connections, poll_fds, poll_fds[i].fd)) {
+                        poll_fds.erase(poll_fds.begin() + i);
+                        --i;
+                    }
                 } else {
                     // C'est un socket client
                     Logger::instance().log(ERROR, "Error on client socket detected in poll");
-                    close(poll_fds[i].fd);
-                    connections.erase(poll_fds[i].fd);
-                    poll_fds.erase(poll_fds.begin() + i);
-                    --i;
+                    dropCGIClient(connections, poll_fds, poll_fds[i].fd);
+                    break;
                 }
                 continue;
             }
@@ -490,47 +847,23 @@ int main(int argc, char* argv[]) {
             if (poll_fds[i].revents & POLLHUP) {
                 if (fdType == FD_CLIENT_SOCKET) {
                     Logger::instance().log(INFO, "Disconnected client FD: " + to_string(poll_fds[i].fd));
-                    close(poll_fds[i].fd);
-                    connections.erase(poll_fds[i].fd);
-                    poll_fds.erase(poll_fds.begin() + i);
-                    --i;
-                } else if (fdType == FD_CGI_OUTPUT) {
-
-                    // Trouver la connexion associée
+                    dropCGIClient(connections, poll_fds, poll_fds[i].fd);
+                    break;
+                } else if (fdType == FD_CGI_INPUT) {
                     std::map<int, ClientConnection>::iterator it = std::find_if(
                         connections.begin(),
                         connections.end(),
-                        MatchCGIOutputFD(poll_fds[i].fd)
+                        MatchCGIInputFD(poll_fds[i].fd)
                     );
-                    if (it != connections.end()) {
-                        ClientConnection& connection = it->second;
-                        connection.getCgiHandler()->readFromCGI();
-                        // Fermer le descripteur de sortie du pipe
-                        connection.getCgiHandler()->closeOutputPipe();
+                    poll_fds.erase(poll_fds.begin() + i);
+                    --i;
+                    if (it != connections.end())
+                        it->second.getCgiHandler()->closeInputPipe();
+                } else if (fdType == FD_CGI_OUTPUT) {
+                    // Le CGI a terminé d'écrire : on vide ce qui reste dans le pipe
+                    if (handleCGIOutputEvent(connections, poll_fds, poll_fds[i].fd)) {
                         poll_fds.erase(poll_fds.begin() + i);
                         --i;
-
-                        std::string cgiOutput = connection.getCgiHandler()->getCGIOutput();
-                        HTTPResponse* cgiResponse = new HTTPResponse();
-                        cgiResponse->parseCGIOutput(cgiOutput);
-
-						cgiResponse->setHeader("Connection", "keep-alive");
-
-                        if (connection.getResponse())
-                            delete connection.getResponse();
-
-                        connection.setResponse(cgiResponse);
-                        connection.prepareResponse();
-
-                        delete connection.getCgiHandler();
-                        connection.setCgiHandler(NULL);
-
-                        for (size_t j = 0; j < poll_fds.size(); ++j) {
-                            if (poll_fds[j].fd == it->first) {
-                                poll_fds[j].events |= POLLOUT;
-                                break;
-                            }
-                        }
                     }
                 }
                 continue;
@@ -591,48 +924,30 @@ int main(int argc, char* argv[]) {
                     if (conn_it != connections.end()) {
                         ClientConnection& connection = conn_it->second;
                         Server* server = connection.getServer();
-                        server->handleClient(poll_fds[i].fd, connection);
+                        if (connection.getCgiHandler()) {
+                            // Suite du corps d'une requête déjà confiée au CGI
+                            if (connection.getCgiHandler()->isAwaitingBody()
+                                && !server->receiveCGIBody(poll_fds[i].fd, connection)) {
+                                dropCGIClient(connections, poll_fds, poll_fds[i].fd);
+                                break;
+                            }
+                        } else if (connection.getUpload()) {
+                            // Suite du corps d'un upload multipart
+                            if (!server->receiveUploadBody(poll_fds[i].fd, connection)) {
+                                dropCGIClient(connections, poll_fds, poll_fds[i].fd);
+                                break;
+                            }
+                        } else {
+                            server->handleClient(poll_fds[i].fd, connection);
+                        }
                     }
                     continue;
                 } else if (fdType == FD_CGI_OUTPUT) {
-                        std::map<int, ClientConnection>::iterator it = std::find_if(
-                        connections.begin(),
-                        connections.end(),
-                        MatchCGIOutputFD(poll_fds[i].fd)
-                    );
-                    ClientConnection& connection = it->second;
-                    CGIHandler* cgiHandler = connection.getCgiHandler();
-                    // normalement pas indispensable pusiaue checke dans manageconnections
-                    // if (cgiHandler->hasTimedOut()) {
-                    //     cgiHandler->terminateCGI();
-                    //     connection.setResponse(new HTTPResponse());
-                    //     connection.getResponse()->beError(504);
-                    //     connection.prepareResponse();
-                    // } else {
-                        int received = cgiHandler->readFromCGI();
-                        if (!received) {
-                            poll_fds.erase(poll_fds.begin() + i);
-                            --i;
-
-                            std::string cgiOutput = cgiHandler->getCGIOutput();
-                            HTTPResponse* cgiResponse = new HTTPResponse();
-                            cgiResponse->parseCGIOutput(cgiOutput);
-							cgiResponse->setHeader("Connection", "keep-alive");
-                            if (connection.getResponse())
-                                delete connection.getResponse();
-                            connection.setResponse(cgiResponse);
-                            connection.prepareResponse();
-
-                            // Activer POLLOUT sur le descripteur du client pour envoyer la réponse
-                            for (size_t j = 0; j < poll_fds.size(); ++j) {
-                                if (poll_fds[j].fd == it->first) {  // it->first est le fd du client associé à cette connexion
-                                    poll_fds[j].events |= POLLOUT;
-                                    break;
-                                }
-                            }
-                            continue;
-                        }
-                    // }
+                    if (handleCGIOutputEvent(connections, poll_fds, poll_fds[i].fd)) {
+                        poll_fds.erase(poll_fds.begin() + i);
+                        --i;
+                        continue;
+                    }
                 } else {
                     Logger::instance().log(WARNING, std::string("Unhandled POLLIN event on fd : ") + to_string(poll_fds[i].fd));
                 }
@@ -653,19 +968,9 @@ int main(int argc, char* argv[]) {
                     ClientConnection& connection = it->second;
                     int sending = connection.getCgiHandler()->writeToCGI();
                     if (!sending) {
-                        poll_fds[i].events &= ~POLLOUT;
-                        close(poll_fds[i].fd);
+                        // Entrée entièrement écrite, le pipe est déjà fermé par writeToCGI
                         poll_fds.erase(poll_fds.begin() + i);
                         --i;
-
-                        int cgi_output_fd = connection.getCgiHandler()->getOutputPipeFd();
-                        if (cgi_output_fd != -1) {
-                            pollfd cgiOutput;
-                            cgiOutput.fd = cgi_output_fd;
-                            cgiOutput.events = POLLIN;
-                            cgiOutput.revents = 0;
-                            poll_fds.push_back(cgiOutput);
-                        }
                         continue;
                     }
                 } else {
@@ -681,6 +986,8 @@ int main(int argc, char* argv[]) {
 
     // Nettoyer les objets HTTPRequest restants
     connections.clear();
+    CGISpawner::instance().stop();
+    SessionStore::instance().flushAll();
 
     // Nettoyer la mémoire
     for (size_t i = 0; i < servers.size(); ++i) {
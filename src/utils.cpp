@@ -1,3 +1,4 @@
+#include <limits.h>
 #include "Utils.hpp"
 
 namespace serverSignal {
@@ -11,8 +12,73 @@ namespace serverSignal {
 }
 
 
+std::string httpDate(time_t when) {
+    char buffer[64];
+    struct tm gmt;
+    gmtime_r(&when, &gmt);
+    strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    return buffer;
+}
+
 unsigned long curr_time_ms() {
     struct timeval tv;
     gettimeofday(&tv, NULL);
     return static_cast<unsigned long>(tv.tv_sec) * 1000 + tv.tv_usec / 1000;
 }
+
+// Chemin absolu sans realpath() : le répertoire courant ne change pas après
+// le démarrage, il n'est lu qu'une fois
+std::string absolutePath(const std::string& path) {
+    static std::string cwd;
+    if (!path.empty() && path[0] == '/')
+        return path;
+    if (cwd.empty()) {
+        char buffer[PATH_MAX];
+        if (getcwd(buffer, sizeof(buffer)) != NULL)
+            cwd = buffer;
+    }
+    if (path.compare(0, 2, "./") == 0)
+        return cwd + path.substr(1);
+    return cwd + "/" + path;
+}
+
+bool base64Decode(const std::string& input, std::string& output) {
+    static const std::string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    output.clear();
+    unsigned int buffer = 0;
+    int bits = 0;
+    size_t i = 0;
+    for (; i < input.size() && input[i] != '='; ++i) {
+        size_t value = alphabet.find(input[i]);
+        if (value == std::string::npos)
+            return false;
+        buffer = (buffer << 6) | value;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            output += static_cast<char>((buffer >> bits) & 0xFF);
+        }
+    }
+    // Seul le padding peut suivre, et jamais plus de deux '='
+    if (input.size() - i > 2 || input.find_first_not_of('=', i) != std::string::npos)
+        return false;
+    return bits < 6;
+}
+
+std::string base64Encode(const std::string& input) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string output;
+    output.reserve((input.size() + 2) / 3 * 4);
+    for (size_t i = 0; i < input.size(); i += 3) {
+        unsigned int group = static_cast<unsigned char>(input[i]) << 16;
+        if (i + 1 < input.size())
+            group |= static_cast<unsigned char>(input[i + 1]) << 8;
+        if (i + 2 < input.size())
+            group |= static_cast<unsigned char>(input[i + 2]);
+        output += alphabet[(group >> 18) & 0x3F];
+        output += alphabet[(group >> 12) & 0x3F];
+        output += i + 1 < input.size() ? alphabet[(group >> 6) & 0x3F] : '=';
+        output += i + 2 < input.size() ? alphabet[group & 0x3F] : '=';
+    }
+    return output;
+}
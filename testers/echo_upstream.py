@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+# echo_upstream.py
+#
+# Upstream SCGI / uwsgi minimal pour tester scgi_pass et uwsgi_pass :
+# renvoie la méthode, l'URI, les variables reçues et le corps de la requête.
+# ?status=404 change le statut de la réponse.
+#
+#   python3 testers/echo_upstream.py scgi /tmp/scgi.sock
+#   python3 testers/echo_upstream.py uwsgi /tmp/uwsgi.sock
+#
+# Comme les vrais serveurs, il ferme la connexion après chaque réponse ; en
+# uwsgi, il répond avec une ligne de statut HTTP comme uWSGI.
+
+import os
+import socketserver
+import struct
+import sys
+from urllib.parse import parse_qs
+
+
+def read_exact(rfile, size):
+    data = rfile.read(size)
+    if len(data) != size:
+        raise EOFError("truncated request")
+    return data
+
+
+def read_scgi(rfile):
+    length = b""
+    while not length.endswith(b":"):
+        length += read_exact(rfile, 1)
+    block = read_exact(rfile, int(length[:-1]))
+    if read_exact(rfile, 1) != b",":
+        raise ValueError("malformed netstring")
+    items = block.split(b"\0")[:-1]
+    return {items[i].decode(): items[i + 1].decode() for i in range(0, len(items), 2)}
+
+
+def read_uwsgi(rfile):
+    _, size, _ = struct.unpack("<BHB", read_exact(rfile, 4))
+    block = read_exact(rfile, size)
+    env, offset = {}, 0
+    while offset < size:
+        (key_size,) = struct.unpack_from("<H", block, offset)
+        key = block[offset + 2:offset + 2 + key_size].decode()
+        offset += 2 + key_size
+        (value_size,) = struct.unpack_from("<H", block, offset)
+        env[key] = block[offset + 2:offset + 2 + value_size].decode()
+        offset += 2 + value_size
+    return env
+
+
+class EchoHandler(socketserver.StreamRequestHandler):
+    def handle(self):
+        env = read_scgi(self.rfile) if PROTOCOL == "scgi" else read_uwsgi(self.rfile)
+        body = read_exact(self.rfile, int(env.get("CONTENT_LENGTH") or 0))
+        status = parse_qs(env.get("QUERY_STRING", "")).get("status", ["200"])[0]
+
+        text = "%s %s\n" % (env.get("REQUEST_METHOD"), env.get("REQUEST_URI"))
+        text += "".join("%s=%s\n" % item for item in sorted(env.items()))
+        payload = text.encode() + b"\n" + body
+        head = "HTTP/1.1 %s Echo\r\n" % status if PROTOCOL == "uwsgi" else "Status: %s Echo\r\n" % status
+        head += "Content-Type: text/plain\r\nContent-Length: %d\r\n\r\n" % len(payload)
+        self.wfile.write(head.encode() + payload)
+
+
+class Server(socketserver.ThreadingMixIn, socketserver.UnixStreamServer):
+    daemon_threads = True
+    request_queue_size = 128
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3 or sys.argv[1] not in ("scgi", "uwsgi"):
+        sys.exit("usage: echo_upstream.py scgi|uwsgi /path/to/socket")
+    PROTOCOL, path = sys.argv[1], sys.argv[2]
+    if os.path.exists(path):
+        os.unlink(path)
+    Server(path, EchoHandler).serve_forever()